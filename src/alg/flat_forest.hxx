@@ -0,0 +1,223 @@
+#ifndef _glia_alg_flat_forest_hxx_
+#define _glia_alg_flat_forest_hxx_
+
+#include "util/mp.hxx"
+
+namespace glia {
+namespace alg {
+
+// Classification forest compiled into flat node arrays for inference
+// Nodes of all trees are laid out breadth-first, structure of arrays:
+// * feature: split feature index, or -1 for leaves
+// * threshold: samples with x[feature] <= threshold go left
+// * next: left child of splits (right child is next + 1), class of leaves
+// Thresholds are rounded down to FVal, so that comparing FVal inputs
+// against them decides exactly as comparing against the source doubles
+// Arrays are either owned (built by addTree) or viewed in memory kept
+// alive by an owner (e.g. a mapped model file, see forest_file.hxx)
+class FlatForest {
+ public:
+  typedef FlatForest Self;
+  typedef std::shared_ptr<Self> Pointer;
+  typedef std::shared_ptr<const Self> ConstPointer;
+
+  // Samples per block; a block is run through all trees before the next
+  static const uint BLOCK_SIZE = 64;
+
+  // Node arrays viewed in external memory
+  struct View {
+    int const* feature = nullptr;
+    FVal const* threshold = nullptr;
+    int const* next = nullptr;
+    int const* roots = nullptr;
+    int const* labels = nullptr;
+    uint nNode = 0;
+    uint nTree = 0;
+    uint nClass = 0;
+    uint nFeature = 0;
+  };
+
+ protected:
+  std::vector<int> m_feature;
+  std::vector<FVal> m_threshold;
+  std::vector<int> m_next;
+  std::vector<int> m_roots;
+  std::vector<int> m_labels;  // Class -> label
+  uint m_nClass = 0;
+  uint m_nFeature = 0;
+  View m_view;
+  std::shared_ptr<const void> m_viewOwner;
+
+ public:
+  FlatForest () {}
+
+  void clear () {
+    m_feature.clear();
+    m_threshold.clear();
+    m_next.clear();
+    m_roots.clear();
+    m_labels.clear();
+    m_nClass = 0;
+    m_nFeature = 0;
+    m_view = View();
+    m_viewOwner.reset();
+  }
+
+  // View external node arrays, kept alive by owner
+  void view (View const& v, std::shared_ptr<const void> const& owner) {
+    clear();
+    m_view = v;
+    m_viewOwner = owner;
+  }
+
+  bool viewing () const { return m_view.feature != nullptr; }
+
+  bool empty () const { return trees() == 0; }
+
+  uint trees () const { return viewing()? m_view.nTree: m_roots.size(); }
+
+  uint nodes () const { return viewing()? m_view.nNode: m_feature.size(); }
+
+  uint classes () const { return viewing()? m_view.nClass: m_nClass; }
+
+  // Minimum sample dimension
+  uint features () const
+  { return viewing()? m_view.nFeature: m_nFeature; }
+
+  // Node arrays, owned or viewed
+  View arrays () const {
+    if (viewing()) { return m_view; }
+    View ret;
+    ret.feature = m_feature.data();
+    ret.threshold = m_threshold.data();
+    ret.next = m_next.data();
+    ret.roots = m_roots.data();
+    ret.labels = m_labels.data();
+    ret.nNode = m_feature.size();
+    ret.nTree = m_roots.size();
+    ret.nClass = m_nClass;
+    ret.nFeature = m_nFeature;
+    return ret;
+  }
+
+  // Label of class c; the class itself if no labels were set
+  int label (uint c) const {
+    int const* labels = viewing()? m_view.labels: m_labels.data();
+    return labels && c < classes()? labels[c]: c;
+  }
+
+  // Raise minimum sample dimension to n, e.g. to the training dimension
+  void setFeatures (uint n) {
+    if (viewing()) { perr("Error: cannot modify viewed forest..."); }
+    m_nFeature = std::max(m_nFeature, n);
+  }
+
+  // Set labels of classes 0, 1, ...
+  void setLabels (std::vector<int> const& labels) {
+    if (viewing()) { perr("Error: cannot modify viewed forest..."); }
+    m_labels = labels;
+    m_nClass = std::max<uint>(m_nClass, labels.size());
+  }
+
+  // Append tree given its root and node accessors
+  // fsplit(node, feature, threshold, left, right): false for leaves,
+  //   otherwise sets split feature, threshold and children
+  // fleaf(node): class index of leaf
+  template <typename TNode, typename SFunc, typename LFunc> void
+  addTree (TNode const& root, SFunc fsplit, LFunc fleaf) {
+    if (viewing()) { perr("Error: cannot modify viewed forest..."); }
+    std::vector<std::pair<TNode, int>> queue;
+    queue.emplace_back(root, addNodes(1));
+    m_roots.push_back(queue.back().second);
+    for (uint qi = 0; qi < queue.size(); ++qi) {
+      TNode node = queue[qi].first;
+      int k = queue[qi].second;
+      int feature;
+      double threshold;
+      TNode left, right;
+      if (fsplit(node, feature, threshold, left, right)) {
+        m_feature[k] = feature;
+        m_threshold[k] = roundDown(threshold);
+        m_next[k] = addNodes(2);
+        queue.emplace_back(left, m_next[k]);
+        queue.emplace_back(right, m_next[k] + 1);
+        m_nFeature = std::max<uint>(m_nFeature, feature + 1);
+      }
+      else {
+        m_next[k] = fleaf(node);
+        m_nClass = std::max<uint>(m_nClass, m_next[k] + 1);
+      }
+    }
+  }
+
+  // Per class votes of n samples of dimension d, row-major
+  // votes: n * classes() counts, sample by sample
+  // maxThreads: 0 to use OMP_NUM_THREADS
+  void vote (std::vector<uint16>& votes, FVal const* X, uint n, uint d,
+             uint maxThreads) const {
+    View a = arrays();
+    if (n > 0 && d < a.nFeature)
+    { perr("Error: sample dimension smaller than forest's..."); }
+    votes.assign(n * a.nClass, 0);
+    uint nBlock = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    auto fblock = [&](int b) {
+      uint s0 = b * BLOCK_SIZE, s1 = std::min<uint>(s0 + BLOCK_SIZE, n);
+      for (uint t = 0; t < a.nTree; ++t) {
+        int root = a.roots[t];
+        for (uint s = s0; s < s1; ++s) {
+          FVal const* x = X + s * d;
+          int k = root;
+          while (a.feature[k] >= 0)
+          { k = a.next[k] + !(x[a.feature[k]] <= a.threshold[k]); }
+          ++votes[s * a.nClass + a.next[k]];
+        }
+      }
+    };
+    if (nBlock > 1) { parfor(0, nBlock, false, fblock, maxThreads); }
+    else if (nBlock == 1) { fblock(0); }
+  }
+
+  // Majority class of n samples of dimension d, row-major
+  // Ties go to the smaller class
+  void predict (std::vector<int>& classes, FVal const* X, uint n, uint d,
+                uint maxThreads) const {
+    std::vector<uint16> votes;
+    vote(votes, X, n, d, maxThreads);
+    uint nClass = this->classes();
+    classes.resize(n);
+    for (uint s = 0; s < n; ++s) {
+      uint16 const* v = &votes[s * nClass];
+      classes[s] = std::max_element(v, v + nClass) - v;
+    }
+  }
+
+  // Largest FVal not above t
+  static FVal roundDown (double t) {
+    FVal ret = t;
+    if (ret > t)
+    { ret = std::nextafter(ret, -std::numeric_limits<FVal>::infinity()); }
+    return ret;
+  }
+
+  // Approximate bytes held, excluding viewed memory
+  size_t bytes () const {
+    return sizeof(Self) + (m_feature.capacity() + m_next.capacity() +
+                           m_roots.capacity() + m_labels.capacity()) *
+        sizeof(int) + m_threshold.capacity() * sizeof(FVal);
+  }
+
+ protected:
+  // Append n nodes, returning the first
+  int addNodes (uint n) {
+    int ret = m_feature.size();
+    m_feature.resize(ret + n, -1);
+    m_threshold.resize(ret + n, 0);
+    m_next.resize(ret + n, 0);
+    return ret;
+  }
+};
+
+};
+};
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef _glia_alg_forest_file_hxx_
+#define _glia_alg_forest_file_hxx_
+
+#include "alg/flat_forest.hxx"
+#include "util/mapped_file.hxx"
+#include <cstring>
+#include <fstream>
+
+namespace glia {
+namespace alg {
+
+// Binary file of flat forests, memory-mapped on read so that processes
+// loading the same file share its pages
+// Layout (native byte order):
+// * ForestFileHeader
+// * ForestFileEntry per forest
+// * per forest, each 64-byte aligned: roots, feature, threshold, next,
+//   labels (see FlatForest)
+// Forests are stage-major: forest i is category i % nCat of stage
+// i / nCat
+// Version 2: nFeature is the sample dimension forests were trained on
+// (version 1: largest feature used plus one; no longer read)
+static const char FOREST_FILE_MAGIC[8] =
+    {'G', 'L', 'I', 'A', 'F', 'R', 'S', 'T'};
+static const uint32 FOREST_FILE_VERSION = 2;
+static const uint32 FOREST_FILE_BYTE_ORDER = 0x01020304;
+static const uint64 FOREST_FILE_ALIGN = 64;
+
+struct ForestFileHeader {
+  char magic[8];
+  uint32 version;
+  uint32 byteOrder;
+  uint32 fvalSize;  // Bytes per threshold
+  uint32 nForest;
+  uint32 nCat;
+  uint32 reserved[9];
+};
+
+struct ForestFileEntry {
+  uint64 offset;  // Of roots, from file start
+  uint32 nTree;
+  uint32 nNode;
+  uint32 nClass;
+  uint32 nFeature;
+  uint32 nLabel;
+  uint32 reserved;
+};
+
+
+inline uint64 forestFileAlign (uint64 n)
+{ return (n + FOREST_FILE_ALIGN - 1) & ~(FOREST_FILE_ALIGN - 1); }
+
+
+// Offsets of roots, feature, threshold, next, labels and end of a
+// forest from its entry offset
+inline void
+forestFileOffsets (uint64* offsets, ForestFileEntry const& e, uint fvalSize)
+{
+  offsets[0] = e.offset;
+  offsets[1] = forestFileAlign(offsets[0] + e.nTree * sizeof(int));
+  offsets[2] = forestFileAlign(offsets[1] + e.nNode * sizeof(int));
+  offsets[3] = forestFileAlign(offsets[2] + e.nNode * fvalSize);
+  offsets[4] = forestFileAlign(offsets[3] + e.nNode * sizeof(int));
+  offsets[5] = forestFileAlign(offsets[4] + e.nLabel * sizeof(int));
+}
+
+
+// Whether node indices of v are in range: roots within nodes, split
+// features below nFeature, split children within nodes and after their
+// parent (so that every path ends at a leaf), leaf classes below nClass
+inline bool isValidForest (FlatForest::View const& v)
+{
+  for (uint t = 0; t < v.nTree; ++t)
+  { if (v.roots[t] < 0 || (uint)v.roots[t] >= v.nNode) { return false; } }
+  for (uint k = 0; k < v.nNode; ++k) {
+    int f = v.feature[k], next = v.next[k];
+    if (f >= 0) {
+      if ((uint)f >= v.nFeature || next <= (int)k ||
+          (uint)next + 1 >= v.nNode) { return false; }
+    }
+    else if (f != -1 || next < 0 || (uint)next >= v.nClass) { return false; }
+  }
+  return true;
+}
+
+
+inline bool isForestFile (std::string const& file)
+{
+  std::ifstream fs(file, std::ios::binary);
+  char magic[sizeof(FOREST_FILE_MAGIC)];
+  return fs.read(magic, sizeof(magic)) &&
+      std::memcmp(magic, FOREST_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+
+// Write forests, nCat per stage
+inline void
+writeForestFile (std::string const& file,
+                 std::vector<FlatForest const*> const& forests, uint nCat)
+{
+  if (nCat == 0 || forests.size() % nCat != 0)
+  { perr("Error: forest count not a multiple of category count..."); }
+  ForestFileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, FOREST_FILE_MAGIC, sizeof(h.magic));
+  h.version = FOREST_FILE_VERSION;
+  h.byteOrder = FOREST_FILE_BYTE_ORDER;
+  h.fvalSize = sizeof(FVal);
+  h.nForest = forests.size();
+  h.nCat = nCat;
+  std::vector<ForestFileEntry> entries(forests.size());
+  std::vector<FlatForest::View> views(forests.size());
+  uint64 offset = forestFileAlign(
+      sizeof(h) + entries.size() * sizeof(ForestFileEntry));
+  uint64 offsets[6];
+  for (uint i = 0; i < forests.size(); ++i) {
+    views[i] = forests[i]->arrays();
+    auto& e = entries[i];
+    std::memset(&e, 0, sizeof(e));
+    e.offset = offset;
+    e.nTree = views[i].nTree;
+    e.nNode = views[i].nNode;
+    e.nClass = views[i].nClass;
+    e.nFeature = views[i].nFeature;
+    e.nLabel = views[i].labels? views[i].nClass: 0;
+    forestFileOffsets(offsets, e, sizeof(FVal));
+    offset = offsets[5];
+  }
+  std::ofstream fs(file, std::ios::binary);
+  if (!fs.is_open()) { perr("Error: cannot create forest file..."); }
+  auto fpad = [&fs](uint64 to) {
+    static const char zeros[FOREST_FILE_ALIGN] = {};
+    uint64 at = fs.tellp();
+    if (to > at) { fs.write(zeros, to - at); }
+  };
+  fs.write((char const*)&h, sizeof(h));
+  fs.write((char const*)entries.data(),
+           entries.size() * sizeof(ForestFileEntry));
+  for (uint i = 0; i < forests.size(); ++i) {
+    auto const& e = entries[i];
+    auto const& v = views[i];
+    forestFileOffsets(offsets, e, sizeof(FVal));
+    fpad(offsets[0]);
+    fs.write((char const*)v.roots, e.nTree * sizeof(int));
+    fpad(offsets[1]);
+    fs.write((char const*)v.feature, e.nNode * sizeof(int));
+    fpad(offsets[2]);
+    fs.write((char const*)v.threshold, e.nNode * sizeof(FVal));
+    fpad(offsets[3]);
+    fs.write((char const*)v.next, e.nNode * sizeof(int));
+    fpad(offsets[4]);
+    fs.write((char const*)v.labels, e.nLabel * sizeof(int));
+  }
+  if (!fs) { perr("Error: cannot write forest file..."); }
+}
+
+
+// Map forests from file, nCat per stage; returns nCat
+// Forests view the mapped pages, except thresholds written with another
+// FVal, which are converted (double to float rounds down, see FlatForest)
+inline uint
+readForestFile (std::vector<FlatForest>& forests, std::string const& file)
+{
+  // Keeps the mapping and converted thresholds alive
+  struct Owner {
+    MappedFile file;
+    std::vector<std::vector<FVal>> thresholds;
+    Owner (std::string const& f) : file(f) {}
+  };
+  auto owner = std::make_shared<Owner>(file);
+  char const* data = owner->file.data();
+  uint64 size = owner->file.size();
+  ForestFileHeader h;
+  if (size < sizeof(h)) { perr("Error: invalid forest file..."); }
+  std::memcpy(&h, data, sizeof(h));
+  if (std::memcmp(h.magic, FOREST_FILE_MAGIC, sizeof(h.magic)) != 0)
+  { perr("Error: invalid forest file..."); }
+  if (h.byteOrder != FOREST_FILE_BYTE_ORDER)
+  { perr("Error: forest file of another byte order..."); }
+  if (h.version != FOREST_FILE_VERSION)
+  { perr("Error: unsupported forest file version..."); }
+  if (h.fvalSize != sizeof(float) && h.fvalSize != sizeof(double))
+  { perr("Error: invalid forest file threshold size..."); }
+  if (h.nCat == 0 || h.nForest % h.nCat != 0)
+  { perr("Error: invalid forest file category count..."); }
+  if (size < sizeof(h) + h.nForest * sizeof(ForestFileEntry))
+  { perr("Error: truncated forest file..."); }
+  ForestFileEntry const* entries =
+      reinterpret_cast<ForestFileEntry const*>(data + sizeof(h));
+  forests.assign(h.nForest, FlatForest());
+  owner->thresholds.reserve(h.nForest);
+  uint64 offsets[6];
+  for (uint i = 0; i < h.nForest; ++i) {
+    auto const& e = entries[i];
+    forestFileOffsets(offsets, e, h.fvalSize);
+    if (e.offset % FOREST_FILE_ALIGN != 0 || offsets[5] < e.offset ||
+        offsets[4] + e.nLabel * sizeof(int) > size ||
+        (e.nLabel != 0 && e.nLabel != e.nClass))
+    { perr("Error: corrupt forest file..."); }
+    FlatForest::View v;
+    v.roots = reinterpret_cast<int const*>(data + offsets[0]);
+    v.feature = reinterpret_cast<int const*>(data + offsets[1]);
+    v.next = reinterpret_cast<int const*>(data + offsets[3]);
+    v.labels = e.nLabel > 0?
+        reinterpret_cast<int const*>(data + offsets[4]): nullptr;
+    v.nTree = e.nTree;
+    v.nNode = e.nNode;
+    v.nClass = e.nClass;
+    v.nFeature = e.nFeature;
+    if (h.fvalSize == sizeof(FVal)) {
+      v.threshold = reinterpret_cast<FVal const*>(data + offsets[2]);
+    } else {
+      owner->thresholds.emplace_back(e.nNode);
+      auto& t = owner->thresholds.back();
+      if (h.fvalSize == sizeof(double)) {
+        double const* src =
+            reinterpret_cast<double const*>(data + offsets[2]);
+        for (uint k = 0; k < e.nNode; ++k)
+        { t[k] = FlatForest::roundDown(src[k]); }
+      } else {
+        float const* src = reinterpret_cast<float const*>(data + offsets[2]);
+        std::copy(src, src + e.nNode, t.begin());
+      }
+      v.threshold = t.data();
+    }
+    if (e.nNode == 0 && e.nTree == 0) { continue; }  // Empty forest
+    if (!isValidForest(v)) { perr("Error: corrupt forest file..."); }
+    forests[i].view(v, owner);
+  }
+  return h.nCat;
+}
+
+};
+};
+
+#endif
@@ -134,6 +134,15 @@ class MLP2 : public virtual opt::TFunction<Eigen::VectorXd> {
 };
 
 
+// Feature vector as Eigen vector, without copying
+inline Eigen::Map<const Eigen::Matrix<FVal, Eigen::Dynamic, 1>>
+mapInput (std::vector<FVal> const& x)
+{
+  return Eigen::Map<const Eigen::Matrix<FVal, Eigen::Dynamic, 1>>
+      (x.data(), x.size());
+}
+
+
 class MLP2v : public virtual opt::TFunction<std::vector<FVal>> {
  public:
   typedef opt::TFunction<std::vector<FVal>> Super;
@@ -167,12 +176,12 @@ class MLP2v : public virtual opt::TFunction<std::vector<FVal>> {
 
   double operator() (Input const& x) override {
     return _mlp->operator()(
-        Eigen::Map<const Eigen::VectorXd>(x.data(), x.size()));
+        mapInput(x).cast<double>());
   }
 
   double operator() (double* g, Input const& x) override {
     return _mlp->operator()(
-        g, Eigen::Map<const Eigen::VectorXd>(x.data(), x.size()));
+        g, mapInput(x).cast<double>());
   }
 
   int dim () const override { return _mlp->dim(); }
@@ -226,7 +235,7 @@ class EnsembleMLP2v : public virtual opt::TFunction<std::vector<FVal>> {
 
   double operator() (Input const& x) override {
     return models[fdist(x)]->operator()(
-        Eigen::Map<const Eigen::VectorXd>(x.data(), x.size()));
+        mapInput(x).cast<double>());
   }
 
   double operator() (double* g, Input const& x) override {
@@ -1,7 +1,9 @@
 #ifndef _glia_alg_rf_hxx_
 #define _glia_alg_rf_hxx_
 
+#include "alg/forest_file.hxx"
 #include "shogun_helpers.hxx"
+#include <mutex>
 #include <shogun/ensemble/MajorityVote.h>
 #include <shogun/io/serialization/JsonDeserializer.h>
 #include <shogun/io/serialization/JsonSerializer.h>
@@ -9,12 +11,72 @@
 #include <shogun/io/stream/ByteArrayOutputStream.h>
 #include <shogun/lib/any.h>
 #include <shogun/machine/RandomForest.h>
+#include <shogun/multiclass/tree/CARTree.h>
 
 using namespace shogun;
 
 namespace glia {
 namespace alg {
 
+// Compile the CART trees of a trained shogun forest into flat
+// Leaves flat empty if the forest cannot be compiled (untrained, nominal
+// features or unexpected internals), so that callers fall back to shogun
+inline void compile_forest(FlatForest &flat, RandomForest &rf) {
+  typedef BinaryTreeMachineNode<CARTreeNodeData> Node;
+  typedef std::shared_ptr<Node> NodePtr;
+  flat.clear();
+  std::vector<std::shared_ptr<Machine>> bags;
+  try {
+    bags = rf.get<std::vector<std::shared_ptr<Machine>>>("bags");
+  } catch (...) {
+    return;
+  }
+  bool ok = !bags.empty();
+  int n_dims = 0;
+  for (auto const &bag : bags) {
+    auto tree = std::dynamic_pointer_cast<CARTree>(bag);
+    NodePtr root = tree ? std::dynamic_pointer_cast<Node>(tree->get_root())
+                        : NodePtr();
+    if (!root) {
+      ok = false;
+      break;
+    }
+    auto types = tree->get_feature_types();
+    for (int j = 0; j < types.vlen; ++j) {
+      ok = ok && !types[j];
+    }
+    n_dims = std::max(n_dims, types.vlen);
+    if (!ok) {
+      break;
+    }
+    // As CARTree::apply: x[attribute] <= transit value goes left
+    flat.addTree(
+        root,
+        [&ok](NodePtr const &node, int &feature, double &threshold,
+              NodePtr &left, NodePtr &right) {
+          if (node->data.num_leaves == 1) {
+            return false;
+          }
+          feature = node->data.attribute_id;
+          threshold = node->data.transit_into_values[0];
+          left = node->left();
+          right = node->right();
+          ok = ok && feature >= 0 && left && right;
+          return ok;
+        },
+        [&ok](NodePtr const &node) {
+          ok = ok && node->data.node_label >= 0;
+          return ok ? (int)node->data.node_label : 0;
+        });
+  }
+  if (!ok) {
+    flat.clear();
+    return;
+  }
+  // Training dimension, checked against samples at prediction
+  flat.setFeatures(n_dims);
+}
+
 class MyRandomForest {
 public:
   // Apply weights to samples for class imbalance
@@ -28,7 +90,10 @@ public:
   // number of categories (3)
   int n_cats;
 
+  // Empty if loaded from a forest file
   std::vector<std::shared_ptr<RandomForest>> rand_forest;
+  // rand_forest compiled for inference; empty where not compilable
+  std::vector<FlatForest> flat_forest;
 
   MyRandomForest() {}
 
@@ -67,9 +132,28 @@ public:
       auto obj = deserializer->read_object()->as<RandomForest>();
       rand_forest.push_back(obj);
     }
+    compile();
+  }
+
+  // Inference only forests, e.g. of a forest file
+  void from_flat(std::vector<FlatForest> const &forests) {
+    n_cats = forests.size();
+    rand_forest.clear();
+    flat_forest = forests;
+  }
+
+  void compile() {
+    flat_forest.assign(rand_forest.size(), FlatForest());
+    for (int i = 0; i < rand_forest.size(); ++i) {
+      compile_forest(flat_forest[i], *rand_forest[i]);
+    }
   }
 
   std::vector<std::string> to_serialized() {
+    if (rand_forest.size() != n_cats) {
+      perr("Error: forests loaded from a forest file cannot be "
+           "serialized...");
+    }
     auto params = std::vector<std::string>(n_cats);
     auto serializer = std::make_shared<io::JsonSerializer>();
     for (int i = 0; i < n_cats; ++i) {
@@ -82,36 +166,69 @@ public:
     return params;
   }
 
+  // Train the forest of category cat
+  // Shogun calls hold shogun_mutex, so forests are trained one at a time,
+  // each parallelized by shogun itself
+  void train_cat(int const &cat, FeaturesPtr feats_this_cat,
+                 MulticlassLabelsPtr labels_this_cat) {
+    SGVector<double> weights(feats_this_cat->get_num_vectors());
+    SGVector<double>::fill_vector(weights, labels_this_cat->get_num_labels(),
+                                  1);
+    if (balance)
+      make_balanced_weight_vector(labels_this_cat, weights);
+    auto f_type = SGVector<bool>(feats_this_cat->get_num_features());
+
+    std::lock_guard<std::mutex> lock(shogun_mutex());
+    rand_forest[cat]->set_labels(labels_this_cat);
+    rand_forest[cat]->set_weights(weights);
+    rand_forest[cat]->set_feature_types(f_type);
+    rand_forest[cat]->train(feats_this_cat);
+  }
+
+  // Train the forest of each category that has more than one label
   void train(CategorizedFeaturesPtr X, MulticlassLabelsPtr Y) {
 
     for (int i = 0; i < X->n_cats; ++i) {
       auto feats_this_cat = X->get(i);
-      auto labels_this_cat = X->filter_labels(Y, i);
+      auto labels_this_cat = X->copy_labels(Y, i);
       std::cout << " cat. " << i
                 << " n vectors: " << feats_this_cat->get_num_vectors()
                 << " n unique labels: "
                 << labels_this_cat->get_unique_labels().size() << std::endl;
       if (labels_this_cat->get_unique_labels().size() > 1) {
-        SGVector<double> weights(feats_this_cat->get_num_vectors());
-        SGVector<double>::fill_vector(
-            weights, X->filter_labels(Y, i)->get_num_labels(), 1);
-        if (balance)
-          make_balanced_weight_vector(labels_this_cat, weights);
-
-        rand_forest[i]->set_labels(labels_this_cat);
-        rand_forest[i]->set_weights(weights);
-
-        auto f_type = SGVector<bool>(X->n_dims);
-        // X->filter_labels(Y, i)->get_labels().display_vector();
-        rand_forest[i]->set_feature_types(f_type);
-        rand_forest[i]->train(feats_this_cat);
+        train_cat(i, feats_this_cat, labels_this_cat);
       }
     }
+    compile();
   }
 
   // Predict operators
+  // Forests that could not be compiled are run through shogun, one call
+  // at a time as shogun forests are not known to be thread-safe
+  static std::mutex &shogun_mutex() {
+    static std::mutex m;
+    return m;
+  }
+
+  RandomForest &shogun_forest(int const &cat) {
+    if (cat >= rand_forest.size()) {
+      perr("Error: no shogun forest for category (loaded from a forest "
+           "file?)...");
+    }
+    return *rand_forest[cat];
+  }
+
+  // Compiled forests record their training dimension, which samples must
+  // match
+  void check_dims(int const &cat, int const &d) const {
+    if (d != flat_forest[cat].features()) {
+      perr("Error: sample dimension differs from forest's...");
+    }
+  }
+
   int predict(FeaturesPtr f, int const& cat) {
-    auto pred = rand_forest[cat]->apply_multiclass(f)->get_int_label(0);
+    std::lock_guard<std::mutex> lock(shogun_mutex());
+    auto pred = shogun_forest(cat).apply_multiclass(f)->get_int_label(0);
 
     // set 0 to -1 for merge algorithm
     if(pred == 0)
@@ -119,6 +236,63 @@ public:
     return pred;
   };
 
+  // Predict all vectors of f with one call per forest
+  std::vector<int> predict_batch(FeaturesPtr f, int const& cat) {
+    std::lock_guard<std::mutex> lock(shogun_mutex());
+    auto labels = shogun_forest(cat).apply_multiclass(f);
+    std::vector<int> preds(labels->get_num_labels());
+    for (int i = 0; i < preds.size(); ++i) {
+      preds[i] = labels->get_int_label(i);
+      // set 0 to -1 for merge algorithm
+      if (preds[i] == 0)
+        preds[i] = -1;
+    }
+    return preds;
+  };
+
+  // Predict n samples of dimension d (row-major)
+  // Thread-safe if the forest of cat is compiled
+  std::vector<int> predict_batch(FVal const *X, int n, int d,
+                                 int const &cat) const {
+    std::vector<int> preds;
+    if (cat < flat_forest.size() && !flat_forest[cat].empty()) {
+      check_dims(cat, d);
+      flat_forest[cat].predict(preds, X, n, d, 0);
+      for (auto &pred : preds) {
+        // set 0 to -1 for merge algorithm
+        if (pred == 0)
+          pred = -1;
+      }
+      return preds;
+    }
+    auto mat = SGMatrix<double>(d, n);
+    std::copy(X, X + n * d, mat.matrix);
+    auto f = std::make_shared<DenseFeatures<double>>(mat);
+    return const_cast<MyRandomForest *>(this)->predict_batch(f, cat);
+  }
+
+  // Merge probability (fraction of trees voting class 0) of n samples of
+  // dimension d (row-major)
+  // Uncompiled forests give hard 0/1 probabilities from their predictions
+  std::vector<double> predict_merge_prob(FVal const *X, int n, int d,
+                                         int const &cat) const {
+    std::vector<double> probs(n, 0.0);
+    if (cat < flat_forest.size() && !flat_forest[cat].empty()) {
+      check_dims(cat, d);
+      auto const &forest = flat_forest[cat];
+      std::vector<uint16> votes;
+      forest.vote(votes, X, n, d, 0);
+      for (int i = 0; i < n; ++i) {
+        probs[i] = (double)votes[i * forest.classes()] / forest.trees();
+      }
+      return probs;
+    }
+    auto preds = predict_batch(X, n, d, cat);
+    for (int i = 0; i < n; ++i) {
+      probs[i] = preds[i] == -1 ? 1.0 : 0.0;
+    }
+    return probs;
+  }
 };
 
 class EnsembleRandomForest {
@@ -152,6 +326,7 @@ public:
   ~EnsembleRandomForest() {}
 
   // This will create a new RF in the ensemble
+  // Categories are trained one after another (see MyRandomForest::train_cat)
   void train(CategorizedFeaturesPtr X, MulticlassLabelsPtr Y) {
 
     // create new model
@@ -174,12 +349,62 @@ public:
     return params;
   }
 
+  // Write flat forests of all stages to a forest file
+  // Categories without a compiled forest are written empty
+  void write_file(std::string const &file) const {
+    std::vector<FlatForest const *> forests;
+    for (auto const &m : models) {
+      if (m->flat_forest.size() != n_cats) {
+        perr("Error: forests not compiled for forest file...");
+      }
+      for (auto const &f : m->flat_forest) {
+        forests.push_back(&f);
+      }
+    }
+    writeForestFile(file, forests, n_cats);
+  }
+
+  // Replace all stages by those of a forest file, viewing its mapped pages
+  void read_file(std::string const &file) {
+    std::vector<FlatForest> forests;
+    n_cats = readForestFile(forests, file);
+    models.clear();
+    for (int i = 0; i < forests.size(); i += n_cats) {
+      auto m = std::make_shared<MyRandomForest>();
+      m->balance = balance;
+      m->sample_size_ratio = sample_size_ratio;
+      m->num_features = num_features;
+      m->n_trees = forests[i].trees();
+      m->from_flat(std::vector<FlatForest>(forests.begin() + i,
+                                           forests.begin() + i + n_cats));
+      models.push_back(m);
+    }
+  }
+
   int predict(FeaturesPtr v, int const& cat) {
     //use last model by default
     auto m = models[models.size() -1];
     return m->predict(v, cat);
   };
 
+  std::vector<int> predict_batch(FeaturesPtr v, int const& cat) {
+    //use last model by default
+    auto m = models[models.size() -1];
+    return m->predict_batch(v, cat);
+  };
+
+  std::vector<int> predict_batch(FVal const *X, int n, int d,
+                                 int const &cat) const {
+    //use last model by default
+    return models.back()->predict_batch(X, n, d, cat);
+  };
+
+  std::vector<double> predict_merge_prob(FVal const *X, int n, int d,
+                                         int const &cat) const {
+    //use last model by default
+    return models.back()->predict_merge_prob(X, n, d, cat);
+  };
+
   // first dim: stage, second dim: category
   virtual void
   from_serialized(std::vector<std::vector<std::string>> const &params) {
@@ -2,11 +2,47 @@
 #define _glia_alg_rf_hxx_
 
 #include "type/function.hxx"
+#include "alg/forest_file.hxx"
 #include "ml/rf/rf.hxx"
 
 namespace glia {
 namespace alg {
 
+// Compile the trees of a random forest model into flat
+// Classes are indices into model.orig_labels, which become flat's labels
+// Only numerical splits are supported
+inline void
+compileForest (FlatForest& flat, ml::rf::Model const& model)
+{
+  for (auto c: model.categorical_feature) {
+    if (c != 0)
+    { perr("Error: categorical features unsupported by flat forest..."); }
+  }
+  flat.clear();
+  int nrnodes = model.nrnodes;
+  for (int t = 0; t < model.ntree; ++t) {
+    // Node k of tree: children treemap[2k], treemap[2k + 1] (1-based),
+    // status -1 for leaves, split variable (1-based), class (1-based)
+    int const* treemap = model.treemap.data() + 2 * nrnodes * t;
+    int const* status = model.nodestatus.data() + nrnodes * t;
+    double const* split = model.xbestsplit.data() + nrnodes * t;
+    int const* var = model.bestvar.data() + nrnodes * t;
+    int const* cls = model.nodeclass.data() + nrnodes * t;
+    flat.addTree(
+        0, [&](int k, int& feature, double& threshold, int& left,
+               int& right) {
+          if (status[k] == -1) { return false; }
+          feature = var[k] - 1;
+          threshold = split[k];
+          left = treemap[2 * k] - 1;
+          right = treemap[2 * k + 1] - 1;
+          return true;
+        }, [&](int k) { return cls[k] - 1; });
+  }
+  flat.setLabels(model.orig_labels);
+}
+
+
 class RandomForest : public virtual opt::TFunction<std::vector<FVal>> {
  public:
   typedef opt::TFunction<std::vector<FVal>> Super;
@@ -16,13 +52,31 @@ class RandomForest : public virtual opt::TFunction<std::vector<FVal>> {
   typedef std::vector<FVal> Input;
 
   int predictLabel;
-  std::shared_ptr<ml::rf::Model> model;
+  std::shared_ptr<ml::rf::Model> model;  // Null if read from forest file
+  FlatForest flat;
+  int predictClass = -1;  // Class of predictLabel in flat
 
+  // modelFile: old binary model or forest file of a single forest
   virtual void initialize (
       int predictLabel_, std::string const& modelFile) {
     predictLabel = predictLabel_;
-    model = std::make_shared<ml::rf::Model>();
-    model->readFromOld(modelFile);
+    if (isForestFile(modelFile)) {
+      std::vector<FlatForest> forests;
+      readForestFile(forests, modelFile);
+      if (forests.size() != 1)
+      { perr("Error: forest file holds more than one forest..."); }
+      model.reset();
+      flat = forests.front();
+    } else {
+      model = std::make_shared<ml::rf::Model>();
+      model->readFromOld(modelFile);
+      compileForest(flat, *model);
+    }
+    predictClass = -1;
+    for (uint c = 0; c < flat.classes(); ++c)
+    { if (flat.label(c) == predictLabel) { predictClass = c; } }
+    if (predictClass < 0)
+    { perr("Error: invalid label for random forest predictor"); }
   }
 
   RandomForest () {}
@@ -32,8 +86,27 @@ class RandomForest : public virtual opt::TFunction<std::vector<FVal>> {
 
   ~RandomForest () override {}
 
-  double operator() (Input const& x) override
-  { return model->predict((double*)x.data(), x.size(), predictLabel); }
+  // Fraction of trees voting for predictLabel
+  double operator() (Input const& x) override {
+    std::vector<double> preds;
+    predict(preds, x.data(), 1, x.size(), 1);
+    return preds.front();
+  }
+
+  // Fractions of trees voting for predictLabel, of n samples of
+  // dimension d (row-major)
+  // maxThreads: 0 to use OMP_NUM_THREADS
+  void predict (std::vector<double>& preds, FVal const* X, uint n, uint d,
+                uint maxThreads) const {
+    std::vector<uint16> votes;
+    flat.vote(votes, X, n, d, maxThreads);
+    preds.resize(n);
+    uint nClass = flat.classes();
+    for (uint i = 0; i < n; ++i) {
+      preds[i] = predictClass < (int)nClass?
+          votes[i * nClass + predictClass] / (double)flat.trees(): 0.0;
+    }
+  }
 
   double operator() (double* g, Input const& x) override {
     perr("Error: no gradient available for random forest...");
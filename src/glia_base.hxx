@@ -43,9 +43,17 @@ typedef uint8_t uint8;
 
 typedef uint32 Label;
 typedef float Real;
-typedef double FVal; // Feature value type
+// Feature value type
+// Statistics behind features are accumulated in double either way
+#ifdef GLIA_FLOAT_FEATS
+typedef float FVal;
+const FVal FVAL_MIN = FLT_MIN;
+const FVal FVAL_MAX = FLT_MAX;
+#else
+typedef double FVal;
 const FVal FVAL_MIN = DBL_MIN;
 const FVal FVAL_MAX = DBL_MAX;
+#endif
 
 #ifndef GLIA_3D
 const int DIMENSION = 2;
@@ -4,14 +4,9 @@
 void glia::hmt::selectFeatures (
     std::vector<FVal>& f, BoundaryClassificationFeats const& bcf)
 {
-  int size = f.size() + 5 + 4 * bcf.x0.region.size() +
-      2 * bcf.x0.labelRegion.size();
-#ifdef GLIA_USE_MEDIAN_AS_FEATS
-  size += 2 * bcf.x0.boundary.size();
-#else
-  size += bcf.x0.boundary.size();
-#endif
-  f.reserve(size);
+  f.reserve(f.size() + selectedFeatsDim(bcf.x0.region.size(),
+                                         bcf.x0.labelRegion.size(),
+                                         bcf.x0.boundary.size()));
   f.push_back(bcf.x1->shape->area);
   f.push_back(bcf.x2->shape->area);
   f.push_back(bcf.x1->shape->perim);
@@ -34,3 +29,39 @@ void glia::hmt::selectFeatures (
     f.push_back(rlf->histDistX2);
   }
 }
+
+
+glia::FVal* glia::hmt::selectFeatures (
+    FVal* f, RegionFeats::Acc const& b, uint nBoundary,
+    double normalizingLength, RegionFeats const& rf0,
+    RegionFeats const& rf1, bool useLogShape)
+{
+#ifdef GLIA_USE_MEDIAN_AS_FEATS
+  perr("Error: median features can not be merged...");
+#endif
+  double boundaryLength =
+      sdivide(std::ceil(b.shape.nBoundary / 2.0), normalizingLength, 0.0);
+  for (double x : {rf0.shape->area, rf1.shape->area, rf0.shape->perim,
+                   rf1.shape->perim, boundaryLength}) {
+    *f++ = useLogShape ? slog(x, 0.0) : x;
+  }
+  for (uint i = 0; i < nBoundary; ++i) {
+    auto const* acc = i < b.boundary.size() ? &b.boundary[i].real : nullptr;
+    *f++ = acc && acc->n > 0 ? acc->sum / acc->n : 0.0;
+  }
+  for (uint i = 0; i < rf0.region.size(); ++i) {
+    auto const& if0 = *rf0.region[i];
+    auto const& if1 = *rf1.region[i];
+    *f++ = std::fabs(if0.mean - if1.mean);
+    *f++ = stats::distL1(if0.histogram, if1.histogram);
+    *f++ = stats::distX2(if0.histogram, if1.histogram);
+    *f++ = std::fabs(if0.entropy - if1.entropy);
+  }
+  for (uint i = 0; i < rf0.labelRegion.size(); ++i) {
+    auto const& if0 = *rf0.labelRegion[i];
+    auto const& if1 = *rf1.labelRegion[i];
+    *f++ = stats::distL1(if0.histogram, if1.histogram);
+    *f++ = stats::distX2(if0.histogram, if1.histogram);
+  }
+  return f;
+}
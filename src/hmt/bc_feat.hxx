@@ -28,6 +28,21 @@ genSaliencyMap (std::unordered_map<TKey, double>& saliencyMap,
 }
 
 
+// Same as above on compacted order (see compactOrder)
+// saliencyMap: key index -> saliency
+inline void
+genSaliencyMap (std::vector<double>& saliencyMap,
+                std::vector<TTriple<uint32>> const& dorder,
+                std::vector<double> const& saliencies, uint nKey,
+                double initSaliency, double saliencyBias)
+{
+  saliencyMap.assign(nKey, initSaliency);
+  int n = dorder.size();
+  for (int i = 0; i < n; ++i)
+  { saliencyMap[dorder[i].x2] = saliencies[i] + saliencyBias; }
+}
+
+
 template <typename TImagePtr>
 struct ImageHistPair {
   TImagePtr image;
@@ -127,6 +142,144 @@ class RegionFeats : public Object {
     if (pSaliency)
     { saliency = std::make_shared<double>(*pSaliency); }
   }
+
+  // Mergeable sufficient statistics of region features
+  // Image accumulators follow the non-null images of the image lists
+  struct Acc {
+    glia::feat::ImageRegionShapeFeats::Acc shape;
+    std::vector<glia::feat::ImageFeats::Acc> region;
+    std::vector<glia::feat::ImageLabelFeats::Acc> labelRegion;
+    std::vector<glia::feat::ImageFeats::Acc> boundary;
+
+    // Region points and image border points; boundary excluded
+    template <typename TPoints, typename TRImagePtr, typename TLImagePtr>
+    void addRegion (TPoints const& reg,
+                    std::vector<ImageHistPair<TRImagePtr>> const& rImages,
+                    std::vector<ImageHistPair<TLImagePtr>> const& rlImages) {
+      shape.addPoints(reg);
+      shape.addBorder(reg.border);
+      addImages(region, reg, rImages);
+      addImages(labelRegion, reg, rlImages);
+    }
+
+    // Same as above, with region points and region image statistics
+    // taken from label i of lstats (see TLabelStats), swept over the
+    // non-null region images
+    template <typename TLabelStats, typename TPoints, typename TLImagePtr>
+    void addRegion (TLabelStats const& lstats, uint i, TPoints const& reg,
+                    std::vector<ImageHistPair<TLImagePtr>> const& rlImages) {
+      glia::feat::ImageRegionShapeFeats::Acc s;
+      lstats.getShape(s, i);
+      shape.merge(s);
+      shape.addBorder(reg.border);
+      for (int c = 0; c < lstats.channels(); ++c) {
+        glia::feat::ImageFeats::Acc a;
+        lstats.getImage(a, i, c);
+        at(region, c).merge(a);
+      }
+      addImages(labelRegion, reg, rlImages);
+    }
+
+    // A piece of region boundary
+    template <typename TPoints, typename TRImagePtr>
+    void addBoundary (TPoints const& b, TRImagePtr const& pbImage,
+                      std::vector<double> const& boundaryThresholds,
+                      std::vector<ImageHistPair<TRImagePtr>> const& bImages) {
+      shape.addBoundary(b, pbImage, boundaryThresholds);
+      addImages(boundary, b, bImages);
+    }
+
+    void merge (Acc const& a) {
+      shape.merge(a.shape);
+      for (int i = 0; i < a.region.size(); ++i)
+      { at(region, i).merge(a.region[i]); }
+      for (int i = 0; i < a.labelRegion.size(); ++i)
+      { at(labelRegion, i).merge(a.labelRegion[i]); }
+      for (int i = 0; i < a.boundary.size(); ++i)
+      { at(boundary, i).merge(a.boundary[i]); }
+    }
+
+    void merge (Acc const& a, Acc const& b) {
+      *this = a;
+      merge(b);
+    }
+
+   protected:
+    template <typename T> static T& at (std::vector<T>& v, int i) {
+      if (v.size() <= i) { v.resize(i + 1); }
+      return v[i];
+    }
+
+    // Add points of all non-null images to accs in one pass
+    template <typename TAcc, typename TPoints, typename TImagePtr>
+    static void addImages (std::vector<TAcc>& accs, TPoints const& points,
+                           std::vector<ImageHistPair<TImagePtr>> const&
+                           images) {
+      std::vector<TImagePtr> ims;
+      std::vector<stats::HistBins> bins;
+      for (auto const& ihp: images) {
+        if (ihp.image.IsNotNull()) {
+          ims.push_back(ihp.image);
+          bins.emplace_back(ihp.histBin, ihp.histRange);
+        }
+      }
+      if (ims.empty()) { return; }
+      at(accs, ims.size() - 1);
+      std::vector<glia::feat::ImageLabelFeats::Acc*> labels;
+      std::vector<glia::feat::ImageRealFeats::Acc*> reals;
+      for (int i = 0; i < ims.size(); ++i) { channel(labels, reals, accs[i]); }
+      glia::feat::addImages(labels, reals, points, ims, bins);
+    }
+
+    static void channel (std::vector<glia::feat::ImageLabelFeats::Acc*>& labels,
+                         std::vector<glia::feat::ImageRealFeats::Acc*>& reals,
+                         glia::feat::ImageFeats::Acc& acc) {
+      labels.push_back(&acc.label);
+      reals.push_back(&acc.real);
+    }
+
+    static void channel (std::vector<glia::feat::ImageLabelFeats::Acc*>& labels,
+                         std::vector<glia::feat::ImageRealFeats::Acc*>& reals,
+                         glia::feat::ImageLabelFeats::Acc& acc)
+    { labels.push_back(&acc); }
+  };
+
+  // Same as generate, from accumulated statistics
+  template <typename TRImagePtr, typename TLImagePtr>
+  void finalize (
+      Acc const& acc, double normalizingArea, double normalizingLength,
+      std::vector<double> const& boundaryThresholds,
+      std::vector<ImageHistPair<TRImagePtr>> const& rImages,
+      std::vector<ImageHistPair<TLImagePtr>> const& rlImages,
+      std::vector<ImageHistPair<TRImagePtr>> const& bImages,
+      double const* pSaliency) {
+    shape = std::make_shared<glia::feat::ImageRegionShapeFeats>();
+    shape->finalize(acc.shape, normalizingArea, normalizingLength,
+                    boundaryThresholds.size());
+    finalizeImages(region, acc.region, rImages);
+    finalizeImages(labelRegion, acc.labelRegion, rlImages);
+    finalizeImages(boundary, acc.boundary, bImages);
+    if (pSaliency)
+    { saliency = std::make_shared<double>(*pSaliency); }
+  }
+
+ protected:
+  template <typename TFeats, typename TAcc, typename TImagePtr>
+  static void finalizeImages (
+      std::vector<std::shared_ptr<TFeats>>& feats,
+      std::vector<TAcc> const& accs,
+      std::vector<ImageHistPair<TImagePtr>> const& images) {
+    feats.reserve(images.size());
+    int i = 0;
+    for (auto const& ihp: images) {
+      if (ihp.image.IsNotNull()) {
+        feats.push_back(std::make_shared<TFeats>());
+        feats.back()->finalize
+            (i < accs.size()? accs[i]: TAcc(), ihp.histBin);
+        ++i;
+      }
+    }
+  }
 };
 
 
@@ -214,6 +367,49 @@ class BoundaryFeats : public Object {
           (std::min(dsal02, dsal12), std::max(dsal02, dsal12));
     }
   }
+
+  // Same as generate, from statistics accumulated on both sides of
+  // the boundary (see RegionFeats::Acc::addBoundary)
+  template <typename TImagePtr> void
+  finalize (RegionFeats::Acc const& b, double normalizingLength,
+            RegionFeats const& rf0, RegionFeats const& rf1,
+            RegionFeats const& rf2, uint nThreshold,
+            std::vector<ImageHistPair<TImagePtr>> const& bImages) {
+    shape = std::make_shared<glia::feat::ImageRegionShapeIntraDiffFeats>();
+    shape->finalize(b.shape, normalizingLength, *rf0.shape,
+                    *rf1.shape, nThreshold);
+    int n = rf0.region.size();
+    region.reserve(n);
+    for (int i = 0; i < n; ++i) {
+      region.push_back(std::make_shared<glia::feat::ImageDiffFeats>());
+      region.back()->generate(*rf0.region[i], *rf1.region[i]);
+    }
+    n = rf0.labelRegion.size();
+    labelRegion.reserve(n);
+    for (int i = 0; i < n; ++i) {
+      labelRegion.push_back
+          (std::make_shared<glia::feat::ImageLabelDiffFeats>());
+      labelRegion.back()->generate
+          (*rf0.labelRegion[i], *rf1.labelRegion[i]);
+    }
+    boundary.reserve(bImages.size());
+    int i = 0;
+    for (auto const& ihp: bImages) {
+      if (ihp.image.IsNotNull()) {
+        boundary.push_back(std::make_shared<glia::feat::ImageFeats>());
+        boundary.back()->finalize
+            (i < b.boundary.size()? b.boundary[i]:
+             glia::feat::ImageFeats::Acc(), ihp.histBin);
+        ++i;
+      }
+    }
+    if (rf0.saliency && rf1.saliency && rf2.saliency) {
+      double dsal02 = std::fabs(*rf0.saliency - *rf2.saliency);
+      double dsal12 = std::fabs(*rf1.saliency - *rf2.saliency);
+      saliency = std::make_shared<std::pair<double, double>>
+          (std::min(dsal02, dsal12), std::max(dsal02, dsal12));
+    }
+  }
 };
 
 
@@ -247,6 +443,51 @@ class BoundaryClassificationFeats :
 // Follow arXiv paper
 void selectFeatures(std::vector<FVal>& f, BoundaryClassificationFeats const& bcf);
 
+
+// Number of features picked by selectFeatures, given numbers of
+// non-null region, label region and boundary images
+// Column layout: region 0/1 areas, region 0/1 perimeters, boundary
+// length, boundary image means (and medians), region image diffs (4
+// each), label region image diffs (2 each)
+inline uint
+selectedFeatsDim (uint nRegion, uint nLabelRegion, uint nBoundary)
+{
+#ifdef GLIA_USE_MEDIAN_AS_FEATS
+  return 5 + 4 * nRegion + 2 * nLabelRegion + 2 * nBoundary;
+#else
+  return 5 + 4 * nRegion + 2 * nLabelRegion + nBoundary;
+#endif
+}
+
+
+template <typename TImagePtr> uint
+countImages (std::vector<ImageHistPair<TImagePtr>> const& images)
+{
+  uint ret = 0;
+  for (auto const& ihp: images) { if (ihp.image.IsNotNull()) { ++ret; } }
+  return ret;
+}
+
+
+template <typename TRImagePtr, typename TLImagePtr> uint
+selectedFeatsDim (std::vector<ImageHistPair<TRImagePtr>> const& rImages,
+                  std::vector<ImageHistPair<TLImagePtr>> const& rlImages,
+                  std::vector<ImageHistPair<TRImagePtr>> const& bImages)
+{
+  return selectedFeatsDim
+      (countImages(rImages), countImages(rlImages), countImages(bImages));
+}
+
+
+// Same features as selectFeatures, written into row f straight from
+// statistics accumulated on both sides of the boundary between rf0 and
+// rf1 (see BoundaryFeats::finalize), without building BoundaryFeats
+// nBoundary: number of non-null boundary images
+// Returns one past the last column written
+FVal* selectFeatures (FVal* f, RegionFeats::Acc const& b, uint nBoundary,
+                      double normalizingLength, RegionFeats const& rf0,
+                      RegionFeats const& rf1, bool useLogShape);
+
 };
 };
 
@@ -1,8 +1,11 @@
 #include "hmt/bc_feat.hxx"
 #include "hmt/hmt_util.hxx"
+#include "hmt/region_feats_cache.hxx"
 #include "np_helpers.hxx"
 #include "pyglia.hxx"
-#include "type/region_map.hxx"
+#include "type/key_index.hxx"
+#include "type/region_store.hxx"
+#include "util/metrics.hxx"
 #include "util/mp.hxx"
 #include "util/text_cmd.hxx"
 #include "util/text_io.hxx"
@@ -14,13 +17,8 @@ using LabelImageType = LabelImage<DIMENSION>;
 using RealImageType = RealImage<DIMENSION>;
 using ImagePairs =
     std::vector<hmt::ImageHistPair<RealImage<DIMENSION>::Pointer>>;
-typedef TRegionMap<Label, Point<DIMENSION>> RegionMap;
+typedef TRegionStore<Label, DIMENSION> RegionStore;
 
-double initSal = 1.0;
-double salBias = 1.0;
-std::vector<double> boundaryThresholds;
-// bool normalizeShape = false;
-// bool useLogShape = false;
 namespace np = boost::python::numpy;
 namespace bp = boost::python;
 
@@ -43,15 +41,22 @@ normalizeShape: see paper, default to true
 useLogShape: see paper, default to true
 ---------------------------------------------------------*/
 
-std::vector<std::vector<FVal>> bc_feat_operation(
-    std::vector<TTriple<Label>> const &order,
+// Number of features per merge
+glia::uint bc_feat_dim(ImagePairs const &vecImagePairs) {
+  return selectedFeatsDim(vecImagePairs, ImagePairs(), ImagePairs());
+}
+
+// Writes order.size() rows of bc_feat_dim(vecImagePairs) features to feats
+// Touches no Python object, so may run without the GIL
+void bc_feat_operation(
+    FVal *feats, std::vector<TTriple<Label>> const &order,
     std::vector<double> const &saliencies,
     LabelImageType::Pointer spLabels, // SP labels
-    std::vector<ImageHistPair<RealImage<DIMENSION>::Pointer>> const
-        &vecImagePairs,                    // LAB, HSV, SIFT codes, etc..
+    ImagePairs const &vecImagePairs,  // LAB, HSV, SIFT codes, etc..
     RealImageType::Pointer const &pbImage, // gPb, UCM, etc..
-    double const &saliencyBias, bp::list const &boundaryShapeThresholds,
-    bool const &normalizeShape, bool const &useLogShape) {
+    double initialSaliency, double saliencyBias,
+    std::vector<double> const &boundaryThresholds, bool normalizeShape,
+    bool useLogShape) {
 
   auto mask = LabelImageType::Pointer(nullptr);
 
@@ -59,81 +64,79 @@ std::vector<std::vector<FVal>> bc_feat_operation(
   double normalizingArea = normalizeShape ? getImageVolume(spLabels) : 1.0;
   double normalizingLength = normalizeShape ? getImageDiagonal(spLabels) : 1.0;
 
-  std::unordered_map<Label, double> saliencyMap;
-  if (saliencies.size() > 0) {
-    genSaliencyMap(saliencyMap, order, saliencies, initSal, saliencyBias);
-  }
-
-  // Generate region features
-  RegionMap rmap(spLabels, mask, order, false);
-  int rn = rmap.size();
-  std::vector<std::pair<Label, std::shared_ptr<RegionFeats>>> rfeats(rn);
-
+  // Generate region and boundary features bottom-up along merge order
+  // Pixels are read once; merged regions use their children's statistics
+  RegionStore rstore;
   std::vector<ImageHistPair<RealImage<DIMENSION>::Pointer>> vecBoundaryPairs,
       vecLabelPairs;
+  RegionFeatsCache<Label> rfcache;
+  {
+    GLIA_TIMER("bc_feat.init_regions");
+    rstore.set(spLabels, mask);
+    rfcache.set(rstore, spLabels, mask, pbImage, boundaryThresholds,
+                vecImagePairs, vecLabelPairs, vecBoundaryPairs, 0);
+  }
+  GLIA_GAUGE("rstore.regions", rstore.size());
+  GLIA_GAUGE("rstore.bytes", rstore.bytes());
 
-  parfor(
-      rmap, true,
-      [&rfeats, &vecImagePairs, &vecLabelPairs, &vecBoundaryPairs, &pbImage,
-       &saliencyMap, normalizingArea,
-       normalizingLength](RegionMap::const_iterator rit, int i) {
-        rfeats[i].first = rit->first;
-        rfeats[i].second = std::make_shared<RegionFeats>();
-        rfeats[i].second->generate(
-            rit->second, normalizingArea, normalizingLength, pbImage,
-            boundaryThresholds, vecImagePairs, vecLabelPairs, vecBoundaryPairs,
-            ccpointer(saliencyMap, rit->first));
-      },
-      0);
-
-  std::unordered_map<Label, std::shared_ptr<RegionFeats>> rfmap;
-  for (auto const &rfp : rfeats) {
-    rfmap[rfp.first] = rfp.second;
+  // Dense key indices: base regions first, then merged regions
+  TKeyIndex<Label> kidx;
+  for (int i = 0; i < rstore.baseSize(); ++i) {
+    kidx.insert(rstore.baseKey(i));
+  }
+  std::vector<TTriple<uint32>> dorder;
+  compactOrder(dorder, kidx, order);
+  std::vector<double> saliencyMap;
+  if (saliencies.size() > 0) {
+    genSaliencyMap(saliencyMap, dorder, saliencies, kidx.size(),
+                   initialSaliency, saliencyBias);
   }
 
-  // Generate boundary classifier features
-  std::cout << "generating boundary features" << std::endl;
-  int bn = order.size();
-  std::vector<BoundaryClassificationFeats> bfeats(bn);
-  parfor(
-      0, bn, true,
-      [&rmap, &order, &bfeats, &rfmap, &vecBoundaryPairs, &pbImage,
-       normalizingLength](int i) {
-        Label r0 = order[i].x0;
-        Label r1 = order[i].x1;
-        Label r2 = order[i].x2;
-        bfeats[i].x1 = rfmap.find(r0)->second.get();
-        bfeats[i].x2 = rfmap.find(r1)->second.get();
-        bfeats[i].x3 = rfmap.find(r2)->second.get();
-        // Keep region 0 area <= region 1 area
-        if (bfeats[i].x1->shape->area > bfeats[i].x2->shape->area) {
-          std::swap(r0, r1);
-          std::swap(bfeats[i].x1, bfeats[i].x2);
-        }
-        RegionMap::Region::Boundary b;
-        getBoundary(b, rmap.find(r0)->second, rmap.find(r1)->second);
-        bfeats[i].x0.generate(b, normalizingLength, *bfeats[i].x1,
-                              *bfeats[i].x2, *bfeats[i].x3, pbImage,
-                              boundaryThresholds, vecBoundaryPairs);
-      },
-      0);
-
-  // Log shape
-
-  // Get features for boundary classifier
-  if (useLogShape) {
-    parfor(
-        0, rn, false, [&rfeats](int i) { rfeats[i].second->log(); }, 0);
-    parfor(
-        0, bn, false, [&bfeats](int i) { bfeats[i].x0.log(); }, 0);
+  std::vector<std::shared_ptr<RegionFeats>> rfmap(kidx.size());
+  auto genRegionFeats = [&rfmap, &rfcache, &kidx, &boundaryThresholds,
+                         &vecImagePairs, &vecLabelPairs, &vecBoundaryPairs,
+                         &saliencyMap, normalizingArea,
+                         normalizingLength](uint32 k) {
+    auto rf = std::make_shared<RegionFeats>();
+    rf->finalize(rfcache.get(kidx.key(k)), normalizingArea,
+                 normalizingLength, boundaryThresholds, vecImagePairs,
+                 vecLabelPairs, vecBoundaryPairs,
+                 saliencyMap.empty() ? nullptr : &saliencyMap[k]);
+    rfmap[k] = rf;
+  };
+  for (int i = 0; i < rstore.baseSize(); ++i) {
+    genRegionFeats(i);
   }
 
-  std::vector<std::vector<FVal>> pickedFeats(bn);
+  // Generate boundary classifier features
+  // Rows are written in place into one row-major matrix owned by numpy;
+  // children's region features are released once merged
+  int bn = order.size();
+  int nBoundary = countImages(vecBoundaryPairs);
+  FVal *row = feats;
+  RegionFeats::Acc bacc;
+  GLIA_TIMER("bc_feat.rows");
   for (int i = 0; i < bn; ++i) {
-    selectFeatures(pickedFeats[i], bfeats[i]);
+    Label r0 = order[i].x0;
+    Label r1 = order[i].x1;
+    Label r2 = order[i].x2;
+    rfcache.getBoundary(bacc, r0, r1);
+    rfcache.merge(r0, r1, r2);
+    genRegionFeats(dorder[i].x2);
+    RegionFeats const *rf0 = rfmap[dorder[i].x0].get();
+    RegionFeats const *rf1 = rfmap[dorder[i].x1].get();
+    // Keep region 0 area <= region 1 area
+    if (rf0->shape->area > rf1->shape->area) {
+      std::swap(rf0, rf1);
+    }
+    row = selectFeatures(row, bacc, nBoundary, normalizingLength, *rf0, *rf1,
+                         useLogShape);
+    for (uint32 k : {dorder[i].x0, dorder[i].x1}) {
+      if (k != dorder[i].x2) {
+        rfmap[k].reset();
+      }
+    }
   }
-
-  return pickedFeats;
 }
 
 np::ndarray MyHmt::bc_feat_wrp(
@@ -151,20 +154,82 @@ np::ndarray MyHmt::bc_feat_wrp(
 
   auto saliencies_vec = nph::np_to_vector<double>(saliencies);
   auto order = nph::np_to_vector_triple<Label>(mergeOrderList);
+  auto boundaryThresholds =
+      nph::list_to_vector<double>(boundaryShapeThresholds);
 
   // Load and set up images
-  std::vector<ImageHistPair<RealImage<DIMENSION>::Pointer>> vecImagePairs;
-
   // Set histogram ranges and bins
-  vecImagePairs = nph::lists_to_image_hist_pair(
+  nph::ArrayRefs refs;
+  ImagePairs vecImagePairs = nph::lists_to_image_hist_pair(
       images,
       histogramBins,
       histogramLowerValues,
-      histogramHigherValues);
+      histogramHigherValues, &refs);
+
+  np::ndarray feats =
+      np::empty(bp::make_tuple(order.size(), bc_feat_dim(vecImagePairs)),
+                np::dtype::get_builtin<FVal>());
+  {
+    nph::gil_release nogil;
+    bc_feat_operation(reinterpret_cast<FVal *>(feats.get_data()), order,
+                      saliencies_vec, segImage, vecImagePairs, pbImage,
+                      initialSaliency, saliencyBias, boundaryThresholds,
+                      normalizeShape, useLogShape);
+  }
+  return feats;
+}
 
-  auto feats = bc_feat_operation(order, saliencies_vec, segImage, vecImagePairs,
-                                 pbImage, salBias, boundaryShapeThresholds,
-                                 normalizeShape, useLogShape);
+// Frames are processed in parallel without the GIL
+// All frames share histogram parameters and options
+bp::list MyHmt::bc_feat_batch(
+    bp::list const &mergeOrderLists, bp::list const &salienciesArrays,
+    bp::list const &labelArrays, bp::list const &imageLists,
+    bp::list const &pbArrays, bp::list const &histogramBins,
+    bp::list const &histogramLowerValues,
+    bp::list const &histogramHigherValues, double const &initialSaliency,
+    double const &saliencyBias, bp::list const &boundaryShapeThresholds,
+    bool const &normalizeShape, bool const &useLogShape) {
 
-  return nph::vector_2d_to_np<FVal>(feats);
+  int n = bp::len(labelArrays);
+  if (bp::len(mergeOrderLists) != n || bp::len(salienciesArrays) != n ||
+      bp::len(imageLists) != n || bp::len(pbArrays) != n) {
+    perr("Error: batch lists differ in length...");
+  }
+  auto boundaryThresholds =
+      nph::list_to_vector<double>(boundaryShapeThresholds);
+  std::vector<std::vector<TTriple<Label>>> orders(n);
+  std::vector<std::vector<double>> saliencies(n);
+  std::vector<LabelImageType::Pointer> segImages(n);
+  std::vector<RealImageType::Pointer> pbImages(n);
+  std::vector<ImagePairs> vecImagePairs(n);
+  std::vector<FVal *> feats(n);
+  nph::ArrayRefs refs;
+  bp::list out;
+  for (int i = 0; i < n; ++i) {
+    orders[i] = nph::np_to_vector_triple<Label>(
+        bp::extract<bp::list>(mergeOrderLists[i]));
+    saliencies[i] = nph::np_to_vector<double>(
+        bp::extract<np::ndarray>(salienciesArrays[i]));
+    segImages[i] =
+        nph::np_to_itk_label(nph::keep_array(refs, labelArrays[i]));
+    pbImages[i] = nph::np_to_itk_real(nph::keep_array(refs, pbArrays[i]));
+    vecImagePairs[i] = nph::lists_to_image_hist_pair(
+        bp::extract<bp::list>(imageLists[i]), histogramBins,
+        histogramLowerValues, histogramHigherValues, &refs);
+    np::ndarray f = np::empty(
+        bp::make_tuple(orders[i].size(), bc_feat_dim(vecImagePairs[i])),
+        np::dtype::get_builtin<FVal>());
+    feats[i] = reinterpret_cast<FVal *>(f.get_data());
+    out.append(f);
+  }
+  {
+    nph::gil_release nogil;
+    parfor(0, n, false, [&](int i) {
+      bc_feat_operation(feats[i], orders[i], saliencies[i], segImages[i],
+                        vecImagePairs[i], pbImages[i], initialSaliency,
+                        saliencyBias, boundaryThresholds, normalizeShape,
+                        useLogShape);
+    }, 0);
+  }
+  return out;
 }
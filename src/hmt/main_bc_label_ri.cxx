@@ -42,6 +42,7 @@ struct NodeData {
 // Whether to tweak conditions for thick boundaries [default: false]")
 // Maximum precision drop allowed for merge [default: 1.0]")
 
+// Touches no Python object, so may run without the GIL
 std::vector<int> bc_label_ri_operation(
     std::vector<TTriple<Label>> const &order, LabelImageType::Pointer labels,
     LabelImageType::Pointer groundtruth, bool const &usePairF1,
@@ -195,9 +196,55 @@ np::ndarray MyHmt::bc_label_ri_wrp(bp::list const &order,
       nph::np_to_itk_label(bp::extract<np::ndarray>(groundtruth));
 
   auto order_vec = nph::np_to_vector_triple<Label>(order);
-  auto bcLabels =
-      bc_label_ri_operation(order_vec, segImage, truthImage, usePairF1,
-                            globalOpt, optSplit, tweak, maxPrecDrop);
+  std::vector<int> bcLabels;
+  {
+    nph::gil_release nogil;
+    bcLabels = bc_label_ri_operation(order_vec, segImage, truthImage,
+                                     usePairF1, globalOpt, optSplit, tweak,
+                                     maxPrecDrop);
+  }
 
   return nph::vector_to_np<int>(bcLabels);
 }
+
+// Frames are processed in parallel without the GIL
+bp::list MyHmt::bc_label_ri_batch(bp::list const &orders,
+                                  bp::list const &labelArrays,
+                                  bp::list const &groundtruthArrays,
+                                  bool const &usePairF1, int const &globalOpt,
+                                  bool const &optSplit, bool const &tweak,
+                                  double const &maxPrecDrop) {
+
+  int n = bp::len(labelArrays);
+  if (bp::len(orders) != n || bp::len(groundtruthArrays) != n) {
+    perr("Error: batch lists differ in length...");
+  }
+  std::vector<std::vector<TTriple<Label>>> order_vecs(n);
+  std::vector<LabelImageType::Pointer> segImages(n), truthImages(n);
+  nph::ArrayRefs refs;
+  for (int i = 0; i < n; ++i) {
+    order_vecs[i] =
+        nph::np_to_vector_triple<Label>(bp::extract<bp::list>(orders[i]));
+    segImages[i] =
+        nph::np_to_itk_label(nph::keep_array(refs, labelArrays[i]));
+    truthImages[i] =
+        nph::np_to_itk_label(nph::keep_array(refs, groundtruthArrays[i]));
+  }
+
+  std::vector<std::vector<int>> bcLabels(n);
+  {
+    nph::gil_release nogil;
+    parfor(0, n, false, [&](int i) {
+      bcLabels[i] = bc_label_ri_operation(order_vecs[i], segImages[i],
+                                          truthImages[i], usePairF1,
+                                          globalOpt, optSplit, tweak,
+                                          maxPrecDrop);
+    }, 0);
+  }
+
+  bp::list out;
+  for (auto const &l : bcLabels) {
+    out.append(nph::vector_to_np<int>(l));
+  }
+  return out;
+}
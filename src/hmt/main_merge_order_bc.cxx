@@ -2,22 +2,57 @@
 #include "alg/rf.hxx"
 #include "hmt/bc_feat.hxx"
 #include "hmt/bc_label.hxx"
+#include "hmt/region_feats_cache.hxx"
 #include "np_helpers.hxx"
 #include "pyglia.hxx"
 #include "util/struct_merge_bc.hxx"
+#include "util/metrics.hxx"
+#include "util/mp.hxx"
 #include "util/text_cmd.hxx"
 #include "util/text_io.hxx"
-#include <chrono> 
 
 using namespace glia;
 using namespace glia::hmt;
-using namespace std::chrono; 
 
 using LabelImageType = LabelImage<DIMENSION>;
 using RealImageType = RealImage<DIMENSION>;
 using ImagePairs =
     std::vector<hmt::ImageHistPair<RealImage<DIMENSION>::Pointer>>;
-typedef TRegionMap<Label, Point<DIMENSION>> RegionMap;
+typedef TRegionStore<Label, DIMENSION> RegionStore;
+
+// Predict boundary features grouped by category, one call per category
+// fpred(FVal const* rows, int n, int d, int cat) -> std::vector<T>
+template <typename T, typename PFunc>
+static void predict_by_category(std::vector<T> &out,
+                                std::vector<std::vector<FVal> const *> const &data,
+                                int n_cats, double cat_thr, PFunc fpred) {
+  out.assign(data.size(), T());
+  if (data.empty()) {
+    return;
+  }
+  int n_dims = data.front()->size();
+  std::vector<std::vector<int>> indices(n_cats);
+  for (int i = 0; i < data.size(); ++i) {
+    auto data_ =
+        SGVector<FVal>(const_cast<FVal *>(data[i]->data()), n_dims, false);
+    indices[categorize_sample<FVal>(data_, 0, 1, cat_thr)].push_back(i);
+  }
+  std::vector<FVal> rows;
+  for (int cat = 0; cat < indices.size(); ++cat) {
+    if (indices[cat].empty()) {
+      continue;
+    }
+    rows.clear();
+    rows.reserve(n_dims * indices[cat].size());
+    for (int j : indices[cat]) {
+      rows.insert(rows.end(), data[j]->begin(), data[j]->end());
+    }
+    auto preds = fpred(rows.data(), indices[cat].size(), n_dims, cat);
+    for (int j = 0; j < indices[cat].size(); ++j) {
+      out[indices[cat][j]] = preds[j];
+    }
+  }
+}
 
 /*-------------------------------------------------------
   Use a trained boundary classifier to generate a merge order
@@ -29,6 +64,15 @@ vecImagePairs: A list of images (holding image features) with corresponding hist
 gpbImage: global probability boundary
 normalizeSizeLength: see paper, default to true
 useLogOfShapes: see paper, default to true
+Boundaries are predicted on bc_feat's rows (selectFeatures), as the
+  forests were trained on them
+lazyQueue: use lazy-invalidation boundary queue (same merge order)
+randomSeed: if non-negative, draw each merge with probability proportional
+  to exp(saliency) instead of greedily, e.g. for ensemble training;
+  batches seed frame i with randomSeed + i
+mergeProbs: if given, receives the merge probability of each merge (fraction
+  of trees voting merge on its boundary features)
+Touches no Python object, so may run without the GIL
 ---------------------------------------------------------*/
 
 std::tuple<std::vector<TTriple<Label>>, std::vector<double>>
@@ -37,9 +81,11 @@ merge_order_bc_operation(
     std::vector<ImageHistPair<RealImage<DIMENSION>::Pointer>> const
         &vecImagePairs, // LAB, HSV, SIFT codes, etc..
     RealImageType::Pointer const &gpbImage, // gPb, UCM, etc..
-    bool const &useLogOfShape, bool const &useSimpleFeatures,
+    bool const &useLogOfShape,
     std::shared_ptr<glia::alg::EnsembleRandomForest> bc,
-                         double const& cat_thr) {
+                         double const& cat_thr, bool const &lazyQueue,
+                         long const &randomSeed,
+                         std::vector<double> *mergeProbs) {
 
   std::vector<double> boundaryThresholds;
 
@@ -53,83 +99,95 @@ merge_order_bc_operation(
   double normalizingArea = getImageVolume(spLabels);
   double normalizingLength = getImageDiagonal(spLabels);
 
-  RegionMap rmap(spLabels, mask, false);
-  // Boundary feature compute
+  RegionStore rstore;
+  RegionFeatsCache<Label> rfcache;
+  {
+    GLIA_TIMER("bc.init_regions");
+    rstore.set(spLabels, mask);
+    // Per-region feature statistics; merged regions are derived from children
+    rfcache.set(rstore, spLabels, mask, gpbImage, boundaryThresholds,
+                vecImagePairs, vecLabelPairs, vecBoundaryPairs, 0);
+  }
+  GLIA_GAUGE("rstore.regions", rstore.size());
+  GLIA_GAUGE("rstore.bytes", rstore.bytes());
+  // Boundary features: the rows bc_feat writes for training (see
+  // bc_feat_operation, normalizeShape on), so that the categorizing
+  // columns 0/1 and the dimension are those the forests were trained on
+  int nDim = selectedFeatsDim(vecImagePairs, vecLabelPairs, vecBoundaryPairs);
+  int nBoundary = countImages(vecBoundaryPairs);
   std::unordered_map<std::pair<Label, Label>, std::vector<FVal>> bcfmap;
-  auto fBcFeat = [normalizingArea, normalizingLength, &gpbImage, &vecImagePairs,
+  auto fBcFeat = [normalizingArea, normalizingLength, &rfcache, &vecImagePairs,
                   &vecBoundaryPairs, &vecLabelPairs, &bcfmap, useLogOfShape,
-                  useSimpleFeatures, boundaryThresholds](
-                     std::vector<FVal> &data, RegionMap::Region const &reg0,
-                     RegionMap::Region const &reg1,
-                     RegionMap::Region const &reg2, Label r0, Label r1,
-                     Label r2) {
-    auto rf0 = std::make_shared<RegionFeats>();
-    auto rf1 = std::make_shared<RegionFeats>();
-    auto rf2 = std::make_shared<RegionFeats>();
-    rf0->generate(reg0, normalizingArea, normalizingLength, gpbImage,
-                  boundaryThresholds, vecImagePairs, vecLabelPairs,
-                  vecBoundaryPairs, nullptr);
-    rf1->generate(reg1, normalizingArea, normalizingLength, gpbImage,
-                  boundaryThresholds, vecImagePairs, vecLabelPairs,
-                  vecBoundaryPairs, nullptr);
-    rf2->generate(reg2, normalizingArea, normalizingLength, gpbImage,
-                  boundaryThresholds, vecImagePairs, vecLabelPairs,
-                  vecBoundaryPairs, nullptr);
-    BoundaryClassificationFeats bcf;
-    bcf.x1 = rf0.get();
-    bcf.x2 = rf1.get();
-    bcf.x3 = rf2.get();
+                  &boundaryThresholds, nDim, nBoundary](
+                     std::vector<FVal> &data, Label r0, Label r1) {
+    RegionFeats rf0, rf1;
+    RegionFeats::Acc bacc;
+    rfcache.getBoundary(bacc, r0, r1);
+    rf0.finalize(rfcache.get(r0), normalizingArea, normalizingLength,
+                 boundaryThresholds, vecImagePairs, vecLabelPairs,
+                 vecBoundaryPairs, nullptr);
+    rf1.finalize(rfcache.get(r1), normalizingArea, normalizingLength,
+                 boundaryThresholds, vecImagePairs, vecLabelPairs,
+                 vecBoundaryPairs, nullptr);
+    RegionFeats const *prf0 = &rf0, *prf1 = &rf1;
     // Keep region 0 area <= region 1 area
-    if (bcf.x1->shape->area > bcf.x2->shape->area) {
-      std::swap(r0, r1);
-      std::swap(bcf.x1, bcf.x2);
-    }
-    RegionMap::Region::Boundary b;
-    getBoundary(b, reg0, reg1);
-    bcf.x0.generate(b, normalizingLength, *bcf.x1, *bcf.x2, *bcf.x3, gpbImage,
-                    boundaryThresholds, vecLabelPairs);
-    if (useLogOfShape) {
-      bcf.x0.log();
-      rf0->log();
-      rf1->log();
-      rf2->log();
-    }
-    if (useSimpleFeatures) {
-      selectFeatures(data, bcf);
-    } else {
-      bcf.serialize(data);
+    // Keys come as r0 < r1, so equal areas put the lower label first, as
+    // bc_feat does on merge orders (the region map path followed region
+    // map order)
+    if (prf0->shape->area > prf1->shape->area) {
+      std::swap(prf0, prf1);
     }
+    data.resize(nDim);
+    selectFeatures(data.data(), bacc, nBoundary, normalizingLength, *prf0,
+                   *prf1, useLogOfShape);
     bcfmap[std::make_pair(std::min(r0, r1), std::max(r0, r1))] = data;
   };
 
-  // Boundary predictor (lambda function passed to merging algorithm)
-  auto fBcPred = [bc, cat_thr](std::vector<double> const &data) {
-    // auto start = high_resolution_clock::now(); 
-    auto data_ = SGVector<double>(data.front(), data.size());
-    auto cat = categorize_sample<double>(data_, 0, 1, cat_thr);
-    auto data_mat = SGMatrix<double>(data_);
-    auto data__ = std::make_shared<DenseFeatures<double>>(data_mat);
-    auto res =  bc->predict(data__, cat);
-    // auto stop = high_resolution_clock::now(); 
-    // auto duration = duration_cast<milliseconds>(stop - start); 
-    // std::cout << "predicted in " << duration.count() << "ms" << std::endl;
-    return res;
+  // Boundary predictor for single boundaries created by merges
+  auto fBcPred = [bc, cat_thr](std::vector<FVal> const &data) {
+    auto data_ = SGVector<FVal>(const_cast<FVal *>(data.data()), data.size(),
+                                false);
+    auto cat = categorize_sample<FVal>(data_, 0, 1, cat_thr);
+    return bc->predict_batch(data.data(), 1, data.size(), cat).front();
+  };
+
+  // Batch predictor for initial boundaries: one call per category
+  auto fBcPredBatch = [bc, cat_thr](
+                          std::vector<std::vector<FVal> const *> const &data,
+                          std::vector<double> &sals) {
+    GLIA_TIMER("rf.predict_batch");
+    GLIA_COUNT("rf.batch_samples", data.size());
+    predict_by_category(sals, data, bc->n_cats, cat_thr,
+                        [&bc](FVal const *X, int n, int d, int cat) {
+                          return bc->predict_batch(X, n, d, cat);
+                        });
   };
 
   // Generate merging orders
   std::vector<TTriple<Label>> order;
   std::vector<double> saliencies;
-  genMergeOrderGreedyUsingBoundaryClassifier<std::vector<FVal>>(
-      order, saliencies, spLabels, mask, fBcFeat, fBcPred,
-      f_true<TBoundaryTable<std::vector<FVal>, RegionMap> &,
-             TBoundaryTable<std::vector<FVal>, RegionMap>::iterator>);
-
-  // store new boundary classifier feats
-  // std::vector<std::vector<FVal>> bcfeats;
-  // bcfeats.reserve(order.size());
-  // for (auto const &m : order) {
-  //   bcfeats.push_back(bcfmap.find(std::make_pair(m.x0, m.x1))->second);
-  // }
+  genMergeOrderGreedyUsingBatchedBoundaryClassifier<std::vector<FVal>>(
+      order, saliencies, rstore, fBcFeat, fBcPred, fBcPredBatch,
+      f_true<TBoundaryTable<std::vector<FVal>, RegionStore> &,
+             TBoundaryTable<std::vector<FVal>, RegionStore>::iterator>,
+      [&rfcache](Label r0, Label r1, Label r2) { rfcache.merge(r0, r1, r2); },
+      lazyQueue ? BoundaryQueue::Lazy : BoundaryQueue::Indexed, randomSeed);
+
+  // Merge probabilities from the features each merge was predicted on
+  if (mergeProbs) {
+    GLIA_TIMER("rf.predict_merge_prob");
+    std::vector<std::vector<FVal> const *> data;
+    data.reserve(order.size());
+    for (auto const &m : order) {
+      data.push_back(
+          &bcfmap.find(std::make_pair(std::min(m.x0, m.x1),
+                                      std::max(m.x0, m.x1)))->second);
+    }
+    predict_by_category(*mergeProbs, data, bc->n_cats, cat_thr,
+                        [&bc](FVal const *X, int n, int d, int cat) {
+                          return bc->predict_merge_prob(X, n, d, cat);
+                        });
+  }
 
   return std::make_tuple(order, saliencies);
 }
@@ -140,21 +198,72 @@ bp::tuple MyHmt::merge_order_bc_wrp(
     np::ndarray const &gpbImage, // gPb, UCM, etc..
     bp::list const &histogramBins, bp::list const &histogramLowerValues,
     bp::list const &histogramHigherValues, bool const &useLogOfShape,
-    double const &cat_thr) {
+    double const &cat_thr, bool const &lazyQueue, long const &randomSeed) {
 
   auto spLabels_itk = nph::np_to_itk_label(spLabels);
   auto gpbImage_itk = nph::np_to_itk_real(gpbImage);
 
   // Set histogram ranges and bins
+  nph::ArrayRefs refs;
   auto vecImagePairs = nph::lists_to_image_hist_pair(
       images, histogramBins,
       histogramLowerValues,
-      histogramHigherValues);
+      histogramHigherValues, &refs);
 
-  auto out =
-      merge_order_bc_operation(spLabels_itk, vecImagePairs,
-                               gpbImage_itk, useLogOfShape, false, this->bc,
-                               cat_thr);
+  std::tuple<std::vector<TTriple<Label>>, std::vector<double>> out;
+  {
+    nph::gil_release nogil;
+    out = merge_order_bc_operation(spLabels_itk, vecImagePairs, gpbImage_itk,
+                                   useLogOfShape, this->bc, cat_thr,
+                                   lazyQueue, randomSeed);
+  }
   return bp::make_tuple(nph::vector_triple_to_np<Label>(std::get<0>(out)),
                         nph::vector_to_np<double>(std::get<1>(out)));
 }
+
+// Frames are processed in parallel without the GIL
+// All frames share histogram parameters and options
+bp::list MyHmt::merge_order_bc_batch(
+    bp::list const &spLabelArrays, bp::list const &imageLists,
+    bp::list const &gpbArrays, bp::list const &histogramBins,
+    bp::list const &histogramLowerValues,
+    bp::list const &histogramHigherValues, bool const &useLogOfShape,
+    double const &cat_thr, bool const &lazyQueue, long const &randomSeed) {
+
+  int n = bp::len(spLabelArrays);
+  if (bp::len(imageLists) != n || bp::len(gpbArrays) != n) {
+    perr("Error: batch lists differ in length...");
+  }
+  std::vector<LabelImageType::Pointer> spLabels(n);
+  std::vector<RealImageType::Pointer> gpbImages(n);
+  std::vector<ImagePairs> vecImagePairs(n);
+  nph::ArrayRefs refs;
+  for (int i = 0; i < n; ++i) {
+    spLabels[i] =
+        nph::np_to_itk_label(nph::keep_array(refs, spLabelArrays[i]));
+    gpbImages[i] =
+        nph::np_to_itk_real(nph::keep_array(refs, gpbArrays[i]));
+    vecImagePairs[i] = nph::lists_to_image_hist_pair(
+        bp::extract<bp::list>(imageLists[i]), histogramBins,
+        histogramLowerValues, histogramHigherValues, &refs);
+  }
+
+  std::vector<std::tuple<std::vector<TTriple<Label>>, std::vector<double>>>
+      outs(n);
+  {
+    nph::gil_release nogil;
+    parfor(0, n, false, [&](int i) {
+      outs[i] = merge_order_bc_operation(spLabels[i], vecImagePairs[i],
+                                         gpbImages[i], useLogOfShape, this->bc,
+                                         cat_thr, lazyQueue,
+                                         randomSeed < 0 ? -1 : randomSeed + i);
+    }, 0);
+  }
+
+  bp::list out;
+  for (auto const &o : outs) {
+    out.append(bp::make_tuple(nph::vector_triple_to_np<Label>(std::get<0>(o)),
+                              nph::vector_to_np<double>(std::get<1>(o))));
+  }
+  return out;
+}
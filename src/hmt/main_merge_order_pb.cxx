@@ -3,7 +3,9 @@
 #include "pyglia.hxx"
 #include "type/tuple.hxx"
 #include "util/image_io.hxx"
-#include "util/struct_merge.hxx"
+#include "util/metrics.hxx"
+#include "util/mp.hxx"
+#include "util/struct_merge_rag.hxx"
 #include "util/text_cmd.hxx"
 #include "util/text_io.hxx"
 
@@ -13,33 +15,40 @@ namespace bp = boost::python;
 
 using LabelImageType = LabelImage<DIMENSION>;
 using RealImageType = RealImage<DIMENSION>;
-typedef TRegionMap<Label, Point<DIMENSION>> RegionMap;
+typedef TRegionGraph<Label> RegionGraph;
+
+// Number of pb histogram bins for approximate boundary median
+const int PB_HIST_BIN = 256;
 
 //"Input initial segmentation image (superpixels)
 //"Input boundary probability image (contour map)
 //"Boundary intensity stats type (1: median, 2: mean) [default: 1]")
+//"Use lazy-invalidation boundary queue [default: false]
+// Touches no Python object, so may run without the GIL
 std::tuple<std::vector<TTriple<Label>>, std::vector<double>>
 merge_order_pb_operation(LabelImageType::Pointer segImage,
                          RealImageType::Pointer pbImage,
-                         int const &bd_intens_stats_type) {
+                         int const &bd_intens_stats_type,
+                         bool const &lazyQueue) {
 
   std::vector<TTriple<Label>> order;
   std::vector<double> saliencies;
 
   LabelImageType::Pointer mask = LabelImageType::Pointer(nullptr);
-  RegionMap rmap(segImage, mask, true);
-
-  if (bd_intens_stats_type == 1) {
-    genMergeOrderGreedyUsingPbApproxMedian(
-        order, saliencies, rmap, false, pbImage,
-        f_true<TBoundaryTable<std::vector<double>, RegionMap> &,
-               TBoundaryTable<std::vector<double>, RegionMap>::iterator>,
-        f_null<std::vector<double> &, Label, Label>);
-  } else if (bd_intens_stats_type == 2) {
-    genMergeOrderGreedyUsingPbMean(
-        order, saliencies, rmap, false, pbImage,
-        f_true<TBoundaryTable<std::pair<double, int>, RegionMap> &,
-               TBoundaryTable<std::pair<double, int>, RegionMap>::iterator>);
+
+  if (bd_intens_stats_type == 1 || bd_intens_stats_type == 2) {
+    bool useMedian = bd_intens_stats_type == 1;
+    RegionGraph rag;
+    {
+      GLIA_TIMER("pb.init_graph");
+      rag.set(segImage, pbImage, mask, useMedian ? PB_HIST_BIN : 0);
+    }
+    GLIA_GAUGE("rag.regions", rag.size());
+    genMergeOrderGreedyUsingPbStats(
+        order, saliencies, rag, useMedian,
+        f_true<TBoundaryTable<RegionGraph::Edge, RegionGraph> &,
+               TBoundaryTable<RegionGraph::Edge, RegionGraph>::iterator>,
+        lazyQueue ? BoundaryQueue::Lazy : BoundaryQueue::Indexed);
   } else {
     perr("Error: unsupported boundary stats type...");
   }
@@ -49,21 +58,57 @@ merge_order_pb_operation(LabelImageType::Pointer segImage,
 
 bp::tuple MyHmt::merge_order_pb_wrp(np::ndarray const &labelArray,
                                     np::ndarray const &pbArray,
-                                    int const &bd_intens_stats_type) {
+                                    int const &bd_intens_stats_type,
+                                    bool const &lazyQueue) {
 
   LabelImageType::Pointer segImage = nph::np_to_itk_label(labelArray);
-  // using WriterType = itk::ImageFileWriter<LabelImageType>;
-  // WriterType::Pointer writer = WriterType::New();
-  // writer->SetFileName("label.jpg");
-  // writer->SetInput(segImage);
-  // writer->Update();
-
-
   RealImageType::Pointer pbImage = nph::np_to_itk_real(pbArray);
 
-  auto out_tuple =
-      merge_order_pb_operation(segImage, pbImage, bd_intens_stats_type);
+  std::tuple<std::vector<TTriple<Label>>, std::vector<double>> out_tuple;
+  {
+    nph::gil_release nogil;
+    out_tuple =
+        merge_order_pb_operation(segImage, pbImage, bd_intens_stats_type,
+                                 lazyQueue);
+  }
 
   return bp::make_tuple(nph::vector_triple_to_np<Label>(std::get<0>(out_tuple)),
                         nph::vector_to_np<double>(std::get<1>(out_tuple)));
 }
+
+// Frames are processed in parallel without the GIL
+bp::list MyHmt::merge_order_pb_batch(bp::list const &labelArrays,
+                                     bp::list const &pbArrays,
+                                     int const &bd_intens_stats_type,
+                                     bool const &lazyQueue) {
+
+  int n = bp::len(labelArrays);
+  if (bp::len(pbArrays) != n) {
+    perr("Error: batch lists differ in length...");
+  }
+  std::vector<LabelImageType::Pointer> segImages(n);
+  std::vector<RealImageType::Pointer> pbImages(n);
+  nph::ArrayRefs refs;
+  for (int i = 0; i < n; ++i) {
+    segImages[i] =
+        nph::np_to_itk_label(nph::keep_array(refs, labelArrays[i]));
+    pbImages[i] = nph::np_to_itk_real(nph::keep_array(refs, pbArrays[i]));
+  }
+
+  std::vector<std::tuple<std::vector<TTriple<Label>>, std::vector<double>>>
+      outs(n);
+  {
+    nph::gil_release nogil;
+    parfor(0, n, false, [&](int i) {
+      outs[i] = merge_order_pb_operation(segImages[i], pbImages[i],
+                                         bd_intens_stats_type, lazyQueue);
+    }, 0);
+  }
+
+  bp::list out;
+  for (auto const &o : outs) {
+    out.append(bp::make_tuple(nph::vector_triple_to_np<Label>(std::get<0>(o)),
+                              nph::vector_to_np<double>(std::get<1>(o))));
+  }
+  return out;
+}
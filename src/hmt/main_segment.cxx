@@ -0,0 +1,115 @@
+#include "hmt/tree_build.hxx"
+#include "hmt/tree_greedy.hxx"
+#include "hmt/tree_segment.hxx"
+#include "np_helpers.hxx"
+#include "pyglia.hxx"
+#include "util/image_alg.hxx"
+#include "util/metrics.hxx"
+
+using namespace glia;
+using namespace glia::hmt;
+
+using LabelImageType = LabelImage<DIMENSION>;
+using RealImageType = RealImage<DIMENSION>;
+using ImagePairs =
+    std::vector<hmt::ImageHistPair<RealImage<DIMENSION>::Pointer>>;
+
+struct SegmentNodeData {
+  Label label;
+  double potential = 0.0;
+};
+
+typedef TTree<SegmentNodeData> SegmentTree;
+
+/*-------------------------------------------------------
+  Segment one frame: watershed superpixels, greedy merge order (by the
+  boundary classifier if models are loaded, otherwise by boundary
+  median pb), then greedy resolution of the merge tree by node
+  potentials
+
+Parameters:
+pbImage: global probability boundary, also flooded by watershed
+vecImagePairs: A list of images (holding image features) with corresponding histogram parameters (range, bins)
+level: watershed water level
+useLogOfShape: see paper, default to true
+cat_thr: threshold for categorization of boundary samples
+
+Touches no Python object, so may run without the GIL
+---------------------------------------------------------*/
+
+LabelImageType::Pointer
+segment_operation(RealImageType::Pointer const &pbImage,
+                  ImagePairs const &vecImagePairs, double level,
+                  bool useLogOfShape,
+                  std::shared_ptr<glia::alg::EnsembleRandomForest> bc,
+                  double cat_thr) {
+
+  LabelImageType::Pointer segImage;
+  {
+    GLIA_TIMER("segment.watershed");
+    segImage = watershed<LabelImageType>(pbImage, level);
+    relabelImage(segImage, 0);
+  }
+
+  // Merge order and probability of each merge
+  std::vector<TTriple<Label>> order;
+  std::vector<double> saliencies, mergeProbs;
+  if (bc && !bc->models.empty()) {
+    // Saliencies are predicted labels; probabilities are tree votes
+    std::tie(order, saliencies) = merge_order_bc_operation(
+        segImage, vecImagePairs, pbImage, useLogOfShape, bc, cat_thr, false,
+        -1, &mergeProbs);
+  } else {
+    std::tie(order, saliencies) = merge_order_pb_operation(segImage, pbImage, 1);
+    // Saliencies are negated boundary medians
+    for (double s : saliencies) {
+      mergeProbs.push_back(1.0 + s);
+    }
+  }
+  if (order.empty()) {
+    return segImage;
+  }
+
+  // Pick non-overlapping nodes of highest potential
+  GLIA_TIMER("segment.resolve");
+  SegmentTree tree;
+  genTreeWithNodePotentials(tree, order, mergeProbs.cbegin());
+  std::vector<int> picks;
+  resolveTreeGreedy(picks, tree,
+                    [](SegmentTree::Node const &a, SegmentTree::Node const &b) {
+                      return a.data.potential < b.data.potential;
+                    });
+  // Assign keys above all superpixel and merge keys, then compact;
+  // superpixels never merged keep their own keys
+  Label keyToAssign = 0;
+  for (auto const &m : order) {
+    keyToAssign = std::max(keyToAssign, m.x2);
+  }
+  genFinalSegmentation(segImage, tree, picks, LabelImageType::Pointer(nullptr),
+                       keyToAssign + 1, true);
+  relabelImage(segImage, 0);
+  return segImage;
+}
+
+np::ndarray MyHmt::segment(np::ndarray const &pbArray, // gPb, UCM, etc..
+                           bp::list const &images, // LAB, HSV, SIFT codes, etc..
+                           bp::list const &histogramBins,
+                           bp::list const &histogramLowerValues,
+                           bp::list const &histogramHigherValues,
+                           double const &level, bool const &useLogOfShape,
+                           double const &cat_thr) {
+
+  auto pbImage = nph::np_to_itk_real(pbArray);
+  nph::ArrayRefs refs;
+  auto vecImagePairs =
+      nph::lists_to_image_hist_pair(images, histogramBins, histogramLowerValues,
+                                    histogramHigherValues, &refs);
+
+  LabelImageType::Pointer segImage;
+  {
+    nph::gil_release nogil;
+    segImage = segment_operation(pbImage, vecImagePairs, level, useLogOfShape,
+                                 this->bc, cat_thr);
+  }
+  return nph::itk_to_np<LabelImageType, Label>(segImage);
+}
@@ -3,6 +3,7 @@
 #include "glia_base.hxx"
 #include "pyglia.hxx"
 #include "shogun_helpers.hxx"
+#include "util/metrics.hxx"
 #include <shogun/ensemble/MajorityVote.h>
 #include <shogun/features/DenseFeatures.h>
 #include <shogun/machine/RandomForest.h>
@@ -22,19 +23,49 @@ num of features to examine at each node. 0 for sqrt(D) balance: Whether to
 balance samples
 ---------------------------------------------------------*/
 
-void MyHmt::train_rf_operation(np::ndarray const &X_, np::ndarray const &Y_) {
+// Categorize samples of X_ for training
+// Categorizes straight from the array's buffer, so that only the
+// per-category matrices are allocated
+static CategorizedFeaturesPtr categorize_np(np::ndarray const &X_,
+                                            np::ndarray const &Y_) {
 
-  // sg::init_shogun_with_defaults();
-  if (X_.shape(0) != Y_.shape(0) || Y_.get_nd() != 1) {
+  if (X_.get_nd() != 2 || X_.shape(0) != Y_.shape(0) || Y_.get_nd() != 1) {
     glia::perr("Error: incorrect matrices dimension...");
   }
 
-  auto X = np_to_shogun_feats<double>(X_);
-  auto Y = np_to_shogun_labels<int>(Y_);
+  auto f64 = np::dtype::get_builtin<double>();
+  auto f32 = np::dtype::get_builtin<float>();
+  auto X = X_;
+  if (!np::equivalent(X.get_dtype(), f64) &&
+      !np::equivalent(X.get_dtype(), f32)) {
+    X = X.astype(f64);
+  }
+  if (!(X.get_flags() & np::ndarray::C_CONTIGUOUS) ||
+      !(X.get_flags() & np::ndarray::ALIGNED)) {
+    X = X.copy();
+  }
+  int n = X.shape(0), d = X.shape(1);
 
-  auto X_cat = std::make_shared<CategorizedFeatures>(X, 0, 1);
+  nph::gil_release nogil;
+  if (np::equivalent(X.get_dtype(), f32)) {
+    return std::make_shared<CategorizedFeatures>(
+        reinterpret_cast<float const *>(X.get_data()), n, d, 0, 1);
+  }
+  return std::make_shared<CategorizedFeatures>(
+      reinterpret_cast<double const *>(X.get_data()), n, d, 0, 1);
+}
 
-  bc->train(X_cat, Y);
+void MyHmt::train_rf_operation(np::ndarray const &X_, np::ndarray const &Y_) {
+
+  // sg::init_shogun_with_defaults();
+  auto X_cat = categorize_np(X_, Y_);
+  auto Y = np_to_shogun_labels<int>(Y_);
+
+  {
+    GLIA_TIMER("rf.train");
+    nph::gil_release nogil;
+    bc->train(X_cat, Y);
+  }
 
   cat_threshold = X_cat->get_threshold();
 
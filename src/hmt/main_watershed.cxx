@@ -21,10 +21,14 @@ np::ndarray MyHmt::watershed_operation (np::ndarray const& image, //grayscale!
 {
 
   auto image_itk = nph::np_to_itk_real(image);
-  auto outputImage = watershed<LabelImage<DIMENSION>>(image_itk, level);
   using LabelImageType = LabelImage<DIMENSION>;
-  if (relabel) {
-    relabelImage(outputImage, 0); }
+  LabelImageType::Pointer outputImage;
+  {
+    nph::gil_release nogil;
+    outputImage = watershed<LabelImageType>(image_itk, level);
+    if (relabel) {
+      relabelImage(outputImage, 0); }
+  }
 
   return nph::itk_to_np<LabelImageType, Label>(outputImage);
 }
@@ -0,0 +1,249 @@
+#ifndef _glia_hmt_region_feats_cache_hxx_
+#define _glia_hmt_region_feats_cache_hxx_
+
+#include "hmt/bc_feat.hxx"
+#include "type/hash.hxx"
+#include "type/label_stats.hxx"
+
+namespace glia {
+namespace hmt {
+
+// Region feature statistics keyed by region label
+// Each region keeps the statistics of its points and, per neighbor, of its
+// boundary points facing that neighbor, so that features of a merged
+// region are derived from its children without touching pixels
+// Boundary pieces follow TRegion: a piece is dropped on merging only if
+// the opposite piece exists, and a one-sided piece (a, c) counts toward
+// a boundary only while base c has pieces left (see
+// TRegion::boundaryWith)
+template <typename TKey>
+class RegionFeatsCache : public Object {
+ public:
+  typedef RegionFeatsCache<TKey> Self;
+  typedef std::shared_ptr<Self> Pointer;
+  typedef std::shared_ptr<const Self> ConstPointer;
+  typedef std::weak_ptr<Self> WeakPointer;
+  typedef TKey Key;
+  typedef std::pair<TKey, TKey> KeyPair;
+  typedef RegionFeats::Acc Acc;
+
+ protected:
+  // Boundary points of r facing s
+  struct Side {
+    Acc mutual;  // Pieces with opposite piece
+    std::unordered_map<Key, Acc> oneSided;  // Base faced -> pieces
+    // Base of r faced by one-sided pieces -> its mutual pieces here
+    std::unordered_map<Key, uint> nMutual;
+
+    void merge (Side const& side) {
+      mutual.merge(side.mutual);
+      for (auto const& op: side.oneSided)
+      { oneSided[op.first].merge(op.second); }
+      for (auto const& np: side.nMutual) { nMutual[np.first] += np.second; }
+    }
+
+    void addTo (Acc& acc) const {
+      acc.merge(mutual);
+      for (auto const& op: oneSided) { acc.merge(op.second); }
+    }
+  };
+
+  // Region points, border and boundary pieces that stayed inside
+  std::unordered_map<Key, Acc> m_inner;
+  // (r, s) -> boundary points of r facing s
+  std::unordered_map<Key, std::unordered_map<Key, Side>> m_out;
+  // Base faced by one-sided pieces -> number of its pieces left
+  std::unordered_map<Key, uint> m_nPiece;
+  // Full statistics of current regions
+  std::unordered_map<Key, Acc> m_full;
+
+ public:
+  RegionFeatsCache () {}
+
+  template <typename TRegionStore, typename TRImagePtr, typename TLImagePtr>
+  RegionFeatsCache (TRegionStore const& rstore, TRImagePtr const& pbImage,
+                    std::vector<double> const& boundaryThresholds,
+                    std::vector<ImageHistPair<TRImagePtr>> const& rImages,
+                    std::vector<ImageHistPair<TLImagePtr>> const& rlImages,
+                    std::vector<ImageHistPair<TRImagePtr>> const& bImages)
+  { set(rstore, pbImage, boundaryThresholds, rImages, rlImages, bImages); }
+
+  ~RegionFeatsCache () override {}
+
+  // Read pixels of base regions of rstore (see TRegionStore) once
+  template <typename TRegionStore, typename TRImagePtr, typename TLImagePtr>
+  void set (TRegionStore const& rstore, TRImagePtr const& pbImage,
+            std::vector<double> const& boundaryThresholds,
+            std::vector<ImageHistPair<TRImagePtr>> const& rImages,
+            std::vector<ImageHistPair<TLImagePtr>> const& rlImages,
+            std::vector<ImageHistPair<TRImagePtr>> const& bImages) {
+    clear();
+    for (uint i = 0; i < rstore.baseSize(); ++i) {
+      Key r = rstore.baseKey(i);
+      m_inner[r].addRegion(rstore.region(r), rImages, rlImages);
+    }
+    setBoundaries(rstore, pbImage, boundaryThresholds, bImages);
+  }
+
+  // Same as above, with statistics of all base regions over region
+  // images from one sweep of labels (see TLabelStats), which should be
+  // those rstore was set with
+  // maxThreads: 0 to use OMP_NUM_THREADS
+  template <typename TRegionStore, typename TImagePtr, typename TMaskPtr,
+            typename TRImagePtr, typename TLImagePtr>
+  void set (TRegionStore const& rstore, TImagePtr const& labels,
+            TMaskPtr const& mask, TRImagePtr const& pbImage,
+            std::vector<double> const& boundaryThresholds,
+            std::vector<ImageHistPair<TRImagePtr>> const& rImages,
+            std::vector<ImageHistPair<TLImagePtr>> const& rlImages,
+            std::vector<ImageHistPair<TRImagePtr>> const& bImages,
+            uint maxThreads) {
+    clear();
+    std::vector<TRImagePtr> images;
+    std::vector<stats::HistBins> bins;
+    for (auto const& ihp: rImages) {
+      if (ihp.image.IsNotNull()) {
+        images.push_back(ihp.image);
+        bins.emplace_back(ihp.histBin, ihp.histRange);
+      }
+    }
+    TLabelStats<Key, TImage<TImagePtr>::ImageDimension> lstats;
+    lstats.set(labels, mask, images, bins, false, maxThreads);
+    for (uint i = 0; i < rstore.baseSize(); ++i) {
+      Key r = rstore.baseKey(i);
+      int li = lstats.find(r);
+      if (li < 0) { perr("Error: region not found in label stats..."); }
+      m_inner[r].addRegion(lstats, li, rstore.region(r), rlImages);
+    }
+    setBoundaries(rstore, pbImage, boundaryThresholds, bImages);
+  }
+
+  void clear () {
+    m_inner.clear();
+    m_out.clear();
+    m_nPiece.clear();
+    m_full.clear();
+  }
+
+ protected:
+  template <typename TRegionStore, typename TRImagePtr>
+  void setBoundaries (TRegionStore const& rstore, TRImagePtr const& pbImage,
+                      std::vector<double> const& boundaryThresholds,
+                      std::vector<ImageHistPair<TRImagePtr>> const& bImages) {
+    // Only bases faced by one-sided pieces have their pieces counted
+    for (uint i = 0; i < rstore.pieceSize(); ++i)
+    { if (!rstore.mutual(i)) { m_nPiece[rstore.pieceKey(i).second]; } }
+    for (uint i = 0; i < rstore.pieceSize(); ++i) {
+      auto const& key = rstore.pieceKey(i);
+      auto& side = m_out[key.first][key.second];
+      Acc acc;
+      acc.addBoundary
+          (rstore.piece(i), pbImage, boundaryThresholds, bImages);
+      bool counted = m_nPiece.count(key.first) > 0;
+      if (counted) { ++m_nPiece[key.first]; }
+      if (rstore.mutual(i)) {
+        side.mutual.merge(acc);
+        if (counted) { ++side.nMutual[key.first]; }
+      } else {
+        side.oneSided[key.second] = acc;
+        // Make neighborhoods symmetric so that merge visits every
+        // neighbor
+        m_out[key.second][key.first];
+      }
+    }
+  }
+
+ public:
+
+  // Statistics of region r
+  virtual Acc const& get (Key r) {
+    auto fit = m_full.find(r);
+    if (fit != m_full.end()) { return fit->second; }
+    auto& acc = m_full[r];
+    acc = m_inner[r];
+    auto oit = m_out.find(r);
+    if (oit != m_out.end())
+    { for (auto const& op: oit->second) { op.second.addTo(acc); } }
+    return acc;
+  }
+
+  // Statistics of the union of regions r0 and r1
+  virtual void getUnion (Acc& acc, Key r0, Key r1) const {
+    acc = clookup(m_inner, r0, Acc());
+    acc.merge(clookup(m_inner, r1, Acc()));
+    for (Key r: {r0, r1}) {
+      auto oit = m_out.find(r);
+      if (oit == m_out.end()) { continue; }
+      for (auto const& op: oit->second) {
+        if (op.first != r0 && op.first != r1) { op.second.addTo(acc); }
+        else {
+          for (auto const& sp: op.second.oneSided)
+          { acc.merge(sp.second); }
+        }
+      }
+    }
+  }
+
+  // Statistics of boundary points between r0 and r1, both sides
+  virtual void getBoundary (Acc& acc, Key r0, Key r1) const {
+    acc = Acc();
+    for (auto const& kp: {std::make_pair(r0, r1), std::make_pair(r1, r0)}) {
+      auto oit = m_out.find(kp.first);
+      if (oit == m_out.end()) { continue; }
+      auto sit = oit->second.find(kp.second);
+      if (sit == oit->second.end()) { continue; }
+      acc.merge(sit->second.mutual);
+      for (auto const& sp: sit->second.oneSided)
+      { if (clookup(m_nPiece, sp.first, 0u) > 0) { acc.merge(sp.second); } }
+    }
+  }
+
+  virtual void merge (Key r0, Key r1, Key r2) {
+    Acc inner;
+    inner.merge(clookup(m_inner, r0, Acc()), clookup(m_inner, r1, Acc()));
+    // Pieces between r0 and r1: one-sided ones stay inside, mutual ones
+    // are dropped
+    for (auto const& kp: {std::make_pair(r0, r1), std::make_pair(r1, r0)}) {
+      auto oit = m_out.find(kp.first);
+      if (oit == m_out.end()) { continue; }
+      auto sit = oit->second.find(kp.second);
+      if (sit == oit->second.end()) { continue; }
+      for (auto const& sp: sit->second.oneSided) { inner.merge(sp.second); }
+      for (auto const& np: sit->second.nMutual)
+      { m_nPiece[np.first] -= np.second; }
+    }
+    std::unordered_map<Key, Side> out2;
+    for (Key r: {r0, r1}) {
+      auto oit = m_out.find(r);
+      if (oit == m_out.end()) { continue; }
+      for (auto& op: oit->second) {
+        Key rs = op.first;
+        if (rs == r0 || rs == r1) { continue; }
+        out2[rs].merge(op.second);
+        auto rsit = m_out.find(rs);
+        if (rsit != m_out.end()) {
+          auto& outs = rsit->second;
+          auto sit = outs.find(r);
+          if (sit != outs.end() && r != r2) {
+            Side side = std::move(sit->second);
+            outs.erase(sit);
+            outs[r2].merge(side);
+          }
+        }
+      }
+      m_out.erase(r);
+    }
+    for (Key r: {r0, r1}) {
+      m_inner.erase(r);
+      m_full.erase(r);
+    }
+    m_out[r2].swap(out2);
+    m_inner[r2] = std::move(inner);
+    m_full.erase(r2);
+  }
+};
+
+};
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef _glia_hmt_tree_build_hxx_
 #define _glia_hmt_tree_build_hxx_
 
+#include "type/key_index.hxx"
 #include "type/tuple.hxx"
 #include "type/tree.hxx"
 
@@ -12,28 +13,28 @@ namespace hmt {
 template <typename TTree, typename TKey, typename Func> void
 genTree (TTree& tree, std::vector<TTriple<TKey>> const& order, Func f)
 {
+  TKeyIndex<TKey> kidx;
+  std::vector<TTriple<uint32>> dorder;
+  compactOrder(dorder, kidx, order);
   tree.reserve(order.size() * 2 + 1);
-  std::unordered_map<TKey, int> nmap;
+  std::vector<int> nodeOf(kidx.size(), -1); // Key index -> tree node
   int ni = 0;
-  for (auto const& merge: order) {
-    auto nit0 = nmap.find(merge.x0);
-    auto nit1 = nmap.find(merge.x1);
-    if (nit0 == nmap.end()) {
-      tree.emplace_back(ni, -1);
-      f(tree.back(), merge.x0);
-      nit0 = nmap.emplace(merge.x0, ni++).first;
+  for (auto const& merge: dorder) {
+    for (auto k: {merge.x0, merge.x1}) {
+      if (nodeOf[k] < 0) {
+        tree.emplace_back(ni, -1);
+        f(tree.back(), kidx.key(k));
+        nodeOf[k] = ni++;
+      }
     }
-    if (nit1 == nmap.end()) {
-      tree.emplace_back(ni, -1);
-      f(tree.back(), merge.x1);
-      nit1 = nmap.emplace(merge.x1, ni++).first;
-    }
-    tree[nit0->second].parent = ni;
-    tree[nit1->second].parent = ni;
+    tree[nodeOf[merge.x0]].parent = ni;
+    tree[nodeOf[merge.x1]].parent = ni;
     tree.emplace_back
-        (ni, -1, std::initializer_list<int>{nit0->second, nit1->second});
-    f(tree.back(), merge.x2);
-    nmap.emplace(merge.x2, ni++);
+        (ni, -1, std::initializer_list<int>{nodeOf[merge.x0],
+                                            nodeOf[merge.x1]});
+    f(tree.back(), kidx.key(merge.x2));
+    if (nodeOf[merge.x2] < 0) { nodeOf[merge.x2] = ni; }
+    ++ni;
   }
 }
 
@@ -0,0 +1,30 @@
+#include "alg/rf_.hxx"
+#include "util/text_cmd.hxx"
+using namespace glia;
+
+std::string modelFile;
+std::string forestFile;
+
+bool operation ()
+{
+  ml::rf::Model model;
+  model.readFromOld(modelFile);
+  alg::FlatForest flat;
+  alg::compileForest(flat, model);
+  alg::writeForestFile(forestFile, {&flat}, 1);
+  return true;
+}
+
+
+int main (int argc, char* argv[])
+{
+  bpo::options_description opts("Usage");
+  opts.add_options()
+      ("help", "Print usage info")
+      ("m", bpo::value<std::string>(&modelFile)->required(),
+       "Input old binary model file name")
+      ("o", bpo::value<std::string>(&forestFile)->required(),
+       "Output forest file name");
+  return parse(argc, argv, opts) && operation() ?
+      EXIT_SUCCESS : EXIT_FAILURE;
+}
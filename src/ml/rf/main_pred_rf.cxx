@@ -1,4 +1,4 @@
-#include "alg/rf.hxx"
+#include "alg/rf_.hxx"
 #include "alg/function.hxx"
 #include "util/text_io.hxx"
 #include "util/text_cmd.hxx"
@@ -14,9 +14,11 @@ bool operation ()
 {
   // Prepare classifier
   std::shared_ptr<opt::TFunction<std::vector<FVal>>> rf;
+  std::shared_ptr<alg::RandomForest> srf;
   if (modelFiles.size() == 1) {
-    rf = std::make_shared<alg::RandomForest>(
+    srf = std::make_shared<alg::RandomForest>(
         predictLabel, modelFiles.front());
+    rf = srf;
   } else {
     if (modelDistributorArgs.size() != 3)
     { perr("Error: model distributor needs 3 arguments..."); }
@@ -32,8 +34,20 @@ bool operation ()
     feats.clear();
     preds.clear();
     readData(feats, featFiles[i]);
-    preds.reserve(feats.size());
-    for (auto const& x : feats) { preds.push_back(rf->operator()(x)); }
+    if (srf && !feats.empty()) {
+      // All samples at once through the flat forest
+      int d = feats.front().size();
+      std::vector<FVal> X;
+      X.reserve(feats.size() * d);
+      for (auto const& x : feats) {
+        if (x.size() != d) { perr("Error: inconsistent feature sizes..."); }
+        X.insert(X.end(), x.begin(), x.end());
+      }
+      srf->predict(preds, X.data(), feats.size(), d, 0);
+    } else {
+      preds.reserve(feats.size());
+      for (auto const& x : feats) { preds.push_back(rf->operator()(x)); }
+    }
     writeData(predFiles[i], preds, "\n", FLT_PREC);
   }
   return true;
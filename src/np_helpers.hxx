@@ -23,116 +23,136 @@ namespace bp = boost::python;
 
 namespace nph {
 
+// Releases the GIL for its lifetime, so that other Python threads can run
+// No Python object may be touched while it is alive
+class gil_release {
+public:
+  gil_release() : state(PyEval_SaveThread()) {}
+  ~gil_release() { PyEval_RestoreThread(state); }
+  gil_release(gil_release const &) = delete;
+  gil_release &operator=(gil_release const &) = delete;
+
+private:
+  PyThreadState *state;
+};
+
+// References to arrays viewed by zero-copy images (see np_to_itk), held
+// while the images are used, so that arrays taken from lists stay alive
+// when other Python threads drop them while the GIL is released
+using ArrayRefs = std::vector<np::ndarray>;
+
+// Extracts an array from obj and keeps a reference to it in refs
+inline np::ndarray keep_array(ArrayRefs &refs, bp::object const &obj) {
+  refs.push_back(bp::extract<np::ndarray>(obj)());
+  return refs.back();
+}
+
 inline void print(np::ndarray arr) {
   std::cout << bp::extract<char const *>(bp::str(arr)) << std::endl;
 }
 
-// Converts an ITK image to numpy array
+// Keeps an ITK image alive as the base object of numpy arrays viewing its
+// buffer
+template <typename ImageType> void release_itk_image(PyObject *capsule) {
+  delete static_cast<typename ImageType::Pointer *>(
+      PyCapsule_GetPointer(capsule, nullptr));
+}
+
+// Converts an ITK image to numpy array of shape (size[D - 1], ..., size[0])
+// The array views the image buffer and holds a reference to the image
+// Images not buffered whole are copied
 template <typename ImageType, typename PixelType>
 np::ndarray itk_to_np(ImageType *inputImage) {
-
-  auto region = inputImage->GetLargestPossibleRegion();
-  auto size = region.GetSize();
-
-  using IteratorType = itk::ImageLinearIteratorWithIndex<ImageType>;
+  static_assert(std::is_same<typename ImageType::PixelType, PixelType>::value,
+                "pixel type mismatch");
+  constexpr unsigned int D = ImageType::ImageDimension;
+  auto const &region = inputImage->GetLargestPossibleRegion();
+  auto const &size = region.GetSize();
+  std::vector<Py_intptr_t> shape(D), strides(D);
+  Py_intptr_t stride = sizeof(PixelType);
+  for (unsigned int i = 0; i < D; ++i) {
+    shape[D - 1 - i] = size[i];
+    strides[D - 1 - i] = stride;
+    stride *= size[i];
+  }
+  auto dtype = np::dtype::get_builtin<PixelType>();
+  if (inputImage->GetBufferedRegion() == region &&
+      inputImage->GetBufferPointer() != nullptr) {
+    auto *owner = new typename ImageType::Pointer(inputImage);
+    bp::object capsule(bp::handle<>(
+        PyCapsule_New(owner, nullptr, &release_itk_image<ImageType>)));
+    return np::from_data(inputImage->GetBufferPointer(), dtype, shape, strides,
+                         capsule);
+  }
+  np::ndarray out_np = np::empty(D, shape.data(), dtype);
+  PixelType *out = reinterpret_cast<PixelType *>(out_np.get_data());
   using ConstIteratorType = itk::ImageLinearConstIteratorWithIndex<ImageType>;
-
-  np::ndarray out_np = np::empty(bp::make_tuple(size[0] * size[1]),
-                                 np::dtype::get_builtin<PixelType>());
-  ConstIteratorType it(inputImage, inputImage->GetRequestedRegion());
+  ConstIteratorType it(inputImage, region);
   it.SetDirection(0);
-  unsigned int i = 0;
   for (it.GoToBegin(); !it.IsAtEnd(); it.NextLine()) {
-    it.GoToBeginOfLine();
-    while (!it.IsAtEndOfLine()) {
-      out_np[i] = it.Get();
-      ++it;
-      ++i;
+    for (it.GoToBeginOfLine(); !it.IsAtEndOfLine(); ++it) {
+      *out++ = it.Get();
     }
   }
-  return out_np.reshape(bp::make_tuple(size[1], size[0]));
+  return out_np;
 }
 
-
-// Converts a numpy array to ITK image
-inline LabelImage<DIMENSION>::Pointer
-np_to_itk_label(const np::ndarray &inputArray) {
-
-  auto X = inputArray.astype(np::dtype::get_builtin<Label>());
-
-  using LabelImageType = LabelImage<DIMENSION>;
-  using ShapeType = const long int *;
-  typedef itk::ImportImageFilter<Label, DIMENSION> ImportFilterType;
-  typedef itk::PasteImageFilter<LabelImageType> PasteFilterType;
-  typename LabelImageType::Pointer image = LabelImageType::New();
+// Converts a numpy array of shape (size[D - 1], ..., size[0]) to ITK image
+// Writeable, aligned, C-contiguous arrays of matching dtype are imported
+// without copy; the image is then only valid while the array is alive
+// (see ArrayRefs) and must not outlive the call it was made in
+// Other arrays are converted to a contiguous copy owned by the image
+template <typename TPixel, unsigned int D>
+typename itk::Image<TPixel, D>::Pointer np_to_itk(np::ndarray const &inputArray) {
+  using ImageType = itk::Image<TPixel, D>;
+  using ImportFilterType = itk::ImportImageFilter<TPixel, D>;
+  if (inputArray.get_nd() != (int)D) {
+    perr("Error: expecting " + std::to_string(D) + "-d array...");
+  }
+  auto dtype = np::dtype::get_builtin<TPixel>();
   typename ImportFilterType::SizeType size;
-  typename ImportFilterType::RegionType region;
   typename ImportFilterType::IndexType start;
-
-  ShapeType shape = reinterpret_cast<ShapeType>(X.get_shape());
-  size[1] = shape[0];
-  size[0] = shape[1];
   start.Fill(0);
-
-  region.SetIndex(start);
-  region.SetSize(size);
-
-  image->SetRegions(region);
-  image->Allocate();
-
-  Label *data = reinterpret_cast<Label *>(X.get_data());
-  int i = 0;
-  for (int y = 0; y < size[1]; ++y) {
-    for (int x = 0; x < size[0]; ++x) {
-    const LabelImageType::IndexType pixelIndex = {{x, y}};
-    auto val = data[i];
-    image->SetPixel(pixelIndex, val);
-    // std::cout << "(" << x << "," << y << "): " << val << std::endl;
-    i++;
+  itk::SizeValueType n = 1;
+  for (unsigned int i = 0; i < D; ++i) {
+    size[i] = inputArray.shape(D - 1 - i);
+    n *= size[i];
+  }
+  typename ImportFilterType::RegionType region(start, size);
+  bool direct = np::equivalent(inputArray.get_dtype(), dtype) &&
+                (inputArray.get_flags() & np::ndarray::C_CONTIGUOUS) &&
+                (inputArray.get_flags() & np::ndarray::ALIGNED) &&
+                (inputArray.get_flags() & np::ndarray::WRITEABLE);
+  if (!direct) {
+    np::ndarray X = inputArray.astype(dtype);
+    if (!(X.get_flags() & np::ndarray::C_CONTIGUOUS)) {
+      X = X.copy();
     }
+    typename ImageType::Pointer image = ImageType::New();
+    image->SetRegions(region);
+    image->Allocate();
+    TPixel const *data = reinterpret_cast<TPixel const *>(X.get_data());
+    std::copy(data, data + n, image->GetBufferPointer());
+    return image;
   }
-
-
+  typename ImportFilterType::Pointer importFilter = ImportFilterType::New();
+  importFilter->SetRegion(region);
+  importFilter->SetImportPointer(
+      reinterpret_cast<TPixel *>(inputArray.get_data()), n, false);
+  importFilter->Update();
+  typename ImageType::Pointer image = importFilter->GetOutput();
+  image->DisconnectPipeline();
   return image;
 }
 
+inline LabelImage<DIMENSION>::Pointer
+np_to_itk_label(const np::ndarray &inputArray) {
+  return np_to_itk<Label, DIMENSION>(inputArray);
+}
 
-inline RealImage<2>::Pointer np_to_itk_real(const np::ndarray &inputArray) {
-
-  auto X = inputArray.astype(np::dtype::get_builtin<Real>());
-  using RealImageType = RealImage<2>;
-  using ShapeType = const long int *;
-  typedef itk::ImportImageFilter<Real, 2> ImportFilterType;
-  typedef itk::PasteImageFilter<RealImageType> PasteFilterType;
-  typename RealImageType::Pointer image = RealImageType::New();
-  typename ImportFilterType::SizeType size;
-  typename ImportFilterType::RegionType region;
-  typename ImportFilterType::IndexType start;
-  ImportFilterType::Pointer importFilter = ImportFilterType::New();
-
-  ShapeType shape = reinterpret_cast<ShapeType>(X.get_shape());
-  size[1] = shape[0];
-  size[0] = shape[1];
-  start.Fill(0);
-
-  region.SetIndex(start);
-  region.SetSize(size);
-
-  image->SetRegions(region);
-  image->Allocate();
-
-  Real *data = reinterpret_cast<Real *>(X.get_data());
-  int i = 0;
-  for (int y = 0; y < size[1]; ++y) {
-    for (int x = 0; x < size[0]; ++x) {
-    const RealImageType::IndexType pixelIndex = {{x, y}};
-    auto val = data[i];
-    image->SetPixel(pixelIndex, val);
-    i++;
-    }
-  }
-
-  return image;
+inline RealImage<DIMENSION>::Pointer
+np_to_itk_real(const np::ndarray &inputArray) {
+  return np_to_itk<Real, DIMENSION>(inputArray);
 }
 
 template <typename T>
@@ -260,11 +280,13 @@ std::vector<glia::TTriple<T>> np_to_vector_triple(bp::list const &list) {
 
 // convert python list of arrays to vector of itk real images
 // This builds vector of ImageHistPair
+// refs: if given, keeps the arrays alive for images viewing them
 inline std::vector<hmt::ImageHistPair<RealImage<DIMENSION>::Pointer>>
 lists_to_image_hist_pair(bp::list const &im_list,
                          bp::list const &histogramBins,
                          bp::list const &histogramLowerValues,
-                         bp::list const &histogramHigherValues) {
+                         bp::list const &histogramHigherValues,
+                         ArrayRefs *refs = nullptr) {
 
   int n_imgs = bp::len(im_list);
   std::vector<hmt::ImageHistPair<RealImage<DIMENSION>::Pointer>> out;
@@ -275,7 +297,8 @@ lists_to_image_hist_pair(bp::list const &im_list,
   for (unsigned int i = 0; i < bp::len(im_list); ++i) {
     std::pair<double, double> hist_range;
     int n_bins;
-    np::ndarray arr = bp::extract<np::ndarray>(im_list[i]);
+    np::ndarray arr = refs ? keep_array(*refs, im_list[i])
+                           : bp::extract<np::ndarray>(im_list[i])();
     hist_range.first = bp::extract<double>(histogramLowerValues[i]);
     hist_range.second = bp::extract<double>(histogramHigherValues[i]);
     n_bins = bp::extract<int>(histogramBins[i]);
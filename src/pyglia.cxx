@@ -30,15 +30,31 @@ BOOST_PYTHON_MODULE(libglia) {
            "Generate watershed segmentation")
 
       .def("merge_order_pb", &MyHmt::merge_order_pb_wrp,
-           bp::args("label", "pbArray", "bd_intens_stats_type"),
+           (bp::arg("label"), bp::arg("pbArray"),
+            bp::arg("bd_intens_stats_type"), bp::arg("lazyQueue") = false),
            "Perform greedy merge according to boundary probability")
 
+      .def("merge_order_pb_batch", &MyHmt::merge_order_pb_batch,
+           (bp::arg("labels"), bp::arg("pbArrays"),
+            bp::arg("bd_intens_stats_type"), bp::arg("lazyQueue") = false),
+           "Perform merge_order_pb on lists of frames in parallel")
+
       .def("merge_order_bc", &MyHmt::merge_order_bc_wrp,
-           bp::args("label", "images", "pbArray",
-                    "histogramBins", "histogramLowerValues",
-                    "histogramHigherValues", "useLogOfShapes", "cat_thr"),
+           (bp::arg("label"), bp::arg("images"), bp::arg("pbArray"),
+            bp::arg("histogramBins"), bp::arg("histogramLowerValues"),
+            bp::arg("histogramHigherValues"), bp::arg("useLogOfShapes"),
+            bp::arg("cat_thr"), bp::arg("lazyQueue") = false,
+            bp::arg("randomSeed") = -1),
            "Perform greedy merge according to boundary probability")
 
+      .def("merge_order_bc_batch", &MyHmt::merge_order_bc_batch,
+           (bp::arg("labels"), bp::arg("images"), bp::arg("pbArrays"),
+            bp::arg("histogramBins"), bp::arg("histogramLowerValues"),
+            bp::arg("histogramHigherValues"), bp::arg("useLogOfShapes"),
+            bp::arg("cat_thr"), bp::arg("lazyQueue") = false,
+            bp::arg("randomSeed") = -1),
+           "Perform merge_order_bc on lists of frames in parallel")
+
       .def("bc_feat", &MyHmt::bc_feat_wrp,
            bp::args("mergeList", "salienciesArray", "labelImages", "Images",
                     "boundaryImages", "histogramBins", "histogramLowerValues",
@@ -47,6 +63,20 @@ BOOST_PYTHON_MODULE(libglia) {
                     "useLogOfShapes"),
            "Generate features for boundary classifier")
 
+      .def("bc_feat_batch", &MyHmt::bc_feat_batch,
+           bp::args("mergeLists", "salienciesArrays", "labelImages", "Images",
+                    "boundaryImages", "histogramBins", "histogramLowerValues",
+                    "histogramHigherValues", "initialSaliency", "saliencBias",
+                    "boundaryShapeThresholds", "normalizesizelength",
+                    "useLogOfShapes"),
+           "Perform bc_feat on lists of frames in parallel")
+
+      .def("segment", &MyHmt::segment,
+           bp::args("pbArray", "images", "histogramBins",
+                    "histogramLowerValues", "histogramHigherValues", "level",
+                    "useLogOfShapes", "cat_thr"),
+           "Segment a frame: watershed, merge order and tree resolution")
+
       .def("train_rf", &MyHmt::train_rf_operation,
            bp::args("X", "Y"),
            "Train RF classifier")
@@ -54,6 +84,12 @@ BOOST_PYTHON_MODULE(libglia) {
       .def("get_models", &MyHmt::get_models,
            "Return models in JSON format")
 
+      .def("save_models", &MyHmt::save_models, bp::args("filename"),
+           "Write models to a binary forest file")
+
+      .def("load_models_file", &MyHmt::load_models_file, bp::args("filename"),
+           "Map models from a binary forest file (inference only)")
+
       .def("get_threshold", &MyHmt::get_cat_threshold,
            "Return threshold for categorization of boundary samples")
 
@@ -63,5 +99,23 @@ BOOST_PYTHON_MODULE(libglia) {
                     "maxPrecDrop"),
            "Generate for each clique a label indicating split/merge")
 
+      .def("bc_label_ri_batch", &MyHmt::bc_label_ri_batch,
+           bp::args("mergeOrderLists", "labels", "groundtruths",
+                    "usePairF1", "globalOpt", "optSplit", "tweak",
+                    "maxPrecDrop"),
+           "Perform bc_label_ri on lists of frames in parallel")
+
+      .def("get_stats", &MyHmt::get_stats,
+           "Return collected timers, counters and gauges")
+
+      .def("reset_stats", &MyHmt::reset_stats,
+           "Reset collected timers, counters and gauges")
+
+      .def("set_tracing", &MyHmt::set_tracing, bp::args("on"),
+           "Start or stop recording trace events")
+
+      .def("write_trace", &MyHmt::write_trace, bp::args("filename"),
+           "Write recorded trace events as Chrome trace JSON")
+
       .def("hello", &MyHmt::hello);
 }
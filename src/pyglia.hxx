@@ -4,6 +4,7 @@
 #include "alg/rf.hxx"
 #include "np_helpers.hxx"
 #include "shogun_helpers.hxx"
+#include "util/metrics.hxx"
 #include <boost/python.hpp>
 #include <boost/python/numpy.hpp>
 
@@ -11,6 +12,11 @@ namespace bp = boost::python;
 namespace np = boost::python::numpy;
 using namespace boost;
 
+// Heavy sections of the entry points run without the GIL, so calls from
+// several Python threads overlap; config, load_models(_file) and
+// train_rf replace or modify the models and must not run
+// concurrently with other calls
+// *_batch entry points process lists of frames in parallel
 class MyHmt {
 private:
   std::shared_ptr<glia::alg::EnsembleRandomForest> bc;
@@ -47,7 +53,9 @@ public:
   void set_model(bp::list models){};
   np::ndarray watershed_operation(np::ndarray const &, double, bool);
   bp::tuple merge_order_pb_wrp(np::ndarray const &, np::ndarray const &,
-                               int const &);
+                               int const &, bool const &);
+  bp::list merge_order_pb_batch(bp::list const &, bp::list const &,
+                                int const &, bool const &);
 
   // models is a list of lists
   void load_models(bp::list const &models) {
@@ -67,14 +75,31 @@ public:
     }
   };
 
+  // Shogun JSON of all stages; not available for models of a forest file
   bp::list get_models() {
     auto serial_vec = bc->to_serialized();
     return std_2d_vector_to_list(serial_vec);
   };
 
+  // Binary forest file of all stages (see alg/forest_file.hxx)
+  void save_models(std::string const &filename) { bc->write_file(filename); }
+
+  // Stages of a forest file, mapped so that processes loading the same
+  // file share its pages; the models are then inference only
+  void load_models_file(std::string const &filename) {
+    if (!bc) {
+      config();
+    }
+    bc->read_file(filename);
+    n_cats = bc->n_cats;
+  }
+
   np::ndarray bc_label_ri_wrp(bp::list const &, np::ndarray const &,
                               np::ndarray const &, bool const &, int const &,
                               bool const &, bool const &, double const &);
+  bp::list bc_label_ri_batch(bp::list const &, bp::list const &,
+                             bp::list const &, bool const &, int const &,
+                             bool const &, bool const &, double const &);
   np::ndarray bc_feat_wrp(bp::list const &, np::ndarray const &,
                           np::ndarray const &, // SP labels
                           bp::list const &,    // LAB, HSV, SIFT codes, etc..
@@ -82,14 +107,111 @@ public:
                           bp::list const &, bp::list const &, bp::list const &,
                           double const &, double const &, bp::list const &,
                           bool const &, bool const &);
+  bp::list bc_feat_batch(bp::list const &, bp::list const &,
+                         bp::list const &, // SP labels
+                         bp::list const &, // lists of images
+                         bp::list const &, // gPb, UCM, etc..
+                         bp::list const &, bp::list const &, bp::list const &,
+                         double const &, double const &, bp::list const &,
+                         bool const &, bool const &);
   bp::tuple
   merge_order_bc_wrp(np::ndarray const &, // SP labels
                      bp::list const &,    // LAB, HSV, SIFT codes, etc..
                      np::ndarray const &, // gPb, UCM, etc..
                      bp::list const &, bp::list const &, bp::list const &,
                      bool const &,
-                     double const&);
+                     double const&, bool const &, long const &);
+  bp::list merge_order_bc_batch(bp::list const &, // SP labels
+                                bp::list const &, // lists of images
+                                bp::list const &, // gPb, UCM, etc..
+                                bp::list const &, bp::list const &,
+                                bp::list const &, bool const &,
+                                double const &, bool const &, long const &);
 
   void train_rf_operation(np::ndarray const &, np::ndarray const &);
+
+  // Watershed, merge order, classification and final segmentation of one
+  // frame in a single call
+  np::ndarray segment(np::ndarray const &, // gPb, UCM, etc..
+                      bp::list const &,    // LAB, HSV, SIFT codes, etc..
+                      bp::list const &, bp::list const &, bp::list const &,
+                      double const &, bool const &, double const &);
+
+  // Timers (seconds), counters and gauges collected so far
+  // Empty unless built with GLIA_METRICS
+  bp::dict get_stats() {
+    auto const &registry = glia::metrics::Registry::instance();
+    bp::dict timers, counters, gauges;
+    registry.traverseTimers([&timers](glia::metrics::Timer const &t) {
+      auto ts = t.stats();
+      bp::dict d;
+      d["count"] = ts.count;
+      d["total"] = ts.total;
+      d["mean"] = ts.count > 0 ? ts.total / ts.count : 0.0;
+      d["min"] = ts.min;
+      d["max"] = ts.max;
+      d["per_sec"] = ts.total > 0.0 ? ts.count / ts.total : 0.0;
+      timers[t.name()] = d;
+    });
+    registry.traverseCounters([&counters](glia::metrics::Counter const &c) {
+      counters[c.name()] = c.value();
+    });
+    registry.traverseGauges([&gauges](glia::metrics::Gauge const &g) {
+      bp::dict d;
+      d["value"] = g.value();
+      d["max"] = g.max();
+      gauges[g.name()] = d;
+    });
+    bp::dict stats;
+    stats["timers"] = timers;
+    stats["counters"] = counters;
+    stats["gauges"] = gauges;
+    return stats;
+  }
+
+  void reset_stats() { glia::metrics::Registry::instance().reset(); }
+
+  void set_tracing(bool on) {
+    glia::metrics::Registry::instance().setTracing(on);
+  }
+
+  void write_trace(std::string const &filename) {
+    if (!glia::metrics::Registry::instance().writeChromeTrace(filename)) {
+      glia::perr("Error: cannot write trace file " + filename);
+    }
+  }
 };
+
+// Per-frame operations behind the entry points, shared by the pipeline
+// Touch no Python object
+// lazyQueue: keep boundaries in a lazy-invalidation queue (see
+// BoundaryQueue); same merge order
+// randomSeed: if non-negative, draw merges at random by saliency
+// mergeProbs: if given, receives the merge probability of each merge
+std::tuple<std::vector<glia::TTriple<glia::Label>>, std::vector<double>>
+merge_order_pb_operation(glia::LabelImage<glia::DIMENSION>::Pointer,
+                         glia::RealImage<glia::DIMENSION>::Pointer,
+                         int const &, bool const &lazyQueue = false);
+
+// Writes order.size() rows of bc_feat_dim(images) features (selectFeatures)
+void bc_feat_operation(
+    glia::FVal *, std::vector<glia::TTriple<glia::Label>> const &,
+    std::vector<double> const &, glia::LabelImage<glia::DIMENSION>::Pointer,
+    std::vector<glia::hmt::ImageHistPair<
+        glia::RealImage<glia::DIMENSION>::Pointer>> const &,
+    glia::RealImage<glia::DIMENSION>::Pointer const &, double, double,
+    std::vector<double> const &, bool, bool);
+
+glia::uint bc_feat_dim(std::vector<glia::hmt::ImageHistPair<
+                           glia::RealImage<glia::DIMENSION>::Pointer>> const &);
+
+std::tuple<std::vector<glia::TTriple<glia::Label>>, std::vector<double>>
+merge_order_bc_operation(
+    glia::LabelImage<glia::DIMENSION>::Pointer,
+    std::vector<glia::hmt::ImageHistPair<
+        glia::RealImage<glia::DIMENSION>::Pointer>> const &,
+    glia::RealImage<glia::DIMENSION>::Pointer const &, bool const &,
+    std::shared_ptr<glia::alg::EnsembleRandomForest>,
+    double const &, bool const &lazyQueue = false,
+    long const &randomSeed = -1, std::vector<double> *mergeProbs = nullptr);
 #endif
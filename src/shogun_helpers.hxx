@@ -27,30 +27,38 @@ typedef std::shared_ptr<MulticlassLabels> MulticlassLabelsPtr;
 // type without modifying the underlying dataset.
 template <typename T> T median(T *begin, T *end);
 
+// Category of a sample from its two categorizing features: 0 if both
+// are below thr, 1 if only one is, 2 otherwise
 template <typename T>
-inline int categorize_sample(SGVector<T> &f, int const &idx_first,
-                             int const &idx_second, double const &thr) {
+inline int categorize_values(T const &first, T const &second,
+                             double const &thr) {
 
-    if (std::max(f.get_element(idx_first), f.get_element(idx_second)) <
-        thr) {
+    if (std::max(first, second) < thr) {
       return 0;
-    } else if ((std::min(f.get_element(idx_first), f.get_element(idx_second)) <
-                thr) &&
-               (std::max(f.get_element(idx_first), f.get_element(idx_second)) >=
-                thr)) {
+    } else if ((std::min(first, second) < thr) &&
+               (std::max(first, second) >= thr)) {
       return 1;
     } else {
       return 2;
     }
 }
+
+template <typename T>
+inline int categorize_sample(SGVector<T> &f, int const &idx_first,
+                             int const &idx_second, double const &thr) {
+  return categorize_values(f.get_element(idx_first),
+                           f.get_element(idx_second), thr);
+}
 class CategorizedFeatures {
 private:
   double threshold;
 
 public:
+  // Samples of each category, in increasing order
   std::vector<std::vector<int>> indices;
   int n_cats = 3;
   int n_dims = 0;
+  // Source features if categorized from them, null otherwise
   FeaturesPtr feats;
   std::vector<FeaturesPtr> feats_by_cat;
 
@@ -62,62 +70,56 @@ public:
               int const &idx_second) const {
     return categorize_sample(f, idx_first, idx_second, threshold);
   }
-  CategorizedFeatures(FeaturesPtr feats_, int const &idx_first,
-                      int const &idx_second) {
-
-    // Compute median of features on given idx
-    auto mat = feats_->get_feature_matrix();
-    // mat.display_matrix();
-    auto first = mat.get_row_vector(idx_first);
-    auto second = mat.get_row_vector(idx_second);
-    auto first_vec =
-        std::vector<double>(first.vector, first.vector + first.size());
-    auto second_vec =
-        std::vector<double>(first.vector, first.vector + first.size());
-    first_vec.insert(first_vec.end(), second_vec.begin(), second_vec.end());
-
-    n_dims = mat.get_column(0).size();
+  // Categorize n samples of dimension d, row-major in X (equivalently,
+  // a column-major d x n feature matrix)
+  // Samples are grouped by category in a single pass and copied once,
+  // straight into the per-category matrices, so that X may be the
+  // caller's buffer and no categorized copy of the whole set is made
+  template <typename T>
+  CategorizedFeatures(T const *X, int const &n, int const &d,
+                      int const &idx_first, int const &idx_second) {
+
+    // Compute median of features on given idx (idx_first only)
+    std::vector<double> vals;
+    vals.reserve(n);
+    for (int i = 0; i < n; ++i) {
+      vals.push_back(X[(size_t)i * d + idx_first]);
+    }
+    threshold = median<double>(vals.data(), vals.data() + vals.size());
+    vals = std::vector<double>();
 
-    threshold = median<double>(&first_vec.front(),
-                               &first_vec.front() + first_vec.size());
-    // std::cout << "median: " << threshold << std::endl;
+    n_dims = d;
 
     // store indices for each category
-    indices = std::vector<std::vector<int>>(3);
-    for (int i = 0; i < feats_->get_num_vectors(); ++i) {
-      auto this_feat = feats_->get_feature_vector(i);
-      auto this_cat = get_cat(this_feat, idx_first, idx_second);
-      indices[this_cat].push_back(i);
+    indices = std::vector<std::vector<int>>(n_cats);
+    for (int i = 0; i < n; ++i) {
+      T const *x = X + (size_t)i * d;
+      indices[categorize_values(x[idx_first], x[idx_second], threshold)]
+          .push_back(i);
     }
 
     for (int i = 0; i < indices.size(); ++i) {
-      // std::cout << "got " << indices[i].size() << " samples in cat. " << i
-      //           << std::endl;
-      auto mat_this_cat =
-          SGMatrix<double>(feats_->get_num_features(), indices[i].size());
+      auto mat_this_cat = SGMatrix<double>(d, indices[i].size());
       for (int j = 0; j < indices[i].size(); ++j) {
-        SGVector<double> vec = mat.get_column(indices[i][j]);
-        // vec.display_vector();
-        mat_this_cat.set_column(j, vec);
+        T const *x = X + (size_t)indices[i][j] * d;
+        std::copy(x, x + d, mat_this_cat.matrix + (size_t)j * d);
       }
-      // mat_this_cat.display_matrix();
-
-      auto feats_this_cat =
-          std::make_shared<DenseFeatures<double>>(mat_this_cat);
-      feats_by_cat.push_back(feats_this_cat);
+      feats_by_cat.push_back(
+          std::make_shared<DenseFeatures<double>>(mat_this_cat));
     }
+  }
 
+  CategorizedFeatures(FeaturesPtr feats_, int const &idx_first,
+                      int const &idx_second)
+      : CategorizedFeatures(feats_->get_feature_matrix().matrix,
+                            feats_->get_num_vectors(),
+                            feats_->get_num_features(), idx_first,
+                            idx_second) {
     feats = feats_;
   }
 
   FeaturesPtr get(int const &cat) { return feats_by_cat[cat]; }
 
-  // this doesn't work: https://github.com/shogun-toolbox/shogun/issues/4795
-  SubFeaturesPtr get_subsamples(int const &cat) {
-    auto vec = SGVector<int>(indices[cat].begin(), indices[cat].end());
-    return std::make_shared<SubFeatures>(feats, vec);
-  }
-
   // Generate MulticlassLabels according to category
   MulticlassLabelsPtr filter_labels(MulticlassLabelsPtr labels,
                                     int const &cat) const {
@@ -128,6 +130,20 @@ public:
     return labels;
   }
 
+  // Labels of category cat, copied so that the shared labels are left
+  // without a subset (filter_labels sets one on them)
+  MulticlassLabelsPtr copy_labels(MulticlassLabelsPtr labels,
+                                  int const &cat) const {
+
+    labels->remove_all_subsets();
+    auto all = labels->get_labels();
+    auto sel = SGVector<float64_t>(indices[cat].size());
+    for (int j = 0; j < indices[cat].size(); ++j) {
+      sel[j] = all[indices[cat][j]];
+    }
+    return std::make_shared<MulticlassLabels>(sel);
+  }
+
   // For each category, display feature matrix
   void display_feats() {
     for (int i = 0; i < indices.size(); ++i) {
@@ -175,7 +191,11 @@ MulticlassLabelsPtr np_to_shogun_labels(np::ndarray const &X) {
   return labels;
 }
 
-template <typename Tx> FeaturesPtr np_to_shogun_feats(np::ndarray const &X) {
+template <typename Tx> FeaturesPtr np_to_shogun_feats(np::ndarray const &X_) {
+  // Features may come in another precision (see GLIA_FLOAT_FEATS)
+  auto X = X_.get_dtype() == np::dtype::get_builtin<Tx>()
+               ? X_
+               : X_.astype(np::dtype::get_builtin<Tx>());
   Tx *data = reinterpret_cast<Tx *>(X.get_data());
   auto mat = SGMatrix<Tx>(X.shape(1), X.shape(0));
   // std::cout << X.shape(0) << std::endl;
@@ -0,0 +1,229 @@
+#include "hmt/bc_feat.hxx"
+#include "hmt/region_feats_cache.hxx"
+#include "test/test_image.hxx"
+#include "test/test_util.hxx"
+#include "type/region_store.hxx"
+#include "util/struct_merge.hxx"
+
+using namespace glia;
+using namespace glia::hmt;
+
+typedef TRegionMap<Label, Point<2>> RegionMap;
+typedef TRegionStore<Label, 2> RegionStore;
+typedef std::vector<ImageHistPair<RealImage<2>::Pointer>> ImagePairs;
+typedef std::vector<std::vector<FVal>> Rows;
+
+// Frame drawn by genLabelImage and genRealImage: pb, then two region
+// images, continuous and of 20 levels; pb is also the boundary image
+struct Frame {
+  LabelImage<2>::Pointer seg;
+  RealImage<2>::Pointer pb;
+  ImagePairs images, boundaryImages;
+  std::vector<double> boundaryThresholds{0.3, 0.6};
+  double normalizingArea, normalizingLength;
+
+  Frame(long seed, UInt width, UInt height, int nSeed) {
+    std::mt19937 rng(seed);
+    seg = test::genLabelImage(width, height, nSeed, rng);
+    pb = test::genRealImage(width, height, 0, rng);
+    images.emplace_back(test::genRealImage(width, height, 0, rng), 8,
+                        std::make_pair(0.0, 1.0));
+    images.emplace_back(test::genRealImage(width, height, 20, rng), 5,
+                        std::make_pair(0.0, 1.0));
+    boundaryImages.emplace_back(pb, 16, std::make_pair(0.0, 1.0));
+    normalizingArea = width * height;
+    normalizingLength = std::sqrt((double)width * width + height * height);
+  }
+};
+
+// Merge order of merge_order_pb (boundary pb means)
+std::vector<TTriple<Label>> mergeOrder(Frame const &f) {
+  LabelImage<2>::Pointer mask(nullptr);
+  RegionMap rmap(f.seg, mask, true);
+  std::vector<TTriple<Label>> order;
+  std::vector<double> saliencies;
+  genMergeOrderGreedyUsingPbMean(
+      order, saliencies, rmap, false, f.pb,
+      f_true<TBoundaryTable<std::pair<double, int>, RegionMap> &,
+             TBoundaryTable<std::pair<double, int>, RegionMap>::iterator>);
+  return order;
+}
+
+// Rows of bc_feat before rows were written in place: features of every
+// region generated from region map points, boundary features built per
+// merge, then logged and picked by selectFeatures
+Rows pixelRows(Frame const &f, std::vector<TTriple<Label>> const &order,
+               bool useLogShape) {
+  ImagePairs labelImages;
+  LabelImage<2>::Pointer mask(nullptr);
+  RegionMap rmap(f.seg, mask, order, false);
+  std::unordered_map<Label, std::shared_ptr<RegionFeats>> rfmap;
+  for (auto const &rp : rmap) {
+    auto rf = std::make_shared<RegionFeats>();
+    rf->generate(rp.second, f.normalizingArea, f.normalizingLength, f.pb,
+                 f.boundaryThresholds, f.images, labelImages,
+                 f.boundaryImages, nullptr);
+    rfmap[rp.first] = rf;
+  }
+  std::vector<BoundaryClassificationFeats> bfeats(order.size());
+  for (int i = 0; i < order.size(); ++i) {
+    auto &bcf = bfeats[i];
+    Label r0 = order[i].x0;
+    Label r1 = order[i].x1;
+    bcf.x1 = rfmap[r0].get();
+    bcf.x2 = rfmap[r1].get();
+    bcf.x3 = rfmap[order[i].x2].get();
+    if (bcf.x1->shape->area > bcf.x2->shape->area) {
+      std::swap(r0, r1);
+      std::swap(bcf.x1, bcf.x2);
+    }
+    RegionMap::Region::Boundary b;
+    getBoundary(b, rmap.find(r0)->second, rmap.find(r1)->second);
+    bcf.x0.generate(b, f.normalizingLength, *bcf.x1, *bcf.x2, *bcf.x3, f.pb,
+                    f.boundaryThresholds, f.boundaryImages);
+  }
+  if (useLogShape) {
+    for (auto &rfp : rfmap) {
+      rfp.second->log();
+    }
+    for (auto &bcf : bfeats) {
+      bcf.x0.log();
+    }
+  }
+  Rows ret(order.size());
+  for (int i = 0; i < order.size(); ++i) {
+    selectFeatures(ret[i], bfeats[i]);
+  }
+  return ret;
+}
+
+// Rows of bc_feat: region features from cached statistics, rows written
+// in place from accumulated boundary statistics
+Rows cachedRows(Frame const &f, std::vector<TTriple<Label>> const &order,
+                bool useLogShape) {
+  ImagePairs labelImages;
+  LabelImage<2>::Pointer mask(nullptr);
+  RegionStore rstore;
+  RegionFeatsCache<Label> rfcache;
+  rstore.set(f.seg, mask);
+  rfcache.set(rstore, f.seg, mask, f.pb, f.boundaryThresholds, f.images,
+              labelImages, f.boundaryImages, 0);
+  std::unordered_map<Label, std::shared_ptr<RegionFeats>> rfmap;
+  auto genRegionFeats = [&](Label r) {
+    auto rf = std::make_shared<RegionFeats>();
+    rf->finalize(rfcache.get(r), f.normalizingArea, f.normalizingLength,
+                 f.boundaryThresholds, f.images, labelImages,
+                 f.boundaryImages, nullptr);
+    rfmap[r] = rf;
+  };
+  for (int i = 0; i < rstore.baseSize(); ++i) {
+    genRegionFeats(rstore.baseKey(i));
+  }
+  int dim = selectedFeatsDim(f.images, labelImages, f.boundaryImages);
+  std::vector<FVal> feats(order.size() * dim);
+  FVal *row = feats.data();
+  RegionFeats::Acc bacc;
+  for (auto const &m : order) {
+    rfcache.getBoundary(bacc, m.x0, m.x1);
+    rfcache.merge(m.x0, m.x1, m.x2);
+    genRegionFeats(m.x2);
+    RegionFeats const *rf0 = rfmap[m.x0].get();
+    RegionFeats const *rf1 = rfmap[m.x1].get();
+    if (rf0->shape->area > rf1->shape->area) {
+      std::swap(rf0, rf1);
+    }
+    row = selectFeatures(row, bacc, countImages(f.boundaryImages),
+                         f.normalizingLength, *rf0, *rf1, useLogShape);
+  }
+  test::check(row == feats.data() + feats.size(),
+              "rows do not fill selectedFeatsDim columns");
+  Rows ret;
+  for (int i = 0; i < order.size(); ++i) {
+    ret.emplace_back(feats.begin() + i * dim, feats.begin() + (i + 1) * dim);
+  }
+  return ret;
+}
+
+// Rows of the baseline bc_feat on a fixed frame with log shape, with
+// pb as boundary image
+struct GoldenRow {
+  TTriple<Label> merge;
+  std::vector<double> feats;
+};
+
+std::vector<GoldenRow> const GOLDEN{
+     {{2, 6, 7},
+      {-1.8325814637483102, -1.4271163556401458, -0.16425203348601805,
+       0.058891517828191638, -1.956011502714073, 0.32680527617534,
+       0.045829908689484, 0.375, 0.10423669467787106, 0.085865227200088601,
+       0.092105267103761435, 0.58333333333333337, 0.27740768003925886,
+       0.073691537151525655}},
+     {{3, 7, 8},
+      {-2.8134107167600364, -0.916290731874155, -0.85739921404596331,
+       0.52889514707392726, -1.5505463946059086, 0.37795752969880897,
+       0.11090956820795933, 0.78333333333333333, 0.54253736171313893,
+       0.63982103075703689, 0.0061403565729657994, 0.81666666666666654,
+       0.52762163209924362, 0.79820335741034021}},
+     {{4, 8, 9},
+      {-2.0402208285265546, -0.77652878949899629, -0.34657359027997275,
+       0.52889514707392726, -0.70324853421870515, 0.4565696676190083,
+       0.020386746414877921, 0.86622073578595327, 0.52832917261872647,
+       0.61824841097318828, 0.13421932040997175, 0.6488294314381271,
+       0.35626872063744075, 0.29761627727272422}},
+     {{1, 9, 10},
+      {-2.2072749131897207, -0.52763274208237199, -0.25126341047564776,
+       0.39536375444940464, -1.0397207708399181, 0.55009078569710257,
+       0.046160798252937563, 0.54853620955315874, 0.19547860628272942,
+       0.070217100258299414, 0.014840651561831841, 0.3543913713405239,
+       0.080157313727651766, 0.093904400651652509}},
+     {{5, 10, 11},
+      {-1.2039728043259361, -0.35667494393873245, 0.24121307462214631,
+       0.44188377008429752, -0.56971714159418241, 0.5638552880845964,
+       0.02994840454664971, 0.44761904761904758, 0.10706421149095589,
+       0.091696704623625891, 0.028320801896708381, 0.24761904761904754,
+       0.04461774047186929, 0.13139114850687417}}};
+
+int main() {
+  double const tol = sizeof(FVal) < sizeof(double) ? 1e-5 : 1e-9;
+  {
+    Frame f(9, 10, 10, 6);
+    auto order = mergeOrder(f);
+    bool sameOrder = order.size() == GOLDEN.size();
+    for (int i = 0; sameOrder && i < order.size(); ++i) {
+      auto const &m = GOLDEN[i].merge;
+      sameOrder = order[i].x0 == m.x0 && order[i].x1 == m.x1 &&
+                  order[i].x2 == m.x2;
+    }
+    test::check(sameOrder, "merge order differs from baseline");
+    if (sameOrder) {
+      auto rows0 = pixelRows(f, order, true);
+      auto rows1 = cachedRows(f, order, true);
+      for (int i = 0; i < order.size(); ++i) {
+        std::vector<double> r0(rows0[i].begin(), rows0[i].end());
+        std::vector<double> r1(rows1[i].begin(), rows1[i].end());
+        test::check(test::near(r0, GOLDEN[i].feats, tol),
+                    "pixel row differs from baseline");
+        test::check(test::near(r1, GOLDEN[i].feats, tol),
+                    "cached row differs from baseline");
+      }
+    }
+  }
+  // Random frames: both paths agree, with and without log shape
+  for (long seed = 100; seed < 200; ++seed) {
+    std::mt19937 rng(seed);
+    UInt width = 2 + rng() % 30, height = 2 + rng() % 30;
+    Frame f(seed, width, height, 2 + rng() % 40);
+    auto order = mergeOrder(f);
+    std::string name = "frame " + std::to_string(seed);
+    for (bool useLogShape : {false, true}) {
+      auto rows0 = pixelRows(f, order, useLogShape);
+      auto rows1 = cachedRows(f, order, useLogShape);
+      bool same = rows0.size() == rows1.size();
+      for (int i = 0; same && i < rows0.size(); ++i) {
+        same = test::near(rows0[i], rows1[i], tol);
+      }
+      test::check(same, "cached and pixel rows differ, " + name);
+    }
+  }
+  return test::result();
+}
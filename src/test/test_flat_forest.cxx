@@ -0,0 +1,134 @@
+#include "alg/rf_.hxx"
+#include "test/test_util.hxx"
+#include <functional>
+
+using namespace glia;
+
+// Random forest model of nTree trees of depth at most 5 over nFeature
+// features, nodes numbered depth-first as the old trainer does
+ml::rf::Model genModel(int nTree, int nFeature, int nClass,
+                       std::mt19937 &rng) {
+  int const nrnodes = 63;
+  ml::rf::Model m;
+  m.nrnodes = nrnodes;
+  m.ntree = nTree;
+  m.nclass = nClass;
+  m.treemap.setZero(2 * nrnodes, nTree);
+  m.nodestatus.setZero(nrnodes, nTree);
+  m.xbestsplit.setZero(nrnodes, nTree);
+  m.bestvar.setZero(nrnodes, nTree);
+  m.nodeclass.setZero(nrnodes, nTree);
+  for (int c = 0; c < nClass; ++c) {
+    m.orig_labels.push_back(c - 1);
+  }
+  for (int t = 0; t < nTree; ++t) {
+    int *treemap = m.treemap.data() + 2 * nrnodes * t;
+    int next = 1;
+    std::function<void(int, int)> build = [&](int k, int depth) {
+      if (depth >= 5 || rng() % 4 == 0 || next + 2 > nrnodes) {
+        m.nodestatus(k, t) = -1;
+        m.nodeclass(k, t) = 1 + rng() % nClass;
+        return;
+      }
+      m.nodestatus(k, t) = -3;
+      m.bestvar(k, t) = 1 + rng() % nFeature;
+      m.xbestsplit(k, t) = (int)(rng() % 200) / 100.0 - 1.0;
+      int l = next++, r = next++;
+      treemap[2 * k] = l + 1;
+      treemap[2 * k + 1] = r + 1;
+      build(l, depth + 1);
+      build(r, depth + 1);
+    };
+    build(0, 0);
+  }
+  return m;
+}
+
+// Per class votes of sample x, read off the model arrays by the rules of
+// rf_old's predictClassTree: 1-based children and classes, x <= split goes
+// left, double comparison
+// This is not classForest itself, which is 3rd party code outside the
+// tree, so it checks compileForest's layout and threshold rounding rather
+// than the old predictor's semantics
+std::vector<int> modelVotes(ml::rf::Model const &m, FVal const *x) {
+  std::vector<int> ret(m.nclass, 0);
+  for (int t = 0; t < m.ntree; ++t) {
+    int const *treemap = m.treemap.data() + 2 * m.nrnodes * t;
+    int k = 0;
+    while (m.nodestatus(k, t) != -1) {
+      double v = x[m.bestvar(k, t) - 1];
+      k = v <= m.xbestsplit(k, t) ? treemap[2 * k] - 1
+                                  : treemap[2 * k + 1] - 1;
+    }
+    ++ret[m.nodeclass(k, t) - 1];
+  }
+  return ret;
+}
+
+int main() {
+  std::mt19937 rng(7);
+  int const nTree = 37, nFeature = 12, nClass = 3, n = 1000;
+  auto m = genModel(nTree, nFeature, nClass, rng);
+  alg::FlatForest flat;
+  alg::compileForest(flat, m);
+  test::check(flat.trees() == nTree && flat.classes() == nClass,
+              "compiled forest has wrong trees or classes");
+  for (int c = 0; c < nClass; ++c) {
+    test::check(flat.label(c) == m.orig_labels[c], "wrong class label");
+  }
+  // Samples on split thresholds, next to them and in between, then NaN
+  std::vector<FVal> X(n * nFeature);
+  for (auto &x : X) {
+    int i = rng() % 400;
+    x = i % 2 == 0 ? (i / 2) / 100.0 - 1.0
+                   : (int)(rng() % 2001) / 1000.0 - 1.0;
+  }
+  X[5] = std::nan("");
+  std::vector<uint16> votes;
+  flat.vote(votes, X.data(), n, nFeature, 0);
+  std::vector<int> classes;
+  flat.predict(classes, X.data(), n, nFeature, 0);
+  int nBad = 0, nBadClass = 0;
+  for (int s = 0; s < n; ++s) {
+    auto v = modelVotes(m, &X[s * nFeature]);
+    for (int c = 0; c < nClass; ++c) {
+      if (v[c] != votes[s * nClass + c]) {
+        ++nBad;
+      }
+    }
+    if (classes[s] != std::max_element(v.begin(), v.end()) - v.begin()) {
+      ++nBadClass;
+    }
+  }
+  test::check(nBad == 0, "flat votes differ from tree traversal");
+  test::check(nBadClass == 0, "flat classes differ from majority votes");
+  // Thresholds not representable in FVal: FVal samples next to them go
+  // the way they do against the double threshold
+  double const thresholds[] = {0.1, -0.1, 1.0 / 3.0, 0.0};
+  for (double t : thresholds) {
+    alg::FlatForest f1;
+    f1.addTree(
+        0,
+        [t](int k, int &feature, double &threshold, int &left, int &right) {
+          if (k > 0) {
+            return false;
+          }
+          feature = 0;
+          threshold = t;
+          left = 1;
+          right = 2;
+          return true;
+        },
+        [](int k) { return k - 1; });
+    FVal x = t;
+    std::vector<FVal> xs{x, std::nextafter(x, (FVal)1),
+                         std::nextafter(x, (FVal)-1)};
+    std::vector<int> cs;
+    f1.predict(cs, xs.data(), xs.size(), 1, 0);
+    for (int i = 0; i < xs.size(); ++i) {
+      test::check(cs[i] == ((double)xs[i] <= t ? 0 : 1),
+                  "threshold " + std::to_string(t) + " rounded wrong");
+    }
+  }
+  return test::result();
+}
@@ -0,0 +1,63 @@
+#include "alg/rf.hxx"
+#include "test/test_util.hxx"
+
+using namespace glia;
+
+// n samples of dimension d, row-major, of 1000 levels in [-1, 1) so that
+// many fall on split thresholds; label 1 where x0 + x1 * x2 > 0
+void genSamples(std::vector<FVal> &X, std::vector<double> &labels, int n,
+                int d, std::mt19937 &rng) {
+  X.resize(n * d);
+  labels.resize(n);
+  for (int s = 0; s < n; ++s) {
+    FVal *x = &X[s * d];
+    for (int j = 0; j < d; ++j) {
+      x[j] = (int)(rng() % 1000) / 500.0 - 1.0;
+    }
+    labels[s] = x[0] + x[1] * x[2] > 0 ? 1 : 0;
+  }
+}
+
+FeaturesPtr toShogun(std::vector<FVal> const &X, int n, int d) {
+  SGMatrix<double> mat(d, n);
+  std::copy(X.begin(), X.end(), mat.matrix);
+  return std::make_shared<Features>(mat);
+}
+
+int main() {
+  std::mt19937 rng(3);
+  int const d = 6, n = 600;
+  std::vector<FVal> X;
+  std::vector<double> y;
+  genSamples(X, y, n, d, rng);
+  SGVector<double> labels(n);
+  std::copy(y.begin(), y.end(), labels.vector);
+  // Odd number of trees: no majority ties between the two classes
+  alg::MyRandomForest rf(1, 15, 1.0, 0, false);
+  rf.train_cat(0, toShogun(X, n, d),
+               std::make_shared<MulticlassLabels>(labels));
+  rf.compile();
+  test::check(!rf.flat_forest[0].empty(), "shogun forest not compiled");
+  test::check(rf.flat_forest[0].trees() == 15, "compiled forest lost trees");
+  test::check(rf.flat_forest[0].features() == d,
+              "compiled forest has wrong dimension");
+  // Training samples, then fresh ones
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass > 0) {
+      genSamples(X, y, n, d, rng);
+    }
+    auto flat = rf.predict_batch(X.data(), n, d, 0);
+    auto sg = rf.predict_batch(toShogun(X, n, d), 0);
+    test::check(flat.size() == n && sg.size() == n, "missing predictions");
+    int nBad = 0;
+    for (int s = 0; s < n; ++s) {
+      if (flat[s] != sg[s]) {
+        ++nBad;
+      }
+    }
+    test::check(nBad == 0, "flat predictions differ from shogun's (" +
+                               std::to_string(nBad) + " of " +
+                               std::to_string(n) + ")");
+  }
+  return test::result();
+}
@@ -0,0 +1,188 @@
+#include "alg/forest_file.hxx"
+#include "test/test_util.hxx"
+#include <cstdio>
+
+using namespace glia;
+using alg::FlatForest;
+
+// Random tree of depth at most 5 over nFeature features, thresholds
+// k / 100 - 1 (most not representable in float)
+struct Tree {
+  std::vector<int> feature, left, right, cls;
+  std::vector<double> threshold;
+
+  int add(int depth, int nFeature, int nClass, std::mt19937 &rng) {
+    int k = feature.size();
+    feature.push_back(-1);
+    threshold.push_back(0.0);
+    left.push_back(-1);
+    right.push_back(-1);
+    cls.push_back(rng() % nClass);
+    if (depth < 5 && rng() % 4 != 0) {
+      feature[k] = rng() % nFeature;
+      threshold[k] = (int)(rng() % 200) / 100.0 - 1.0;
+      int l = add(depth + 1, nFeature, nClass, rng);
+      int r = add(depth + 1, nFeature, nClass, rng);
+      left[k] = l;
+      right[k] = r;
+    }
+    return k;
+  }
+};
+
+// Forest of nTree random trees with labels -1, 0, ...
+// thresholds: receives the double threshold of each flat node (0 for
+// leaves), as addTree visits nodes in the order it lays them out
+FlatForest genForest(int nTree, int nFeature, int nClass,
+                     std::vector<double> &thresholds, std::mt19937 &rng) {
+  FlatForest ret;
+  for (int t = 0; t < nTree; ++t) {
+    Tree tree;
+    tree.add(0, nFeature, nClass, rng);
+    ret.addTree(
+        0,
+        [&](int k, int &feature, double &threshold, int &left, int &right) {
+          thresholds.push_back(tree.feature[k] < 0 ? 0.0
+                                                   : tree.threshold[k]);
+          if (tree.feature[k] < 0) {
+            return false;
+          }
+          feature = tree.feature[k];
+          threshold = tree.threshold[k];
+          left = tree.left[k];
+          right = tree.right[k];
+          return true;
+        },
+        [&](int k) { return tree.cls[k]; });
+  }
+  std::vector<int> labels;
+  for (int c = 0; c < nClass; ++c) {
+    labels.push_back(c - 1);
+  }
+  ret.setLabels(labels);
+  ret.setFeatures(nFeature);
+  return ret;
+}
+
+// Same counts and arrays; thresholds compared separately if expected
+// ones are given
+bool sameArrays(FlatForest::View const &a, FlatForest::View const &b,
+                std::vector<FVal> const *thresholds = nullptr) {
+  if (a.nTree != b.nTree || a.nNode != b.nNode || a.nClass != b.nClass ||
+      a.nFeature != b.nFeature || !a.labels != !b.labels) {
+    return false;
+  }
+  bool ret = std::equal(a.roots, a.roots + a.nTree, b.roots) &&
+             std::equal(a.feature, a.feature + a.nNode, b.feature) &&
+             std::equal(a.next, a.next + a.nNode, b.next) &&
+             (!a.labels || std::equal(a.labels, a.labels + a.nClass,
+                                      b.labels));
+  FVal const *t = thresholds ? thresholds->data() : a.threshold;
+  return ret && std::equal(b.threshold, b.threshold + b.nNode, t);
+}
+
+// Single forest file as writeForestFile would write it with TFVal
+// thresholds taken from doubles
+template <typename TFVal>
+void writeOtherFVal(std::string const &file, FlatForest const &forest,
+                    std::vector<double> const &thresholds) {
+  auto v = forest.arrays();
+  alg::ForestFileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, alg::FOREST_FILE_MAGIC, sizeof(h.magic));
+  h.version = alg::FOREST_FILE_VERSION;
+  h.byteOrder = alg::FOREST_FILE_BYTE_ORDER;
+  h.fvalSize = sizeof(TFVal);
+  h.nForest = 1;
+  h.nCat = 1;
+  alg::ForestFileEntry e;
+  std::memset(&e, 0, sizeof(e));
+  e.offset = alg::forestFileAlign(sizeof(h) + sizeof(e));
+  e.nTree = v.nTree;
+  e.nNode = v.nNode;
+  e.nClass = v.nClass;
+  e.nFeature = v.nFeature;
+  e.nLabel = v.nClass;
+  uint64 offsets[6];
+  alg::forestFileOffsets(offsets, e, sizeof(TFVal));
+  std::vector<char> data(offsets[5], 0);
+  std::vector<TFVal> t(thresholds.begin(), thresholds.end());
+  std::memcpy(&data[0], &h, sizeof(h));
+  std::memcpy(&data[sizeof(h)], &e, sizeof(e));
+  std::memcpy(&data[offsets[0]], v.roots, e.nTree * sizeof(int));
+  std::memcpy(&data[offsets[1]], v.feature, e.nNode * sizeof(int));
+  std::memcpy(&data[offsets[2]], t.data(), e.nNode * sizeof(TFVal));
+  std::memcpy(&data[offsets[3]], v.next, e.nNode * sizeof(int));
+  std::memcpy(&data[offsets[4]], v.labels, e.nLabel * sizeof(int));
+  std::ofstream fs(file, std::ios::binary);
+  fs.write(data.data(), data.size());
+}
+
+int main() {
+  std::string const file = "test_forest_file.bin";
+  std::mt19937 rng(5);
+  int const nFeature = 9, n = 500;
+  std::vector<double> t0, t1;
+  auto f0 = genForest(23, nFeature, 3, t0, rng);
+  auto f1 = genForest(8, nFeature, 2, t1, rng);
+  FlatForest empty;
+  std::vector<FVal> X(n * nFeature);
+  for (auto &x : X) {
+    x = (int)(rng() % 2001) / 1000.0 - 1.0;
+  }
+  std::vector<uint16> v0, v1;
+  f0.vote(v0, X.data(), n, nFeature, 0);
+  // Two stages of two categories, one forest empty
+  alg::writeForestFile(file, {&f0, &empty, &f1, &f0}, 2);
+  test::check(alg::isForestFile(file), "written file not a forest file");
+  {
+    std::vector<FlatForest> forests;
+    auto nCat = alg::readForestFile(forests, file);
+    test::check(nCat == 2, "wrong category count read");
+    test::check(forests.size() == 4, "wrong forest count read");
+    test::check(forests[0].viewing(), "read forest does not view file");
+    test::check(forests[1].empty(), "empty forest read nonempty");
+    test::check(sameArrays(f0.arrays(), forests[0].arrays()) &&
+                    sameArrays(f1.arrays(), forests[2].arrays()) &&
+                    sameArrays(f0.arrays(), forests[3].arrays()),
+                "read forest arrays differ from written");
+    for (int c = 0; c < 3; ++c) {
+      test::check(forests[3].label(c) == c - 1, "wrong label read");
+    }
+    // Copies keep the mapping alive
+    FlatForest copy = forests[3];
+    forests.clear();
+    copy.vote(v1, X.data(), n, nFeature, 0);
+    test::check(v1 == v0, "read forest votes differ from written");
+  }
+  // Thresholds written with the other FVal: double ones round down to
+  // float, float ones widen exactly
+  std::vector<FVal> expected;
+  if (sizeof(FVal) == sizeof(float)) {
+    writeOtherFVal<double>(file, f0, t0);
+    for (double t : t0) {
+      expected.push_back(FlatForest::roundDown(t));
+    }
+  } else {
+    writeOtherFVal<float>(file, f0, t0);
+    for (double t : t0) {
+      expected.push_back((float)t);
+    }
+  }
+  {
+    std::vector<FlatForest> forests;
+    auto nCat = alg::readForestFile(forests, file);
+    test::check(nCat == 1 && forests.size() == 1,
+                "wrong header read from other FVal file");
+    test::check(sameArrays(f0.arrays(), forests[0].arrays(), &expected),
+                "other FVal thresholds converted wrong");
+    if (sizeof(FVal) == sizeof(float)) {
+      forests[0].vote(v1, X.data(), n, nFeature, 0);
+      test::check(v1 == v0, "double thresholds read as float vote wrong");
+    }
+  }
+  std::ofstream(file) << "not a forest file";
+  test::check(!alg::isForestFile(file), "text file taken for forest file");
+  std::remove(file.c_str());
+  return test::result();
+}
@@ -0,0 +1,80 @@
+#include "test/test_util.hxx"
+#include "util/stats.hxx"
+#include <limits>
+
+using namespace glia;
+
+// Bin lookup of histc before HistBins: linear scan of accumulated bounds
+int scanBin(double val, int bin, std::pair<double, double> const &range) {
+  double interval = (range.second - range.first) / bin;
+  std::vector<double> bounds(bin);
+  bounds[0] = interval;
+  for (auto i = 1; i < bin; ++i) {
+    bounds[i] = bounds[i - 1] + interval;
+  }
+  if (val > range.first && val < range.second) {
+    for (auto i = 0; i < bin; ++i) {
+      if (val < bounds[i]) {
+        return i;
+      }
+    }
+    return -1;
+  }
+  return val <= range.first ? 0 : bin - 1;
+}
+
+int main() {
+  double const inf = std::numeric_limits<double>::infinity();
+  std::mt19937 rng(11);
+  std::vector<std::pair<double, double>> ranges{
+      {0.0, 1.0}, {0.0, 255.0}, {-1.0, 1.0}, {-3.5, 0.25}, {2.0, 7.0},
+      {0.0, 0.1}, {-100.0, -20.0}};
+  std::vector<int> bins{1, 2, 3, 7, 10, 16, 64, 255, 256};
+  for (auto const &range : ranges) {
+    for (int bin : bins) {
+      stats::HistBins hb(bin, range);
+      // Values around range ends and every bound, then random ones
+      std::vector<double> vals;
+      double interval = (range.second - range.first) / bin;
+      for (double x : {range.first, range.second, 0.0}) {
+        vals.push_back(x);
+        vals.push_back(std::nextafter(x, -inf));
+        vals.push_back(std::nextafter(x, inf));
+      }
+      double b = 0.0;
+      for (int i = 0; i < bin; ++i) {
+        b += interval;
+        vals.push_back(b);
+        vals.push_back(std::nextafter(b, -inf));
+        vals.push_back(std::nextafter(b, inf));
+      }
+      double w = range.second - range.first;
+      std::uniform_real_distribution<double> u(range.first - 0.1 * w,
+                                               range.second + 0.1 * w);
+      for (int i = 0; i < 2000; ++i) {
+        vals.push_back(u(rng));
+      }
+      int nBad = 0;
+      for (double v : vals) {
+        if (hb(v) != scanBin(v, bin, range)) {
+          ++nBad;
+        }
+      }
+      test::check(nBad == 0, "HistBins differs from linear scan (bin " +
+                                 std::to_string(bin) + ", range [" +
+                                 std::to_string(range.first) + ", " +
+                                 std::to_string(range.second) + "])");
+      // histc counts as the scan would
+      std::vector<glia::uint> hc, hcScan(bin, 0);
+      stats::histc(hc, vals, bin, range);
+      for (double v : vals) {
+        int i = scanBin(v, bin, range);
+        if (i >= 0) {
+          ++hcScan[i];
+        }
+      }
+      test::check(hc == hcScan, "histc differs from linear scan");
+    }
+  }
+  return test::result();
+}
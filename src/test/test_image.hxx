@@ -0,0 +1,68 @@
+#ifndef _glia_test_test_image_hxx_
+#define _glia_test_test_image_hxx_
+
+#include "glia_image.hxx"
+#include <random>
+
+namespace glia {
+namespace test {
+
+// Images are drawn from raw mt19937 output only (no std distributions),
+// so they are the same on every platform
+
+template <typename TImage>
+typename TImage::Pointer newImage(UInt width, UInt height) {
+  itk::Index<2> index;
+  index.Fill(0);
+  itk::Size<2> size;
+  size[0] = width;
+  size[1] = height;
+  auto ret = TImage::New();
+  ret->SetRegions(itk::ImageRegion<2>(index, size));
+  ret->Allocate();
+  return ret;
+}
+
+// Voronoi cells of nSeed random seeds, labeled from 1 (ties go to the
+// lower seed); cells are connected but some labels may be absent
+inline LabelImage<2>::Pointer genLabelImage(UInt width, UInt height,
+                                            int nSeed, std::mt19937 &rng) {
+  std::vector<std::pair<long, long>> seeds(nSeed);
+  for (auto &s : seeds) {
+    s.first = rng() % width;
+    s.second = rng() % height;
+  }
+  auto ret = newImage<LabelImage<2>>(width, height);
+  auto *buf = ret->GetBufferPointer();
+  for (long y = 0; y < height; ++y) {
+    for (long x = 0; x < width; ++x) {
+      long dmin = -1;
+      for (int i = 0; i < nSeed; ++i) {
+        long dx = x - seeds[i].first, dy = y - seeds[i].second;
+        long d = dx * dx + dy * dy;
+        if (dmin < 0 || d < dmin) {
+          dmin = d;
+          buf[y * width + x] = i + 1;
+        }
+      }
+    }
+  }
+  return ret;
+}
+
+// Values k / (nLevel - 1), k < nLevel, or in [0, 1) if nLevel is 0
+inline RealImage<2>::Pointer genRealImage(UInt width, UInt height, int nLevel,
+                                          std::mt19937 &rng) {
+  auto ret = newImage<RealImage<2>>(width, height);
+  auto *buf = ret->GetBufferPointer();
+  for (UInt i = 0; i < width * height; ++i) {
+    buf[i] = nLevel > 0 ? (Real)(rng() % nLevel) / (nLevel - 1)
+                        : (Real)(rng() / 4294967296.0);
+  }
+  return ret;
+}
+
+};
+};
+
+#endif
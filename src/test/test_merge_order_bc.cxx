@@ -0,0 +1,308 @@
+#include "hmt/region_feats_cache.hxx"
+#include "test/test_image.hxx"
+#include "test/test_util.hxx"
+#include "util/struct_merge_bc.hxx"
+
+using namespace glia;
+using namespace glia::hmt;
+
+typedef TRegionMap<Label, Point<2>> RegionMap;
+typedef TRegionStore<Label, 2> RegionStore;
+typedef std::vector<ImageHistPair<RealImage<2>::Pointer>> ImagePairs;
+
+// Frame drawn by genLabelImage and genRealImage: pb, then two region
+// images, continuous and of 20 levels
+struct Frame {
+  LabelImage<2>::Pointer seg;
+  RealImage<2>::Pointer pb;
+  ImagePairs images;
+  double normalizingArea, normalizingLength;
+
+  Frame(long seed, UInt width, UInt height, int nSeed) {
+    std::mt19937 rng(seed);
+    seg = test::genLabelImage(width, height, nSeed, rng);
+    pb = test::genRealImage(width, height, 0, rng);
+    images.emplace_back(test::genRealImage(width, height, 0, rng), 8,
+                        std::make_pair(0.0, 1.0));
+    images.emplace_back(test::genRealImage(width, height, 20, rng), 5,
+                        std::make_pair(0.0, 1.0));
+    normalizingArea = width * height;
+    normalizingLength = std::sqrt((double)width * width + height * height);
+  }
+};
+
+// Fixed linear boundary classifier
+double predict(std::vector<FVal> const &data) {
+  double ret = 0.0;
+  for (int i = 0; i < data.size(); ++i) {
+    ret += data[i] * std::sin(0.7 * i + 0.3);
+  }
+  return ret;
+}
+
+// Pixel path of merge_order_bc before region statistics were cached:
+// features of every boundary generated from region map points
+// lowerFirst: equal-area regions put the lower label in x1, as
+// merge_order_bc and bc_feat do; otherwise the higher one
+std::vector<test::Merge> mergePixels(Frame const &f, bool lowerFirst = true) {
+  std::vector<double> boundaryThresholds;
+  ImagePairs labelImages, boundaryImages;
+  auto fBcFeat = [&](std::vector<FVal> &data, RegionMap::Region const &reg0,
+                     RegionMap::Region const &reg1,
+                     RegionMap::Region const &reg2, Label r0, Label r1,
+                     Label r2) {
+    auto rf0 = std::make_shared<RegionFeats>();
+    auto rf1 = std::make_shared<RegionFeats>();
+    auto rf2 = std::make_shared<RegionFeats>();
+    rf0->generate(reg0, f.normalizingArea, f.normalizingLength, f.pb,
+                  boundaryThresholds, f.images, labelImages, boundaryImages,
+                  nullptr);
+    rf1->generate(reg1, f.normalizingArea, f.normalizingLength, f.pb,
+                  boundaryThresholds, f.images, labelImages, boundaryImages,
+                  nullptr);
+    rf2->generate(reg2, f.normalizingArea, f.normalizingLength, f.pb,
+                  boundaryThresholds, f.images, labelImages, boundaryImages,
+                  nullptr);
+    BoundaryClassificationFeats bcf;
+    bcf.x1 = rf0.get();
+    bcf.x2 = rf1.get();
+    bcf.x3 = rf2.get();
+    // Initial boundaries come in region map order here, so equal areas
+    // are oriented explicitly
+    if (bcf.x1->shape->area > bcf.x2->shape->area ||
+        (bcf.x1->shape->area == bcf.x2->shape->area &&
+         (lowerFirst ? r0 > r1 : r0 < r1))) {
+      std::swap(bcf.x1, bcf.x2);
+    }
+    RegionMap::Region::Boundary b;
+    getBoundary(b, reg0, reg1);
+    bcf.x0.generate(b, f.normalizingLength, *bcf.x1, *bcf.x2, *bcf.x3, f.pb,
+                    boundaryThresholds, labelImages);
+    bcf.x0.log();
+    rf0->log();
+    rf1->log();
+    rf2->log();
+    bcf.serialize(data);
+  };
+  std::vector<TTriple<Label>> order;
+  std::vector<double> saliencies;
+  LabelImage<2>::Pointer mask(nullptr);
+  genMergeOrderGreedyUsingBoundaryClassifier<std::vector<FVal>>(
+      order, saliencies, f.seg, mask, fBcFeat, predict,
+      f_true<TBoundaryTable<std::vector<FVal>, RegionMap> &,
+             TBoundaryTable<std::vector<FVal>, RegionMap>::iterator>);
+  return test::merges(order, saliencies);
+}
+
+// Path of merge_order_bc: features from cached region statistics,
+// initial boundaries scored in one batch
+std::vector<test::Merge> mergeCached(Frame const &f, BoundaryQueue qmode) {
+  std::vector<double> boundaryThresholds;
+  ImagePairs labelImages, boundaryImages;
+  LabelImage<2>::Pointer mask(nullptr);
+  RegionStore rstore;
+  RegionFeatsCache<Label> rfcache;
+  rstore.set(f.seg, mask);
+  rfcache.set(rstore, f.seg, mask, f.pb, boundaryThresholds, f.images,
+              labelImages, boundaryImages, 0);
+  auto fBcFeat = [&](std::vector<FVal> &data, Label r0, Label r1) {
+    auto rf0 = std::make_shared<RegionFeats>();
+    auto rf1 = std::make_shared<RegionFeats>();
+    auto rf2 = std::make_shared<RegionFeats>();
+    RegionFeats::Acc acc;
+    rf0->finalize(rfcache.get(r0), f.normalizingArea, f.normalizingLength,
+                  boundaryThresholds, f.images, labelImages, boundaryImages,
+                  nullptr);
+    rf1->finalize(rfcache.get(r1), f.normalizingArea, f.normalizingLength,
+                  boundaryThresholds, f.images, labelImages, boundaryImages,
+                  nullptr);
+    rfcache.getUnion(acc, r0, r1);
+    rf2->finalize(acc, f.normalizingArea, f.normalizingLength,
+                  boundaryThresholds, f.images, labelImages, boundaryImages,
+                  nullptr);
+    BoundaryClassificationFeats bcf;
+    bcf.x1 = rf0.get();
+    bcf.x2 = rf1.get();
+    bcf.x3 = rf2.get();
+    if (bcf.x1->shape->area > bcf.x2->shape->area) {
+      std::swap(r0, r1);
+      std::swap(bcf.x1, bcf.x2);
+    }
+    rfcache.getBoundary(acc, r0, r1);
+    bcf.x0.finalize(acc, f.normalizingLength, *bcf.x1, *bcf.x2, *bcf.x3,
+                    boundaryThresholds.size(), boundaryImages);
+    bcf.x0.log();
+    rf0->log();
+    rf1->log();
+    rf2->log();
+    bcf.serialize(data);
+  };
+  auto fBcPredBatch = [](std::vector<std::vector<FVal> const *> const &data,
+                         std::vector<double> &sals) {
+    sals.clear();
+    for (auto const *d : data) {
+      sals.push_back(predict(*d));
+    }
+  };
+  std::vector<TTriple<Label>> order;
+  std::vector<double> saliencies;
+  genMergeOrderGreedyUsingBatchedBoundaryClassifier<std::vector<FVal>>(
+      order, saliencies, rstore, fBcFeat, predict, fBcPredBatch,
+      f_true<TBoundaryTable<std::vector<FVal>, RegionStore> &,
+             TBoundaryTable<std::vector<FVal>, RegionStore>::iterator>,
+      [&rfcache](Label r0, Label r1, Label r2) { rfcache.merge(r0, r1, r2); },
+      qmode);
+  return test::merges(order, saliencies);
+}
+
+// Orders of the baseline merge_order_bc (features generated from region
+// map points, old boundary table) on fixed frames, with predict in place
+// of the forest
+// The baseline oriented initial boundaries between equal-area regions by
+// region map (hash) order; merge_order_bc now puts the lower label first,
+// as bc_feat always did on merge orders. tie frames have such a tie that
+// decides the order: frame 14 is the baseline's (its region map order put
+// the lower label first), frame 12 the baseline's with the lower label
+// first (its own order differs)
+struct Golden {
+  long seed;
+  UInt width, height;
+  int nSeed;
+  bool tie;
+  std::vector<test::Merge> order;
+};
+
+std::vector<Golden> const GOLDEN{
+    {5,
+     16,
+     16,
+     10,
+     false,
+     {{8, 10, 11, -7.9399424117121962},
+      {7, 11, 12, -9.8092232763575229},
+      {5, 12, 13, -12.928735587495572},
+      {3, 13, 14, -5.4965406716051053},
+      {4, 14, 15, -5.0995460682672089},
+      {1, 15, 16, -4.2853728198214069},
+      {6, 16, 17, -4.5397821476298503},
+      {9, 17, 18, -9.6284860859246901},
+      {2, 18, 19, -3.5204183960340925}}},
+    {6,
+     24,
+     20,
+     25,
+     false,
+     {{2, 21, 26, 8.7147724757934881},
+      {20, 26, 27, 0.22263908689734319},
+      {14, 24, 28, -0.0079577932749034797},
+      {10, 27, 29, -2.7291090742083592},
+      {12, 17, 30, -7.4278047180309619},
+      {15, 29, 31, -8.3368845591101763},
+      {28, 31, 32, -4.886664915140793},
+      {8, 13, 33, -9.9108143165752409},
+      {1, 33, 34, -10.387202007805605},
+      {19, 34, 35, -8.5382537315036355},
+      {11, 35, 36, -8.6276982016612287},
+      {9, 36, 37, -5.2685164443500669},
+      {18, 37, 38, -10.536409741549596},
+      {4, 7, 39, -11.147307198574214},
+      {23, 30, 40, -11.263988086665293},
+      {3, 40, 41, -9.7303506454094695},
+      {32, 41, 42, -12.806965337941495},
+      {25, 42, 43, -10.452445549396296},
+      {5, 43, 44, -10.537937673849809},
+      {16, 39, 45, -12.81420104318752},
+      {6, 45, 46, -11.954612604558829},
+      {22, 46, 47, -13.930271751246355},
+      {38, 44, 48, -15.478520447805117},
+      {47, 48, 49, -12.11839042869147}}},
+    {8,
+     28,
+     18,
+     20,
+     false,
+     {{11, 16, 21, -8.5064761257628252},
+      {18, 20, 22, -8.7836282562826451},
+      {5, 22, 23, -9.4831730411351831},
+      {8, 17, 24, -9.6873949448085792},
+      {21, 24, 25, -8.4344503238528823},
+      {6, 12, 26, -10.907070801219891},
+      {15, 26, 27, -8.2722887109112779},
+      {4, 27, 28, -6.1843795075203367},
+      {1, 28, 29, -10.305431861348241},
+      {7, 23, 30, -12.791372374085419},
+      {9, 30, 31, -12.037286839901258},
+      {10, 31, 32, -7.8226566720481605},
+      {3, 32, 33, -4.6459034468982932},
+      {13, 33, 34, -11.32808268327846},
+      {29, 34, 35, -5.6409672668631039},
+      {2, 35, 36, 1.1364909781586223},
+      {19, 36, 37, -1.2179409829813084},
+      {14, 37, 38, 5.3283778984206318},
+      {25, 38, 39, -0.12286117675703861}}},
+    {12,
+     16,
+     16,
+     12,
+     true,
+     {{4, 11, 13, -9.0752370515608209},
+      {7, 13, 14, -9.5794367994696916},
+      {3, 14, 15, -8.9568642213163692},
+      {6, 15, 16, -8.3319768059428174},
+      {10, 16, 17, -5.5891594476419595},
+      {12, 17, 18, -3.0777836182244855},
+      {1, 8, 19, -10.485363290323505},
+      {2, 18, 20, -11.166749633425505},
+      {9, 20, 21, -11.233247065580393},
+      {5, 21, 22, -8.0450865924965633},
+      {19, 22, 23, -11.293146463890777}}},
+    {14,
+     16,
+     16,
+     12,
+     true,
+     {{3, 8, 13, -9.3007669327408102},
+      {1, 13, 14, -4.4427493579151527},
+      {4, 14, 15, -7.9704455429862806},
+      {6, 15, 16, -10.750352227271918},
+      {5, 16, 17, -9.9823945649801527},
+      {9, 11, 18, -14.099078936860195},
+      {2, 18, 19, -9.5057570963666933},
+      {10, 19, 20, -12.666844628173058},
+      {17, 20, 21, -10.565186746922738},
+      {12, 21, 22, -9.5075372726189915},
+      {7, 22, 23, -9.0987654853304409}}},
+};
+
+int main() {
+  BoundaryQueue const qmodes[] = {BoundaryQueue::Indexed, BoundaryQueue::Lazy};
+  // Baseline saliencies are of double features
+  double const tol = sizeof(FVal) < sizeof(double) ? 1e-5 : 1e-9;
+  for (auto const &g : GOLDEN) {
+    Frame f(g.seed, g.width, g.height, g.nSeed);
+    std::string name = "frame " + std::to_string(g.seed);
+    test::check(test::sameOrder(mergePixels(f), g.order, tol),
+                "pixel merge order differs from baseline, " + name);
+    if (g.tie) {
+      test::check(!test::sameOrder(mergePixels(f, false), g.order, tol),
+                  "tie orientation does not decide the order, " + name);
+    }
+    for (auto qmode : qmodes) {
+      test::check(test::sameOrder(mergeCached(f, qmode), g.order, tol),
+                  "cached merge order differs from baseline, " + name);
+    }
+  }
+  // Random frames: both paths and queues agree
+  for (long seed = 100; seed < 160; ++seed) {
+    std::mt19937 rng(seed);
+    UInt width = 2 + rng() % 30, height = 2 + rng() % 30;
+    Frame f(seed, width, height, 2 + rng() % 40);
+    std::string name = "frame " + std::to_string(seed);
+    auto m0 = mergePixels(f);
+    for (auto qmode : qmodes) {
+      test::check(test::sameOrder(mergeCached(f, qmode), m0, 1e-9),
+                  "cached and pixel merge orders differ, " + name);
+    }
+  }
+  return test::result();
+}
@@ -0,0 +1,120 @@
+#include "pyglia.hxx"
+#include "test/test_image.hxx"
+#include "test/test_util.hxx"
+#include <set>
+
+using namespace glia;
+using namespace glia::hmt;
+
+typedef std::vector<ImageHistPair<RealImage<DIMENSION>::Pointer>> ImagePairs;
+
+std::vector<double> const BOUNDARY_THRESHOLDS{0.2, 0.5, 0.8};
+
+// Frame drawn by genLabelImage and genRealImage: pb, then two region
+// images, continuous and of 20 levels
+struct Frame {
+  LabelImage<DIMENSION>::Pointer seg;
+  RealImage<DIMENSION>::Pointer pb;
+  ImagePairs images;
+  int nRegion;
+
+  Frame(long seed, UInt width, UInt height, int nSeed) {
+    std::mt19937 rng(seed);
+    seg = test::genLabelImage(width, height, nSeed, rng);
+    pb = test::genRealImage(width, height, 0, rng);
+    images.emplace_back(test::genRealImage(width, height, 0, rng), 8,
+                        std::make_pair(0.0, 1.0));
+    images.emplace_back(test::genRealImage(width, height, 20, rng), 5,
+                        std::make_pair(0.0, 1.0));
+    auto const *buf = seg->GetBufferPointer();
+    nRegion = std::set<Label>(buf, buf + width * height).size();
+  }
+};
+
+// Rows bc_feat writes for a merge order, row-major
+std::vector<FVal> bcFeatRows(Frame const &f,
+                             std::vector<TTriple<Label>> const &order,
+                             std::vector<double> const &saliencies,
+                             bool useLog) {
+  std::vector<FVal> ret(order.size() * bc_feat_dim(f.images));
+  bc_feat_operation(ret.data(), order, saliencies, f.seg, f.images, f.pb,
+                    1.0, 1.0, BOUNDARY_THRESHOLDS, true, useLog);
+  return ret;
+}
+
+// Forest trained as train.py's first stage: bc_feat rows on pb merge
+// orders, categorized on columns 0/1; label 1 (no merge) where the first
+// image's mean differs by more than the median
+std::shared_ptr<alg::EnsembleRandomForest>
+trainForest(std::vector<Frame> const &frames, bool useLog, double &catThr) {
+  int d = bc_feat_dim(frames.front().images);
+  std::vector<FVal> X;
+  for (auto const &f : frames) {
+    std::vector<TTriple<Label>> order;
+    std::vector<double> saliencies;
+    std::tie(order, saliencies) = merge_order_pb_operation(f.seg, f.pb, 1);
+    auto rows = bcFeatRows(f, order, saliencies, useLog);
+    X.insert(X.end(), rows.begin(), rows.end());
+  }
+  int n = X.size() / d;
+  std::vector<double> diffs;
+  for (int i = 0; i < n; ++i) {
+    diffs.push_back(X[i * d + 5]);
+  }
+  double thr = median(diffs.data(), diffs.data() + n);
+  SGVector<double> labels(n);
+  for (int i = 0; i < n; ++i) {
+    labels[i] = diffs[i] > thr ? 1 : 0;
+  }
+  auto Xc = std::make_shared<CategorizedFeatures>(X.data(), n, d, 0, 1);
+  auto bc = std::make_shared<alg::EnsembleRandomForest>(3, 15, 1.0, 0, true);
+  bc->train(Xc, std::make_shared<MulticlassLabels>(labels));
+  catThr = Xc->get_threshold();
+  return bc;
+}
+
+int main() {
+  std::vector<Frame> frames;
+  for (long seed = 1; seed <= 6; ++seed) {
+    frames.emplace_back(seed, 40, 40, 60);
+  }
+  for (bool useLog : {true, false}) {
+    double catThr = 0.0;
+    auto bc = trainForest(frames, useLog, catThr);
+    int d = bc_feat_dim(frames.front().images);
+    for (auto const &forest : bc->models.back()->flat_forest) {
+      test::check(!forest.empty() && forest.features() == d,
+                  "forest not compiled on bc_feat rows");
+    }
+    // Training frames, then fresh ones
+    std::vector<Frame> tests(frames);
+    tests.emplace_back(100, 40, 40, 60);
+    tests.emplace_back(101, 30, 50, 45);
+    for (int t = 0; t < tests.size(); ++t) {
+      auto const &f = tests[t];
+      std::string name = "frame " + std::to_string(t) +
+                         (useLog ? ", log shape" : "");
+      std::vector<TTriple<Label>> order;
+      std::vector<double> saliencies, probs;
+      std::tie(order, saliencies) = merge_order_bc_operation(
+          f.seg, f.images, f.pb, useLog, bc, catThr, false, -1, &probs);
+      test::check(order.size() == f.nRegion - 1 &&
+                      probs.size() == order.size(),
+                  "merge_order_bc stopped early, " + name);
+      // Each merge was predicted on the row bc_feat writes for it
+      auto rows = bcFeatRows(f, order, saliencies, useLog);
+      int nBad = 0;
+      for (int i = 0; i < order.size(); ++i) {
+        FVal const *x = &rows[i * d];
+        int cat = categorize_values(x[0], x[1], catThr);
+        if (bc->predict_batch(x, 1, d, cat).front() != saliencies[i] ||
+            bc->predict_merge_prob(x, 1, d, cat).front() != probs[i]) {
+          ++nBad;
+        }
+      }
+      test::check(nBad == 0,
+                  "merges predicted on other rows than bc_feat's, " + name);
+    }
+  }
+  return test::result();
+}
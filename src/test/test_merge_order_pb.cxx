@@ -0,0 +1,172 @@
+#include "test/test_image.hxx"
+#include "test/test_util.hxx"
+#include "util/struct_merge_rag.hxx"
+
+using namespace glia;
+
+typedef TRegionMap<Label, Point<2>> RegionMap;
+typedef TRegionGraph<Label> RegionGraph;
+
+// Frame drawn by genLabelImage and genRealImage
+struct Frame {
+  long seed;
+  UInt width, height;
+  int nSeed, nLevel;
+};
+
+// Pixel path of merge_order_pb before the region graph: boundaries of a
+// region map, boundary pb gathered from the image
+std::vector<test::Merge> mergePixels(LabelImage<2>::Pointer const &seg,
+                                     RealImage<2>::Pointer const &pb,
+                                     bool useMedian, BoundaryQueue qmode) {
+  LabelImage<2>::Pointer mask(nullptr);
+  RegionMap rmap(seg, mask, true);
+  std::vector<TTriple<Label>> order;
+  std::vector<double> saliencies;
+  if (useMedian) {
+    genMergeOrderGreedyUsingPbApproxMedian(
+        order, saliencies, rmap, false, pb,
+        f_true<TBoundaryTable<QuantileSketch, RegionMap> &,
+               TBoundaryTable<QuantileSketch, RegionMap>::iterator>,
+        f_null<QuantileSketch &, Label, Label>, qmode);
+  } else {
+    genMergeOrderGreedyUsingPbMean(
+        order, saliencies, rmap, false, pb,
+        f_true<TBoundaryTable<std::pair<double, int>, RegionMap> &,
+               TBoundaryTable<std::pair<double, int>, RegionMap>::iterator>,
+        qmode);
+  }
+  return test::merges(order, saliencies);
+}
+
+// Region graph path of merge_order_pb
+std::vector<test::Merge> mergeGraph(LabelImage<2>::Pointer const &seg,
+                                    RealImage<2>::Pointer const &pb,
+                                    bool useMedian, BoundaryQueue qmode) {
+  LabelImage<2>::Pointer mask(nullptr);
+  RegionGraph rag(seg, pb, mask, useMedian ? PB_SKETCH_BIN : 0);
+  std::vector<TTriple<Label>> order;
+  std::vector<double> saliencies;
+  genMergeOrderGreedyUsingPbStats(
+      order, saliencies, rag, useMedian,
+      f_true<TBoundaryTable<RegionGraph::Edge, RegionGraph> &,
+             TBoundaryTable<RegionGraph::Edge, RegionGraph>::iterator>,
+      qmode);
+  return test::merges(order, saliencies);
+}
+
+// Orders of the baseline merge_order_pb (exact boundary medians, region
+// map boundary table) on fixed frames
+// Median frames have nLevel pb levels, each in its own sketch bin, so
+// approximate medians rank boundaries as exact ones do
+struct Golden {
+  Frame frame;
+  bool useMedian;
+  std::vector<test::Merge> order;
+};
+
+std::vector<Golden> const GOLDEN{
+    {{1, 16, 16, 12, 0},
+     false,
+     {{4, 11, 12, -0.27997549281766015},
+      {2, 8, 13, -0.31203678171150384},
+      {3, 7, 14, -0.40882652997970581},
+      {1, 13, 15, -0.41482426435686648},
+      {9, 12, 16, -0.4375756412744522},
+      {14, 16, 17, -0.4406953773328236},
+      {5, 17, 18, -0.47549478585521382},
+      {6, 10, 19, -0.52974544702605764},
+      {15, 19, 20, -0.56222308874130245},
+      {18, 20, 21, -0.61809593948478603}}},
+    {{2, 20, 14, 15, 0},
+     false,
+     {{7, 10, 16, -0.23973491725822291},
+      {4, 16, 17, -0.33287382405251265},
+      {6, 12, 18, -0.3546608779579401},
+      {1, 8, 19, -0.38799183401796555},
+      {14, 17, 20, -0.44906425068620592},
+      {2, 11, 21, -0.45197529345750809},
+      {3, 15, 22, -0.46012154097358388},
+      {20, 21, 23, -0.46036260016262531},
+      {22, 23, 24, -0.47653941810131073},
+      {18, 24, 25, -0.48791309197743732},
+      {13, 19, 26, -0.51071560382843018},
+      {5, 25, 27, -0.52114670318909562},
+      {9, 27, 28, -0.56098376264174776},
+      {26, 28, 29, -0.59498001163711356}}},
+    {{3, 16, 16, 12, 50},
+     true,
+     {{8, 9, 13, -0.24489796161651611},
+      {3, 12, 14, -0.28571429848670959},
+      {2, 5, 15, -0.46938776969909668},
+      {4, 14, 16, -0.48979592323303223},
+      {6, 11, 17, -0.55102038383483887},
+      {1, 13, 18, -0.57142859697341919},
+      {15, 18, 19, -0.61224490404129028},
+      {7, 16, 20, -0.63265305757522583},
+      {10, 20, 21, -0.63265305757522583},
+      {19, 21, 22, -0.69387757778167725},
+      {17, 22, 23, -0.83673471212387085}}},
+    {{4, 20, 14, 15, 50},
+     true,
+     {{1, 9, 16, -0.26530611515045166},
+      {4, 11, 17, -0.32653060555458069},
+      {5, 13, 18, -0.36734694242477417},
+      {10, 18, 19, -0.38775509595870972},
+      {12, 17, 20, -0.38775509595870972},
+      {16, 19, 21, -0.40816327929496765},
+      {3, 21, 22, -0.4285714328289032},
+      {7, 14, 23, -0.4285714328289032},
+      {22, 23, 24, -0.53061223030090332},
+      {8, 24, 25, -0.55102038383483887},
+      {20, 25, 26, -0.59183675050735474},
+      {6, 26, 27, -0.65306121110916138},
+      {15, 27, 28, -0.65306121110916138},
+      {2, 28, 29, -0.71428573131561279}}},
+};
+
+int main() {
+  BoundaryQueue const qmodes[] = {BoundaryQueue::Indexed, BoundaryQueue::Lazy};
+  for (auto const &g : GOLDEN) {
+    auto const &f = g.frame;
+    std::mt19937 rng(f.seed);
+    auto seg = test::genLabelImage(f.width, f.height, f.nSeed, rng);
+    auto pb = test::genRealImage(f.width, f.height, f.nLevel, rng);
+    // Approximate medians are off by at most half a sketch bin
+    auto const *buf = pb->GetBufferPointer();
+    auto mm = std::minmax_element(buf, buf + f.width * f.height);
+    double tol =
+        g.useMedian ? (*mm.second - *mm.first) / (2.0 * PB_SKETCH_BIN) : 1e-9;
+    std::string name = "frame " + std::to_string(f.seed);
+    for (auto qmode : qmodes) {
+      auto m0 = mergePixels(seg, pb, g.useMedian, qmode);
+      test::check(test::sameOrder(m0, g.order, tol),
+                  "pixel merge order differs from baseline, " + name);
+      auto m1 = mergeGraph(seg, pb, g.useMedian, qmode);
+      test::check(test::sameOrder(m1, g.order, tol),
+                  "region graph merge order differs from baseline, " + name);
+    }
+  }
+  // Random frames: both paths and queues agree
+  int const nLevels[] = {0, 2, 8, 50};
+  for (long seed = 100; seed < 300; ++seed) {
+    std::mt19937 rng(seed);
+    Frame f{seed, 1 + rng() % 40, 1 + rng() % 40, 2 + (int)(rng() % 60),
+            nLevels[rng() % 4]};
+    auto seg = test::genLabelImage(f.width, f.height, f.nSeed, rng);
+    auto pb = test::genRealImage(f.width, f.height, f.nLevel, rng);
+    std::string name = "frame " + std::to_string(seed);
+    for (bool useMedian : {false, true}) {
+      auto m0 = mergePixels(seg, pb, useMedian, BoundaryQueue::Indexed);
+      auto m1 = mergePixels(seg, pb, useMedian, BoundaryQueue::Lazy);
+      test::check(test::sameOrder(m1, m0, 1e-9),
+                  "lazy queue changes pixel merge order, " + name);
+      for (auto qmode : qmodes) {
+        auto m2 = mergeGraph(seg, pb, useMedian, qmode);
+        test::check(test::sameOrder(m2, m0, 1e-9),
+                    "region graph and pixel merge orders differ, " + name);
+      }
+    }
+  }
+  return test::result();
+}
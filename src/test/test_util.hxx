@@ -0,0 +1,85 @@
+#ifndef _glia_test_test_util_hxx_
+#define _glia_test_test_util_hxx_
+
+#include "type/tuple.hxx"
+#include <random>
+
+namespace glia {
+namespace test {
+
+// Number of failed checks
+inline int &nFailure() {
+  static int n = 0;
+  return n;
+}
+
+inline void check(bool cond, std::string const &msg) {
+  if (!cond) {
+    std::cerr << "Failed: " << msg << std::endl;
+    ++nFailure();
+  }
+}
+
+inline bool near(double x, double y, double tol = 1e-9) {
+  return std::fabs(x - y) <= tol * std::max(1.0, std::max(std::fabs(x),
+                                                          std::fabs(y)));
+}
+
+// Same length, elements within tol
+template <typename T>
+bool near(std::vector<T> const &x, std::vector<T> const &y,
+          double tol = 1e-9) {
+  if (x.size() != y.size()) {
+    return false;
+  }
+  for (int i = 0; i < x.size(); ++i) {
+    if (!near(x[i], y[i], tol)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct Merge {
+  Label r0, r1, r2;
+  double saliency;
+};
+
+inline std::vector<Merge> merges(std::vector<TTriple<Label>> const &order,
+                                 std::vector<double> const &saliencies) {
+  std::vector<Merge> ret;
+  for (int i = 0; i < order.size(); ++i) {
+    ret.push_back({order[i].x0, order[i].x1, order[i].x2, saliencies[i]});
+  }
+  return ret;
+}
+
+// Same merges, saliencies within tol
+inline bool sameOrder(std::vector<Merge> const &m0,
+                      std::vector<Merge> const &m1, double tol) {
+  if (m0.size() != m1.size()) {
+    return false;
+  }
+  for (int i = 0; i < m0.size(); ++i) {
+    if (m0[i].r0 != m1[i].r0 || m0[i].r1 != m1[i].r1 ||
+        m0[i].r2 != m1[i].r2 ||
+        std::fabs(m0[i].saliency - m1[i].saliency) > tol) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Exit code of a test main
+inline int result() {
+  if (nFailure() > 0) {
+    std::cerr << nFailure() << " check(s) failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+};
+};
+
+#endif
@@ -2,9 +2,23 @@
 #define _glia_type_boundary_table_hxx_
 
 #include "type/region_map.hxx"
+#include "type/weighted_sampler.hxx"
 
 namespace glia {
 
+// Indexed: addressable binary heap, items removed eagerly
+// Lazy: flat heap of (saliency, edge id, version) records,
+//       stale records dropped when they reach the top
+enum class BoundaryQueue : int {
+  Indexed = 0,
+  Lazy = 1,
+};
+
+
+// Boundary table keeps a per-region adjacency index and a max-heap over
+// boundary saliencies, so that a merge only touches boundaries incident
+// to the merged regions
+// Ties in saliency are broken by insertion order (latest first)
 template <typename T, typename TRegionMap>
 class TBoundaryTable : public Object {
  public:
@@ -14,71 +28,133 @@ class TBoundaryTable : public Object {
   typedef std::shared_ptr<const Self> ConstPointer;
   typedef std::weak_ptr<Self> WeakPointer;
   typedef typename TRegionMap::Key Key;
+  typedef std::pair<Key, Key> KeyPair;
 
   struct Item;
 
-  typedef std::map<std::pair<Key, Key>, std::shared_ptr<Item>> Table;
+  typedef std::map<KeyPair, std::shared_ptr<Item>> Table;
   typedef typename Table::iterator iterator;
   typedef typename Table::const_iterator const_iterator;
   typedef typename Table::value_type value_type;
 
   struct Item {
     typedef T Data;
-    typename std::multimap<double, iterator>::iterator mqit;
+    double sal = 0.0;
+    uint64 seq = 0;   // Insertion stamp for tie breaking; also edge id
+    int hpos = -1;    // Position in heap, -1 if not queued
     T data;
   };
 
  protected:
+  struct Record {
+    double sal;
+    uint64 id;
+    uint32 version;
+  };
+
   Table m_table;
-  std::multimap<double, iterator> m_mqueue;
-  std::vector<double> m_weights;
-  std::vector<iterator> m_items;
+  BoundaryQueue m_qmode = BoundaryQueue::Indexed;
+  std::vector<iterator> m_heap;
+  std::vector<Record> m_records;
+  std::vector<iterator> m_edges;    // Edge id -> table item
+  std::vector<uint32> m_versions;   // Edge id -> version (lazy mode)
+  uint m_nLive = 0;
+  std::unordered_map<Key, std::vector<Key>> m_adj;
+  uint64 m_seq = 0;
+  // Edge id -> sampling weight, zero if not queued
+  WeightedSampler m_sampler;
+  std::function<double(double)> m_fweight;
 
  public:
   TBoundaryTable () {}
 
+  explicit TBoundaryTable (BoundaryQueue qmode) : m_qmode(qmode) {}
+
+  template <typename BFunc, typename SFunc>
+  TBoundaryTable (TRegionMap const& rmap, BFunc fb, SFunc fsal,
+                  BoundaryQueue qmode = BoundaryQueue::Indexed)
+      : m_qmode(qmode) { init(rmap, fb, fsal); }
+
+  // keys: boundaries as (r0, r1) with r0 < r1
   template <typename BFunc, typename SFunc>
-  TBoundaryTable (TRegionMap const& rmap, BFunc fb, SFunc fsal)
-  { init(rmap, fb, fsal); }
+  TBoundaryTable (std::vector<KeyPair> const& keys, BFunc fb, SFunc fsal,
+                  BoundaryQueue qmode = BoundaryQueue::Indexed)
+      : m_qmode(qmode) { init(keys, fb, fsal); }
 
   ~TBoundaryTable () override {}
 
   // Return iterator to first table item with fcond(.) returning true
   template <typename CFunc> iterator
   top (CFunc fcond) {
-    for (auto it = m_mqueue.rbegin(); it != m_mqueue.rend(); ++it)
-    { if (fcond(*this, it->second)) { return it->second; } }
-    return m_table.end();
+    if (qEmpty()) { return m_table.end(); }
+    if (fcond(*this, qFront())) { return qFront(); }
+    // Pop rejected items in saliency order and restore them afterwards
+    auto ret = m_table.end();
+    std::vector<iterator> skipped;
+    while (!qEmpty()) {
+      auto it = qFront();
+      if (fcond(*this, it)) {
+        ret = it;
+        break;
+      }
+      qErase(it);
+      skipped.push_back(it);
+    }
+    for (auto it: skipped) { qPush(it); }
+    return ret;
   }
 
-  // fsamp(std::vector<double>, const long seed): sampling function
+  // Sample a queued item with fcond(.) returning true, with probability
+  // proportional to its sampling weight; requires initSampler
+  // frand(): uniform random number in [0, 1)
   // fcond(*this, iterator): conditional pass function
-  template <typename CFunc, typename SFunc> iterator
-  top (CFunc fcond, SFunc fsamp, const long seed) {
-    m_weights.clear();
-    m_items.clear();
-    m_weights.reserve(m_mqueue.size());
-    m_items.reserve(m_mqueue.size());
-    for (auto it = m_mqueue.rbegin(); it != m_mqueue.rend(); ++it) {
-      m_weights.push_back(it->first);
-      m_items.push_back(it->second);
+  template <typename CFunc, typename RFunc> iterator
+  top (CFunc fcond, RFunc frand) {
+    if (!m_fweight) { perr("Error: boundary sampler not initialized..."); }
+    auto ret = m_table.end();
+    // Exclude rejected items and restore them afterwards
+    std::vector<uint64> skipped;
+    for (int i = m_sampler.sample(frand()); i >= 0;
+         i = m_sampler.sample(frand())) {
+      if (fcond(*this, m_edges[i])) {
+        ret = m_edges[i];
+        break;
+      }
+      skipped.push_back(i);
+      m_sampler.set(i, 0.0);
     }
-    while (!m_weights.empty()) {
-      int i = fsamp(m_weights, seed);
-      if (fcond(*this, m_items[i])) { return m_items[i]; }
-      remove(m_weights, i);
-      remove(m_items, i);
+    for (auto i: skipped)
+    { m_sampler.set(i, m_fweight(m_edges[i]->second->sal)); }
+    return ret;
+  }
+
+  // Keep sampling weights of queued items from now on
+  // fweight: non-negative sampling weight of an item given its saliency
+  // double fweight (double sal);
+  template <typename WFunc> void
+  initSampler (WFunc fweight) {
+    m_fweight = fweight;
+    std::vector<double> weights(m_edges.size(), 0.0);
+    if (m_qmode == BoundaryQueue::Lazy) {
+      for (auto const& rec: m_records)
+      { if (isLive(rec)) { weights[rec.id] = m_fweight(rec.sal); } }
+    }
+    else {
+      for (auto const& it: m_heap)
+      { weights[it->second->seq] = m_fweight(it->second->sal); }
     }
-    return m_table.end();
+    m_sampler.assign(weights);
   }
 
   virtual Table const& table () const { return m_table; }
 
-  virtual std::multimap<double, iterator> const& mqueue () const
-  { return m_mqueue; }
+  // Saliency of queued item
+  virtual double saliency (const_iterator btit) const
+  { return btit->second->sal; }
 
-  virtual std::multimap<double, iterator>& mqueue ()
-  { return m_mqueue; }
+  // Keys of regions currently sharing a boundary with r
+  virtual std::vector<Key> const* neighbors (Key r) const
+  { return ccpointer(m_adj, r); }
 
   virtual uint size () const { return m_table.size(); }
 
@@ -90,6 +166,132 @@ class TBoundaryTable : public Object {
   // double fsal (T const&, Key r0, Key r1);
   template <typename BFunc, typename SFunc> void
   init (TRegionMap const& rmap, BFunc fb, SFunc fsal) {
+    initTable(rmap, fb);
+    initQueue(fsal);
+  }
+
+  // Same as init, but initial saliencies are computed in one call
+  // fb: boundary table item data initializer
+  // void fb (T&, Key r0, Key r1);
+  // fsals: batch saliency function, data in table order
+  // void fsals (std::vector<T const*> const& data, std::vector<double>& sals);
+  template <typename BFunc, typename SFunc> void
+  initBatch (TRegionMap const& rmap, BFunc fb, SFunc fsals) {
+    initTable(rmap, fb);
+    initQueueBatch(fsals);
+  }
+
+  // Same as initBatch, from boundary keys (r0, r1) with r0 < r1
+  template <typename BFunc, typename SFunc> void
+  initBatch (std::vector<KeyPair> const& keys, BFunc fb, SFunc fsals) {
+    initTable(keys, fb);
+    initQueueBatch(fsals);
+  }
+
+  // Initialize from boundary keys (r0, r1) with r0 < r1
+  // fb: boundary table item data initializer
+  // void fb (T&, Key r0, Key r1);
+  // fsal: saliency function
+  // double fsal (T const&, Key r0, Key r1);
+  template <typename BFunc, typename SFunc> void
+  init (std::vector<KeyPair> const& keys, BFunc fb, SFunc fsal) {
+    initTable(keys, fb);
+    initQueue(fsal);
+  }
+
+  // fb: boundary table item data updater
+  // void fb (T& data2s, Key r0, Key rs, Key r1, Key r2,
+  //          T* pData0s, T* pData1s);
+  // fsal: saliency function
+  // double fsal (T const& data2s, Key rs, Key r2);
+  template <typename BFunc, typename SFunc> void
+  update (iterator btit01, Key r2, BFunc fb, SFunc fsal) {
+    auto r0 = btit01->first.first;
+    auto r1 = btit01->first.second;
+    qErase(btit01);
+    m_table.erase(btit01);
+    // Visit neighbors rs in the order their first boundary with r0/r1
+    // appears in the table, which fixes fb call and tie-break order
+    std::vector<std::pair<KeyPair, Key>> visits;
+    for (Key r: {r0, r1}) {
+      auto ait = m_adj.find(r);
+      if (ait == m_adj.end()) { continue; }
+      for (Key rs: ait->second) {
+        if (rs != r0 && rs != r1) { visits.emplace_back(ordered(r, rs), rs); }
+      }
+    }
+    std::sort(visits.begin(), visits.end());
+    std::unordered_set<Key> visited;
+    auto& adj2 = m_adj[r2];
+    for (auto const& vp: visits) {
+      Key rs = vp.second;
+      if (!visited.insert(rs).second) { continue; }
+      auto btit0s = m_table.find(ordered(r0, rs));
+      auto btit1s = m_table.find(ordered(r1, rs));
+      auto btit2s = m_table.emplace
+          (std::make_pair(rs, r2), std::shared_ptr<Item>(new Item)).first;
+      fb(btit2s->second->data, r0, r1, rs, r2,
+         btit0s == m_table.end()? nullptr: &btit0s->second->data,
+         btit1s == m_table.end()? nullptr: &btit1s->second->data);
+      btit2s->second->sal = fsal(btit2s->second->data, rs, r2);
+      btit2s->second->seq = m_seq++;
+      m_edges.push_back(btit2s);
+      if (m_qmode == BoundaryQueue::Lazy) { m_versions.push_back(0); }
+      qPush(btit2s);
+      if (btit0s != m_table.end()) {
+        qErase(btit0s);
+        m_table.erase(btit0s);
+      }
+      if (btit1s != m_table.end()) {
+        qErase(btit1s);
+        m_table.erase(btit1s);
+      }
+      auto& adjs = m_adj[rs];
+      adjs.erase(std::remove_if(adjs.begin(), adjs.end(), [r0, r1](Key r)
+                                { return r == r0 || r == r1; }),
+                 adjs.end());
+      adjs.push_back(r2);
+      adj2.push_back(rs);
+    }
+    m_adj.erase(r0);
+    m_adj.erase(r1);
+    // Renumber once erased edges outnumber live ones
+    if (m_edges.size() > 2 * m_table.size() + 64) { compact(); }
+  }
+
+ protected:
+  // Drop erased edges from the edge index and renumber live edges in
+  // insertion order, which keeps tie breaking; all live edges must be
+  // queued (true between calls to top and update)
+  void compact () {
+    std::vector<iterator> live;
+    live.reserve(m_table.size());
+    for (auto btit = m_table.begin(); btit != m_table.end(); ++btit)
+    { live.push_back(btit); }
+    std::sort(live.begin(), live.end(), [](iterator a, iterator b)
+              { return a->second->seq < b->second->seq; });
+    for (uint i = 0; i < live.size(); ++i) { live[i]->second->seq = i; }
+    m_seq = live.size();
+    m_edges.swap(live);
+    std::vector<iterator>().swap(live);
+    if (m_qmode == BoundaryQueue::Lazy) {
+      m_versions.assign(m_edges.size(), 0);
+      m_records.clear();
+      for (auto it: m_edges)
+      { m_records.push_back(Record{it->second->sal, it->second->seq, 0}); }
+      std::make_heap(m_records.begin(), m_records.end(), recordLess);
+      m_nLive = m_records.size();
+    }
+    if (m_fweight) {
+      std::vector<double> weights;
+      weights.reserve(m_edges.size());
+      for (auto it: m_edges) { weights.push_back(m_fweight(it->second->sal)); }
+      m_sampler.assign(weights);
+    }
+  }
+
+  template <typename BFunc> void
+  initTable (TRegionMap const& rmap, BFunc fb) {
     for (auto const& rp: rmap) {
       for (auto const& bp: rp.second.boundary) {
         auto r0 = bp.first.first;
@@ -106,64 +308,176 @@ class TBoundaryTable : public Object {
         }
       }
     }
-    for (auto btit = m_table.begin(); btit != m_table.end(); ++btit) {
-      btit->second->mqit = m_mqueue.insert
-          (std::make_pair(fsal(btit->second->data, btit->first.first,
-                               btit->first.second), btit));
+  }
+
+  template <typename BFunc> void
+  initTable (std::vector<KeyPair> const& keys, BFunc fb) {
+    for (auto const& key: keys) {
+      auto btit = m_table.emplace_hint
+          (m_table.end(), key, std::shared_ptr<Item>(new Item));
+      fb(btit->second->data, key.first, key.second);
     }
   }
 
-  // fb: boundary table item data updater
-  // void fb (T& data2s, Key r0, Key rs, Key r1, Key r2,
-  //          T* pData0s, T* pData1s);
-  // fsal: saliency function
-  // double fsal (T const& data2s, Key rs, Key r2);
-  template <typename BFunc, typename SFunc> void
-  update (iterator btit01, Key r2, BFunc fb, SFunc fsal) {
-    auto r0 = btit01->first.first;
-    auto r1 = btit01->first.second;
-    m_mqueue.erase(btit01->second->mqit);
-    m_table.erase(btit01);
-    auto btit = m_table.begin();
-    while (btit != m_table.end() && btit->first.first <= r1) {
-      Key rs;
-      if (btit->first.first == r0 || btit->first.first == r1)
-      { rs = btit->first.second; }
-      else if (btit->first.second == r0 || btit->first.second == r1)
-      { rs = btit->first.first; }
-      else {
-        ++btit;
-        continue;
-      }
-      iterator btit0s, btit1s;
-      if (btit->first.first == r0 || btit->first.second == r0) {
-        btit0s = btit;
-        btit1s = m_table.find
-            (r1 < rs? std::make_pair(r1, rs): std::make_pair(rs, r1));
+  template <typename SFunc> void
+  initQueueBatch (SFunc fsals) {
+    std::vector<T const*> data;
+    data.reserve(m_table.size());
+    for (auto const& bp: m_table) { data.push_back(&bp.second->data); }
+    std::vector<double> sals;
+    fsals(data, sals);
+    if (sals.size() != data.size())
+    { perr("Error: batch saliency size mismatch..."); }
+    auto sit = sals.cbegin();
+    initQueue([&sit](T const&, Key, Key) -> double { return *sit++; });
+  }
+
+  template <typename SFunc> void
+  initQueue (SFunc fsal) {
+    m_edges.reserve(m_table.size() * 2);
+    if (m_qmode == BoundaryQueue::Lazy) {
+      m_records.reserve(m_table.size());
+      m_versions.reserve(m_table.size() * 2);
+    }
+    else { m_heap.reserve(m_table.size()); }
+    for (auto btit = m_table.begin(); btit != m_table.end(); ++btit) {
+      btit->second->sal = fsal(btit->second->data, btit->first.first,
+                               btit->first.second);
+      btit->second->seq = m_seq++;
+      m_edges.push_back(btit);
+      if (m_qmode == BoundaryQueue::Lazy) {
+        m_versions.push_back(0);
+        m_records.push_back(Record{btit->second->sal, btit->second->seq, 0});
+        ++m_nLive;
       }
       else {
-        btit0s = m_table.find
-            (r0 < rs? std::make_pair(r0, rs): std::make_pair(rs, r0));
-        btit1s = btit;
+        btit->second->hpos = m_heap.size();
+        m_heap.push_back(btit);
       }
-      auto btit2s = m_table.emplace
-          (std::make_pair(rs, r2), std::shared_ptr<Item>(new Item)).first;
-      fb(btit2s->second->data, r0, r1, rs, r2,
-         btit0s == m_table.end()? nullptr: &btit0s->second->data,
-         btit1s == m_table.end()? nullptr: &btit1s->second->data);
-      double sal = fsal(btit2s->second->data, rs, r2);
-      btit2s->second->mqit =
-          m_mqueue.insert(std::make_pair(sal, btit2s));
-      if (btit0s != m_table.end()) {
-        m_mqueue.erase(btit0s->second->mqit);
-        if (btit0s != btit) { m_table.erase(btit0s); }
-      }
-      if (btit1s != m_table.end()) {
-        m_mqueue.erase(btit1s->second->mqit);
-        if (btit1s != btit) { m_table.erase(btit1s); }
+      m_adj[btit->first.first].push_back(btit->first.second);
+      m_adj[btit->first.second].push_back(btit->first.first);
+    }
+    if (m_qmode == BoundaryQueue::Lazy)
+    { std::make_heap(m_records.begin(), m_records.end(), recordLess); }
+    else
+    { for (int i = (int)m_heap.size() / 2 - 1; i >= 0; --i) { siftDown(i); } }
+  }
+
+  static KeyPair ordered (Key r0, Key r1)
+  { return r0 < r1? std::make_pair(r0, r1): std::make_pair(r1, r0); }
+
+  static bool recordLess (Record const& lhs, Record const& rhs)
+  { return lhs.sal < rhs.sal || (lhs.sal == rhs.sal && lhs.id < rhs.id); }
+
+  bool isLive (Record const& rec) const
+  { return m_versions[rec.id] == rec.version; }
+
+  // Drop stale records from the top of the lazy heap
+  void prune () {
+    while (!m_records.empty() && !isLive(m_records.front())) {
+      std::pop_heap(m_records.begin(), m_records.end(), recordLess);
+      m_records.pop_back();
+    }
+  }
+
+  bool qEmpty () {
+    if (m_qmode == BoundaryQueue::Lazy) {
+      prune();
+      return m_records.empty();
+    }
+    return m_heap.empty();
+  }
+
+  // Valid after qEmpty() returns false
+  iterator qFront () const {
+    return m_qmode == BoundaryQueue::Lazy?
+        m_edges[m_records.front().id]: m_heap.front();
+  }
+
+  void qPush (iterator it) {
+    if (m_fweight) {
+      auto id = it->second->seq;
+      while (m_sampler.size() <= id) { m_sampler.push_back(0.0); }
+      m_sampler.set(id, m_fweight(it->second->sal));
+    }
+    if (m_qmode == BoundaryQueue::Lazy) {
+      auto id = it->second->seq;
+      m_records.push_back(Record{it->second->sal, id, m_versions[id]});
+      std::push_heap(m_records.begin(), m_records.end(), recordLess);
+      ++m_nLive;
+    }
+    else { heapPush(it); }
+  }
+
+  void qErase (iterator it) {
+    if (m_fweight) { m_sampler.set(it->second->seq, 0.0); }
+    if (m_qmode == BoundaryQueue::Lazy) {
+      ++m_versions[it->second->seq];
+      --m_nLive;
+      // Rebuild once stale records dominate the heap
+      if (m_records.size() > 2 * m_nLive + 64) {
+        m_records.erase(std::remove_if(
+            m_records.begin(), m_records.end(),
+            [this](Record const& rec) { return !isLive(rec); }),
+                        m_records.end());
+        std::make_heap(m_records.begin(), m_records.end(), recordLess);
       }
-      btit = m_table.erase(btit);
     }
+    else { heapErase(it); }
+  }
+
+  static bool heapLess (iterator const& lhs, iterator const& rhs) {
+    auto const& x = *lhs->second;
+    auto const& y = *rhs->second;
+    return x.sal < y.sal || (x.sal == y.sal && x.seq < y.seq);
+  }
+
+  void heapSet (int i, iterator it) {
+    m_heap[i] = it;
+    it->second->hpos = i;
+  }
+
+  void siftUp (int i) {
+    auto it = m_heap[i];
+    while (i > 0) {
+      int p = (i - 1) >> 1;
+      if (!heapLess(m_heap[p], it)) { break; }
+      heapSet(i, m_heap[p]);
+      i = p;
+    }
+    heapSet(i, it);
+  }
+
+  void siftDown (int i) {
+    int n = m_heap.size();
+    auto it = m_heap[i];
+    while (true) {
+      int c = (i << 1) + 1;
+      if (c >= n) { break; }
+      if (c + 1 < n && heapLess(m_heap[c], m_heap[c + 1])) { ++c; }
+      if (!heapLess(it, m_heap[c])) { break; }
+      heapSet(i, m_heap[c]);
+      i = c;
+    }
+    heapSet(i, it);
+  }
+
+  void heapPush (iterator it) {
+    it->second->hpos = m_heap.size();
+    m_heap.push_back(it);
+    siftUp(m_heap.size() - 1);
+  }
+
+  void heapErase (iterator it) {
+    int i = it->second->hpos;
+    if (i < 0) { return; }
+    it->second->hpos = -1;
+    auto last = m_heap.back();
+    m_heap.pop_back();
+    if (i == (int)m_heap.size()) { return; }
+    heapSet(i, last);
+    siftUp(i);
+    siftDown(last->second->hpos);
   }
 };
 
@@ -78,6 +78,81 @@ public:
     }
     bboxArea = sdivide(bboxArea, normalizingArea, 0.0);
   }
+
+  // Mergeable sufficient statistics
+  // Boundary points are added piece by piece so that pieces shared by two
+  // merging regions can be left out by the caller
+  struct Acc {
+    uint area = 0, nBoundary = 0, nBorder = 0;
+    std::vector<long> lower, upper; // Bounding box corners
+
+    template <typename TPoints> void addPoints(TPoints const &points) {
+      const uint D = TPoints::Point::Dimension;
+      area += points.size();
+      points.traverse([this, D](typename TPoints::Point const &p) {
+        if (lower.empty()) {
+          lower.resize(D);
+          for (int i = 0; i < D; ++i) {
+            lower[i] = p[i];
+          }
+          upper = lower;
+        }
+        for (int i = 0; i < D; ++i) {
+          if (p[i] < lower[i]) {
+            lower[i] = p[i];
+          } else if (p[i] > upper[i]) {
+            upper[i] = p[i];
+          }
+        }
+      });
+    }
+
+    template <typename TPoints> void addBorder(TPoints const &points) {
+      nBorder += points.size();
+    }
+
+    template <typename TPoints> void addBoundary(TPoints const &points) {
+      nBoundary += points.size();
+    }
+
+    void merge(Acc const &a) {
+      area += a.area;
+      nBoundary += a.nBoundary;
+      nBorder += a.nBorder;
+      if (lower.empty()) {
+        lower = a.lower;
+        upper = a.upper;
+      } else {
+        for (int i = 0; i < a.lower.size(); ++i) {
+          lower[i] = std::min(lower[i], a.lower[i]);
+          upper[i] = std::max(upper[i], a.upper[i]);
+        }
+      }
+    }
+
+    void merge(Acc const &a, Acc const &b) {
+      *this = a;
+      merge(b);
+    }
+  };
+
+  void finalize(Acc const &acc, double normalizingArea,
+                double normalizingLength) {
+    const uint D = acc.lower.size();
+    init(D);
+    area = acc.area;
+    perim = acc.nBoundary + acc.nBorder;
+    compactness = sdivide(std::pow(perim, (double)D / (D - 1)), area, 0.0);
+    area = sdivide(area, normalizingArea, 0.0);
+    perim = sdivide(perim, normalizingLength, 0.0);
+    bboxArea = 1.0;
+    for (int i = 0; i < D; ++i) {
+      UInt bb = acc.upper[i] - acc.lower[i];
+      bboxSize[i] = sdivide(bb, normalizingLength, 0.0);
+      bboxArea *= bb;
+    }
+    bboxArea = sdivide(bboxArea, normalizingArea, 0.0);
+  }
 };
 
 class RegionShapeDiffFeats : public Object {
@@ -167,6 +242,19 @@ public:
     rBoundaryLengthPerim0 = sdivide(boundaryLength, rf0.perim, 0.0);
     rBoundaryLengthPerim1 = sdivide(boundaryLength, rf1.perim, 0.0);
   }
+
+  // boundary: accumulated points on both sides of the boundary
+  void finalize(RegionShapeFeats::Acc const &boundary,
+                RegionShapeFeats const &rf0, RegionShapeFeats const &rf1,
+                double normalizingLength) {
+    Super::generate(rf0, rf1);
+    boundaryLength =
+        sdivide(std::ceil(boundary.nBoundary / 2.0), normalizingLength, 0.0);
+    rBoundaryLengthArea0 = sdivide(boundaryLength, rf0.area, 0.0);
+    rBoundaryLengthArea1 = sdivide(boundaryLength, rf1.area, 0.0);
+    rBoundaryLengthPerim0 = sdivide(boundaryLength, rf0.perim, 0.0);
+    rBoundaryLengthPerim1 = sdivide(boundaryLength, rf1.perim, 0.0);
+  }
 };
 
 // Only support 2D regions for now
@@ -208,8 +296,75 @@ public:
   void generate(TRegion<TKey, Point<2>> const &region,
                 fPoint<2> const &centroid, double normalizingLength) {
     alg::getCentralMoments(centralMoments, region, centroid);
+    fromCentralMoments(region.size(), normalizingLength);
+  }
+
+  // Mergeable sufficient statistics: raw moments up to order 3
+  struct Acc {
+    double n = 0.0, x = 0.0, y = 0.0, xx = 0.0, xy = 0.0, yy = 0.0;
+    double xxx = 0.0, xxy = 0.0, xyy = 0.0, yyy = 0.0;
+
+    template <typename TPoints> void add(TPoints const &points) {
+      points.traverse([this](Point<2> const &p) {
+        double px = p[0], py = p[1];
+        n += 1.0;
+        x += px;
+        y += py;
+        xx += px * px;
+        xy += px * py;
+        yy += py * py;
+        xxx += px * px * px;
+        xxy += px * px * py;
+        xyy += px * py * py;
+        yyy += py * py * py;
+      });
+    }
+
+    void merge(Acc const &a) {
+      n += a.n;
+      x += a.x;
+      y += a.y;
+      xx += a.xx;
+      xy += a.xy;
+      yy += a.yy;
+      xxx += a.xxx;
+      xxy += a.xxy;
+      xyy += a.xyy;
+      yyy += a.yyy;
+    }
+
+    void merge(Acc const &a, Acc const &b) {
+      *this = a;
+      merge(b);
+    }
+  };
+
+  // Central moments about centroid from raw moments
+  void finalize(Acc const &acc, fPoint<2> const &centroid,
+                double normalizingLength) {
+    double cx = centroid[0], cy = centroid[1];
+    double cx2 = cx * cx, cy2 = cy * cy;
+    centralMoments[0] = acc.yy - 2.0 * cy * acc.y + acc.n * cy2;
+    centralMoments[1] =
+        acc.yyy - 3.0 * cy * acc.yy + 3.0 * cy2 * acc.y - acc.n * cy2 * cy;
+    centralMoments[2] = acc.xy - cx * acc.y - cy * acc.x + acc.n * cx * cy;
+    centralMoments[3] = acc.xyy - 2.0 * cy * acc.xy + cy2 * acc.x -
+                        cx * acc.yy + 2.0 * cx * cy * acc.y -
+                        acc.n * cx * cy2;
+    centralMoments[4] = acc.xx - 2.0 * cx * acc.x + acc.n * cx2;
+    centralMoments[5] = acc.xxy - 2.0 * cx * acc.xy + cx2 * acc.y -
+                        cy * acc.xx + 2.0 * cx * cy * acc.x -
+                        acc.n * cx2 * cy;
+    centralMoments[6] =
+        acc.xxx - 3.0 * cx * acc.xx + 3.0 * cx2 * acc.x - acc.n * cx2 * cx;
+    fromCentralMoments(acc.n, normalizingLength);
+  }
+
+protected:
+  // Valid after centralMoments set
+  void fromCentralMoments(double area, double normalizingLength) {
     std::array<double, 7> sims;
-    alg::getScaleInvariantMoments(sims, region.size(), centralMoments);
+    alg::getScaleInvariantMoments(sims, area, centralMoments);
     if (normalizingLength > 0.0) {
       double normalizingLength2 = normalizingLength * normalizingLength;
       double normalizingLength3 = normalizingLength2 * normalizingLength;
@@ -498,6 +653,55 @@ public:
       rValidPerims[i] = sdivide(vp, region.boundary.size(), 0.0);
     }
   }
+
+  // Mergeable sufficient statistics with per-threshold boundary counts
+  struct Acc : public Super::Acc {
+    std::vector<uint> nValidBoundary;
+
+    using Super::Acc::addBoundary;
+
+    template <typename TPoints, typename TImagePtr>
+    void addBoundary(TPoints const &points, TImagePtr const &image,
+                     std::vector<double> const &thresholds) {
+      Super::Acc::addBoundary(points);
+      nValidBoundary.resize(thresholds.size(), 0);
+      points.traverse([this, &image,
+                       &thresholds](typename TPoints::Point const &p) {
+        auto val = image->GetPixel(p);
+        for (int i = 0; i < thresholds.size(); ++i) {
+          if (val >= thresholds[i]) {
+            ++nValidBoundary[i];
+          }
+        }
+      });
+    }
+
+    void merge(Acc const &a) {
+      Super::Acc::merge(a);
+      if (nValidBoundary.size() < a.nValidBoundary.size()) {
+        nValidBoundary.resize(a.nValidBoundary.size(), 0);
+      }
+      for (int i = 0; i < a.nValidBoundary.size(); ++i) {
+        nValidBoundary[i] += a.nValidBoundary[i];
+      }
+    }
+
+    void merge(Acc const &a, Acc const &b) {
+      *this = a;
+      merge(b);
+    }
+  };
+
+  void finalize(Acc const &acc, double normalizingArea,
+                double normalizingLength, uint nThreshold) {
+    init(acc.lower.size(), nThreshold);
+    Super::finalize(acc, normalizingArea, normalizingLength);
+    for (int i = 0; i < nThreshold; ++i) {
+      uint vp = i < acc.nValidBoundary.size() ? acc.nValidBoundary[i] : 0;
+      validPerims[i] = sdivide(vp, normalizingLength, 0.0);
+      rValidPerims[i] = sdivide(vp, acc.nBoundary, 0.0);
+    }
+  }
 };
 
 // Region shape difference features with images
@@ -591,6 +795,27 @@ public:
           sdivide(validBoundaryLengths[i], rf1.perim, 0.0);
     }
   }
+
+  // boundary: accumulated points on both sides of the boundary
+  void finalize(ImageRegionShapeFeats::Acc const &boundary,
+                double normalizingLength, RegionShapeFeats const &rf0,
+                RegionShapeFeats const &rf1, uint nThreshold) {
+    init(nThreshold);
+    Super::finalize(boundary, rf0, rf1, normalizingLength);
+    for (int i = 0; i < nThreshold; ++i) {
+      uint vp = i < boundary.nValidBoundary.size()
+                    ? boundary.nValidBoundary[i]
+                    : 0;
+      validBoundaryLengths[i] =
+          sdivide(std::ceil(vp / 2.0), normalizingLength, 0.0);
+      rValidBoundaryLengths[i] =
+          sdivide(validBoundaryLengths[i], Super::boundaryLength, 0.0);
+      rValidBoundaryLengthPerims0[i] =
+          sdivide(validBoundaryLengths[i], rf0.perim, 0.0);
+      rValidBoundaryLengthPerims1[i] =
+          sdivide(validBoundaryLengths[i], rf1.perim, 0.0);
+    }
+  }
 };
 
 // Label image features (areas, perimeter)
@@ -640,6 +865,48 @@ public:
     stats::hist(histogram, image, points, histBin, histRange);
     entropy = stats::entropy(histogram);
   }
+
+  // Mergeable sufficient statistics: histogram counts
+  struct Acc {
+    uint n = 0;
+    std::vector<uint> counts;
+
+    template <typename TPoints, typename TImagePtr>
+    void add(TPoints const &points, TImagePtr const &image, uint histBin,
+             std::pair<double, double> const &histRange) {
+      std::vector<uint> hc;
+      stats::histc(hc, image, points, histBin, histRange);
+      Acc a;
+      a.n = points.size();
+      a.counts.swap(hc);
+      merge(a);
+    }
+
+    void merge(Acc const &a) {
+      n += a.n;
+      if (counts.size() < a.counts.size()) {
+        counts.resize(a.counts.size(), 0);
+      }
+      for (int i = 0; i < a.counts.size(); ++i) {
+        counts[i] += a.counts[i];
+      }
+    }
+
+    void merge(Acc const &a, Acc const &b) {
+      *this = a;
+      merge(b);
+    }
+  };
+
+  void finalize(Acc const &acc, uint histBin) {
+    init(histBin);
+    if (acc.n > 0) {
+      for (int i = 0; i < histBin && i < acc.counts.size(); ++i) {
+        histogram[i] = acc.counts[i] / (double)acc.n;
+      }
+    }
+    entropy = stats::entropy(histogram);
+  }
 };
 
 // Label image difference features
@@ -740,6 +1007,54 @@ public:
     stddev = ssqrt(stddev / n - mean * mean, 0.0);
 #endif
   }
+
+  // Mergeable sufficient statistics: sums and extrema
+  struct Acc {
+    uint n = 0;
+    double sum = 0.0, sum2 = 0.0, min = FMAX, max = -FMAX;
+
+    template <typename TPoints, typename TImagePtr>
+    void add(TPoints const &points, TImagePtr const &image) {
+      n += points.size();
+      points.traverse([&image, this](typename TPoints::Point const &p) {
+        auto val = image->GetPixel(p);
+        this->sum += val;
+        this->sum2 += (double)val * val;
+        if (val < this->min) {
+          this->min = val;
+        }
+        if (val > this->max) {
+          this->max = val;
+        }
+      });
+    }
+
+    void merge(Acc const &a) {
+      n += a.n;
+      sum += a.sum;
+      sum2 += a.sum2;
+      min = std::min(min, a.min);
+      max = std::max(max, a.max);
+    }
+
+    void merge(Acc const &a, Acc const &b) {
+      *this = a;
+      merge(b);
+    }
+  };
+
+  void finalize(Acc const &acc) {
+#ifdef GLIA_USE_MEDIAN_AS_FEATS
+    perr("Error: median features can not be merged...");
+#endif
+    if (acc.n == 0) {
+      return;
+    }
+    mean = acc.sum / acc.n;
+    stddev = ssqrt(acc.sum2 / acc.n - mean * mean, 0.0);
+    min = acc.min;
+    max = acc.max;
+  }
   // template <typename TPoints, typename TImagePtr> void
   // generate (TPoints const& points, TImagePtr const& image) {
   //   auto n = points.size();
@@ -850,8 +1165,103 @@ public:
     Super0::generate(points, image, histBin, histRange);
     Super1::generate(points, image);
   }
+
+  struct Acc {
+    Super0::Acc label;
+    Super1::Acc real;
+
+    template <typename TPoints, typename TImagePtr>
+    void add(TPoints const &points, TImagePtr const &image, uint histBin,
+             std::pair<double, double> const &histRange) {
+      label.add(points, image, histBin, histRange);
+      real.add(points, image);
+    }
+
+    void merge(Acc const &a) {
+      label.merge(a.label);
+      real.merge(a.real);
+    }
+
+    void merge(Acc const &a, Acc const &b) {
+      *this = a;
+      merge(b);
+    }
+  };
+
+  void finalize(Acc const &acc, uint histBin) {
+    init(histBin);
+    Super0::finalize(acc.label, histBin);
+    Super1::finalize(acc.real);
+  }
 };
 
+// Fused accumulation over several images in one traversal of points
+// Image i adds to labels[i] and, unless reals is empty, reals[i], as
+// ImageLabelFeats::Acc::add and ImageRealFeats::Acc::add would
+// Pixel values are gathered in blocks of points, then statistics and
+// bins (see stats::HistBins) are computed per image on contiguous values
+template <typename TPoints, typename TImagePtr>
+void addImages(std::vector<ImageLabelFeats::Acc *> const &labels,
+               std::vector<ImageRealFeats::Acc *> const &reals,
+               TPoints const &points, std::vector<TImagePtr> const &images,
+               std::vector<stats::HistBins> const &bins) {
+  const int B = 256;
+  int nImage = images.size();
+  if (nImage == 0) {
+    return;
+  }
+  std::vector<std::vector<uint>> counts(nImage);
+  for (int i = 0; i < nImage; ++i) {
+    counts[i].resize(bins[i].size(), 0);
+  }
+  std::vector<double> vals(B * nImage);
+  int n = 0;
+  auto flush = [&]() {
+    for (int i = 0; i < nImage; ++i) {
+      double const *v = &vals[i * B];
+      if (!reals.empty()) {
+        auto &r = *reals[i];
+        for (int j = 0; j < n; ++j) {
+          r.sum += v[j];
+          r.sum2 += v[j] * v[j];
+          if (v[j] < r.min) {
+            r.min = v[j];
+          }
+          if (v[j] > r.max) {
+            r.max = v[j];
+          }
+        }
+      }
+      auto &hc = counts[i];
+      for (int j = 0; j < n; ++j) {
+        int b = bins[i](v[j]);
+        if (b >= 0) {
+          ++hc[b];
+        }
+      }
+    }
+    n = 0;
+  };
+  points.traverse([&](typename TPoints::Point const &p) {
+    for (int i = 0; i < nImage; ++i) {
+      vals[i * B + n] = images[i]->GetPixel(p);
+    }
+    if (++n == B) {
+      flush();
+    }
+  });
+  flush();
+  for (int i = 0; i < nImage; ++i) {
+    ImageLabelFeats::Acc a;
+    a.n = points.size();
+    a.counts.swap(counts[i]);
+    labels[i]->merge(a);
+    if (!reals.empty()) {
+      reals[i]->n += points.size();
+    }
+  }
+}
+
 // Image difference features
 class ImageDiffFeats : public virtual ImageLabelDiffFeats,
                        public virtual ImageRealDiffFeats {
@@ -0,0 +1,109 @@
+#ifndef _glia_type_key_index_hxx_
+#define _glia_type_key_index_hxx_
+
+#include "type/hash.hxx"
+#include "type/object.hxx"
+#include "type/tuple.hxx"
+
+namespace glia {
+
+// Dense indices 0, 1, ... for sparse keys (e.g. superpixel labels and
+// merge keys), in order of insertion, with reverse map
+// Non-negative integer keys below a bound growing with the number of
+// keys are looked up in a direct table, so label/merge keys starting
+// near zero never hit the hash map
+template <typename TKey>
+class TKeyIndex : public Object {
+ public:
+  typedef Object SuperObject;
+  typedef TKeyIndex<TKey> Self;
+  typedef std::shared_ptr<Self> Pointer;
+  typedef std::shared_ptr<const Self> ConstPointer;
+  typedef std::weak_ptr<Self> WeakPointer;
+  typedef TKey Key;
+
+  static constexpr uint32 NONE = std::numeric_limits<uint32>::max();
+
+ protected:
+  std::vector<TKey> m_keys;                 // Index -> key
+  std::vector<uint32> m_direct;             // Key -> index, small keys
+  std::unordered_map<TKey, uint32> m_hash;  // Key -> index, other keys
+
+ public:
+  TKeyIndex () {}
+
+  template <typename TContainer>
+  TKeyIndex (TContainer const& keys)
+  { for (auto const& key: keys) { insert(key); } }
+
+  ~TKeyIndex () override {}
+
+  void clear () {
+    m_keys.clear();
+    m_direct.clear();
+    m_hash.clear();
+  }
+
+  void reserve (uint n) { m_keys.reserve(n); }
+
+  // Index of key, assigned if new
+  uint32 insert (TKey const& key) {
+    uint32 ret = find(key);
+    if (ret != NONE) { return ret; }
+    ret = m_keys.size();
+    m_keys.push_back(key);
+    if (isDirect(key, m_keys.size())) {
+      uint64 k = key;
+      if (k >= m_direct.size())
+      { m_direct.resize(std::max<uint64>(k + 1, 2 * m_direct.size()), NONE); }
+      m_direct[k] = ret;
+    }
+    else { m_hash[key] = ret; }
+    return ret;
+  }
+
+  // Index of key, or NONE if absent
+  uint32 find (TKey const& key) const {
+    if (isDirect(key, m_keys.size()) && (uint64)key < m_direct.size() &&
+        m_direct[(uint64)key] != NONE) { return m_direct[(uint64)key]; }
+    if (m_hash.empty()) { return NONE; }
+    auto hit = m_hash.find(key);
+    return hit == m_hash.end()? NONE: hit->second;
+  }
+
+  bool contains (TKey const& key) const { return find(key) != NONE; }
+
+  TKey const& key (uint32 i) const { return m_keys[i]; }
+
+  std::vector<TKey> const& keys () const { return m_keys; }
+
+  uint size () const { return m_keys.size(); }
+
+  bool empty () const { return m_keys.empty(); }
+
+ protected:
+  static bool isDirect (TKey const& key, uint64 n) {
+    return std::is_integral<TKey>::value && key >= 0 &&
+        (uint64)key < 4 * n + 65536;
+  }
+};
+
+
+// Replace keys of order by their indices, inserting new keys
+// (children before parents)
+template <typename TKey> void
+compactOrder (std::vector<TTriple<uint32>>& dorder,
+              TKeyIndex<TKey>& kidx, std::vector<TTriple<TKey>> const& order)
+{
+  dorder.reserve(dorder.size() + order.size());
+  kidx.reserve(kidx.size() + order.size() * 2 + 1);
+  for (auto const& m: order) {
+    uint32 i0 = kidx.insert(m.x0);
+    uint32 i1 = kidx.insert(m.x1);
+    dorder.emplace_back(i0, i1, kidx.insert(m.x2));
+  }
+}
+
+};
+
+#endif
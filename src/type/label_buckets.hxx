@@ -0,0 +1,218 @@
+#ifndef _glia_type_label_buckets_hxx_
+#define _glia_type_label_buckets_hxx_
+
+#include "glia_image.hxx"
+#include "type/hash.hxx"
+#include "type/object.hxx"
+
+namespace glia {
+
+// Masked-in points of an image bucketed by label with a counting sort:
+// one histogram pass, a prefix sum and one scatter pass
+// Points are kept as image buffer offsets, grouped by label in a single
+// array, so each label is a contiguous range (raster order within)
+// Keys are sorted; integer labels spanning a range comparable to the
+// number of points are counted directly by value, other labels are
+// compacted once per run of equal labels through a hash map
+template <typename TKey, uint D>
+class TLabelBuckets : public Object {
+ public:
+  typedef Object SuperObject;
+  typedef TLabelBuckets<TKey, D> Self;
+  typedef std::shared_ptr<Self> Pointer;
+  typedef std::shared_ptr<const Self> ConstPointer;
+  typedef std::weak_ptr<Self> WeakPointer;
+  typedef TKey Key;
+
+ protected:
+  std::array<long, D> m_lower;   // Buffered region index
+  std::array<long, D> m_size;
+  std::array<long, D> m_strides;
+  std::vector<Key> m_keys;
+  std::vector<uint32> m_starts;  // Bucket i: [m_starts[i], m_starts[i + 1])
+  std::vector<uint32> m_offsets;
+
+ public:
+  TLabelBuckets () {}
+
+  template <typename TImagePtr, typename TMaskPtr>
+  TLabelBuckets (TImagePtr const& image, TMaskPtr const& mask,
+                 bool onlyCount) { set(image, mask, onlyCount); }
+
+  ~TLabelBuckets () override {}
+
+  // Bucket points of requested region
+  // If onlyCount, only keys and bucket sizes are generated
+  template <typename TImagePtr, typename TMaskPtr> void
+  set (TImagePtr const& image, TMaskPtr const& mask, bool onlyCount)
+  { set(image, mask, image->GetRequestedRegion(), onlyCount); }
+
+  template <typename TImagePtr, typename TMaskPtr> void
+  set (TImagePtr const& image, TMaskPtr const& mask,
+       itk::ImageRegion<D> const& region, bool onlyCount) {
+    typedef TImageVal<TImagePtr> Val;
+    m_keys.clear();
+    m_starts.clear();
+    m_offsets.clear();
+    auto const& buffered = image->GetBufferedRegion();
+    long n = 1;
+    for (uint i = 0; i < D; ++i) {
+      m_lower[i] = buffered.GetIndex()[i];
+      m_size[i] = buffered.GetSize()[i];
+      m_strides[i] = n;
+      n *= m_size[i];
+    }
+    if (n > (long)std::numeric_limits<uint32>::max())
+    { perr("Error: image too large for label buckets..."); }
+    auto const* lbuf = image->GetBufferPointer();
+    auto const* mbuf = mask.IsNull()? nullptr: mask->GetBufferPointer();
+    // Label range
+    Val lower = Val(), upper = Val();
+    uint32 nPoints = 0;
+    traverseMaskedIn(region, lbuf, mbuf, [&](Val v) {
+      if (nPoints == 0 || v < lower) { lower = v; }
+      if (nPoints == 0 || upper < v) { upper = v; }
+      ++nPoints;
+    });
+    m_starts.push_back(0);
+    if (nPoints == 0) { return; }
+    // Histogram, indexed by value or by compacted key
+    bool dense = std::is_integral<Val>::value &&
+        (double)upper - (double)lower < 2.0 * nPoints + 65536.0;
+    std::vector<uint32> counts, bucketOfVal;
+    std::unordered_map<Val, uint32> bucketOfKey;
+    Val lastVal = Val();
+    uint32 lastBucket = 0;
+    bool hasLast = false;
+    if (dense) {
+      counts.assign((long)upper - (long)lower + 1, 0);
+      traverseMaskedIn(region, lbuf, mbuf, [&counts, lower](Val v)
+                       { ++counts[(long)v - (long)lower]; });
+      bucketOfVal.resize(counts.size());
+      for (uint32 b = 0; b < counts.size(); ++b) {
+        if (counts[b] > 0) {
+          bucketOfVal[b] = m_keys.size();
+          m_keys.push_back((long)lower + (long)b);
+          m_starts.push_back(m_starts.back() + counts[b]);
+        }
+      }
+    }
+    else {
+      traverseMaskedIn(region, lbuf, mbuf, [&](Val v) {
+        if (!hasLast || !(v == lastVal)) {
+          auto bit = bucketOfKey.emplace(v, counts.size()).first;
+          if (bit->second == counts.size()) { counts.push_back(0); }
+          lastVal = v;
+          lastBucket = bit->second;
+          hasLast = true;
+        }
+        ++counts[lastBucket];
+      });
+      // Renumber buckets by sorted key
+      std::vector<std::pair<Val, uint32>> vbs
+          (bucketOfKey.begin(), bucketOfKey.end());
+      std::sort(vbs.begin(), vbs.end());
+      for (uint32 i = 0; i < vbs.size(); ++i) {
+        m_keys.push_back(vbs[i].first);
+        m_starts.push_back(m_starts.back() + counts[vbs[i].second]);
+        bucketOfKey[vbs[i].first] = i;
+      }
+    }
+    if (onlyCount) { return; }
+    // Scatter
+    m_offsets.resize(nPoints);
+    std::vector<uint32> cursor(m_starts.begin(), m_starts.end() - 1);
+    hasLast = false;
+    traverseRows(region, [&](long j, long nx) {
+      for (long x = j; x < j + nx; ++x) {
+        if (mbuf && mbuf[x] == MASK_OUT_VAL) { continue; }
+        Val v = lbuf[x];
+        if (dense) { lastBucket = bucketOfVal[(long)v - (long)lower]; }
+        else if (!hasLast || !(v == lastVal)) {
+          lastVal = v;
+          lastBucket = bucketOfKey.find(v)->second;
+          hasLast = true;
+        }
+        m_offsets[cursor[lastBucket]++] = x;
+      }
+    });
+  }
+
+  // Number of labels
+  uint size () const { return m_keys.size(); }
+
+  bool empty () const { return m_keys.empty(); }
+
+  Key key (uint i) const { return m_keys[i]; }
+
+  std::vector<Key> const& keys () const { return m_keys; }
+
+  // Bucket index of key, or -1 if absent
+  int find (Key key) const {
+    auto kit = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+    return kit != m_keys.end() && *kit == key? kit - m_keys.begin(): -1;
+  }
+
+  uint count (uint i) const { return m_starts[i + 1] - m_starts[i]; }
+
+  // Buffer offsets of bucket i; empty if onlyCount
+  uint32 const* begin (uint i) const
+  { return m_offsets.data() + m_starts[i]; }
+
+  uint32 const* end (uint i) const
+  { return m_offsets.data() + m_starts[i + 1]; }
+
+  std::vector<uint32> const& starts () const { return m_starts; }
+
+  std::vector<uint32> const& offsets () const { return m_offsets; }
+
+  itk::Index<D> index (uint32 offset) const {
+    itk::Index<D> ret;
+    for (uint i = 0; i < D; ++i)
+    { ret[i] = m_lower[i] + (offset / m_strides[i]) % m_size[i]; }
+    return ret;
+  }
+
+  // Approximate bytes held
+  size_t bytes () const {
+    return sizeof(Self) + m_keys.capacity() * sizeof(Key) +
+        (m_starts.capacity() + m_offsets.capacity()) * sizeof(uint32);
+  }
+
+ protected:
+  // f (long offset of first row point, long row length)
+  template <typename Func> void
+  traverseRows (itk::ImageRegion<D> const& region, Func f) const {
+    long nRow = 1, nx = region.GetSize()[0];
+    for (uint i = 0; i < D; ++i) {
+      if (region.GetSize()[i] == 0) { return; }
+      if (i > 0) { nRow *= region.GetSize()[i]; }
+    }
+    itk::Index<D> point = region.GetIndex();
+    for (long row = 0; row < nRow; ++row) {
+      long offset = 0;
+      for (uint i = 0; i < D; ++i)
+      { offset += (point[i] - m_lower[i]) * m_strides[i]; }
+      f(offset, nx);
+      for (uint i = 1; i < D; ++i) {
+        if (++point[i] < region.GetIndex()[i] + (long)region.GetSize()[i])
+        { break; }
+        point[i] = region.GetIndex()[i];
+      }
+    }
+  }
+
+  // f (val)
+  template <typename TVal, typename TMaskVal, typename Func> void
+  traverseMaskedIn (itk::ImageRegion<D> const& region, TVal const* lbuf,
+                    TMaskVal const* mbuf, Func f) const {
+    traverseRows(region, [lbuf, mbuf, &f](long j, long nx) {
+      for (long x = 0; x < nx; ++x)
+      { if (!mbuf || mbuf[j + x] != MASK_OUT_VAL) { f(lbuf[j + x]); } }
+    });
+  }
+};
+
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef _glia_type_label_stats_hxx_
+#define _glia_type_label_stats_hxx_
+
+#include "type/feat.hxx"
+#include "type/key_index.hxx"
+#include "type/label_buckets.hxx"
+#include "util/mp.hxx"
+
+namespace glia {
+
+// Statistics of all labels of a label image from one raster sweep:
+// area, bounding box, coordinate sums (centroid), raw moments up to
+// order 3 (2D only, optional) and, per channel image, histogram counts
+// (see stats::HistBins) and sum/sum2/min/max
+// Labels are indexed in sorted key order, as in TLabelBuckets
+// Rows of the requested region are split into a fixed number of stripes
+// swept in parallel (GLIA_MT); each stripe keeps partial statistics of
+// the labels it touches, merged in stripe order at the end, so sums do
+// not depend on the number of threads
+// Channel images are read at the indices of the label image, each
+// through its own buffer
+template <typename TKey, uint D>
+class TLabelStats : public Object {
+ public:
+  typedef Object SuperObject;
+  typedef TLabelStats<TKey, D> Self;
+  typedef std::shared_ptr<Self> Pointer;
+  typedef std::shared_ptr<const Self> ConstPointer;
+  typedef std::weak_ptr<Self> WeakPointer;
+  typedef TKey Key;
+  typedef feat::RegionAdvShapeFeats2D::Acc Moments;
+  typedef feat::ImageRealFeats::Acc Real;
+
+ protected:
+  static constexpr uint32 NONE = std::numeric_limits<uint32>::max();
+  static constexpr long N_STRIPE = 32;
+
+  // Statistics of labels slot by slot
+  struct Part {
+    std::vector<uint32> slotOf;  // Label index -> slot
+    std::vector<uint32> labels;  // Slot -> label index
+    std::vector<uint32> area;
+    std::vector<long> lower, upper;  // Slot * D + i
+    std::vector<double> coords;      // Slot * D + i
+    std::vector<Moments> moments;
+    std::vector<uint32> counts;      // Slot * nBin + channel bin
+    std::vector<Real> reals;         // Slot * nChannel + channel
+  };
+
+  std::vector<Key> m_keys;
+  std::vector<uint> m_binStarts;  // Channel c: [m_binStarts[c], [c + 1])
+  bool m_moments = false;
+  Part m_all;                     // Slot i: label i
+
+ public:
+  TLabelStats () {}
+
+  ~TLabelStats () override {}
+
+  // channels: images swept along with labels, binned by bins
+  // moments: whether to accumulate raw moments (2D)
+  // maxThreads: 0 to use OMP_NUM_THREADS
+  template <typename TImagePtr, typename TMaskPtr, typename TCImagePtr>
+  void set (TImagePtr const& image, TMaskPtr const& mask,
+            std::vector<TCImagePtr> const& channels,
+            std::vector<stats::HistBins> const& bins, bool moments,
+            uint maxThreads) {
+    TLabelBuckets<Key, D> buckets(image, mask, true);
+    m_keys = buckets.keys();
+    m_binStarts.assign(1, 0);
+    for (auto const& b: bins)
+    { m_binStarts.push_back(m_binStarts.back() + b.size()); }
+    m_moments = moments && D == 2;
+    m_all = Part();
+    uint n = m_keys.size();
+    for (uint i = 0; i < n; ++i) { add(m_all, i); }
+    if (n == 0) { return; }
+    TKeyIndex<Key> kidx(m_keys);
+    auto const& region = image->GetRequestedRegion();
+    long nRow = 1;
+    for (uint i = 1; i < D; ++i) { nRow *= region.GetSize()[i]; }
+    long nStripe = std::max(1L, std::min(N_STRIPE, nRow));
+    std::vector<Part> parts(nStripe);
+    parfor(0, nStripe, false, [&](int s) {
+        sweep(parts[s], s * nRow / nStripe, (s + 1) * nRow / nStripe,
+              kidx, image, mask, channels, bins);
+      }, maxThreads);
+    for (auto const& part: parts) { merge(part); }
+  }
+
+  // Number of labels
+  uint size () const { return m_keys.size(); }
+
+  bool empty () const { return m_keys.empty(); }
+
+  Key key (uint i) const { return m_keys[i]; }
+
+  std::vector<Key> const& keys () const { return m_keys; }
+
+  // Label index of key, or -1 if absent
+  int find (Key key) const {
+    auto kit = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+    return kit != m_keys.end() && *kit == key? kit - m_keys.begin(): -1;
+  }
+
+  uint channels () const { return m_binStarts.size() - 1; }
+
+  uint area (uint i) const { return m_all.area[i]; }
+
+  // Bounding box corners
+  long const* lower (uint i) const { return &m_all.lower[i * D]; }
+
+  long const* upper (uint i) const { return &m_all.upper[i * D]; }
+
+  // Area and bounding box, as RegionShapeFeats::Acc::addPoints
+  void getShape (feat::RegionShapeFeats::Acc& acc, uint i) const {
+    acc.area = area(i);
+    acc.lower.assign(lower(i), lower(i) + D);
+    acc.upper.assign(upper(i), upper(i) + D);
+  }
+
+  void getCentroid (fPoint<D>& c, uint i) const {
+    for (uint j = 0; j < D; ++j) { c[j] = m_all.coords[i * D + j] / area(i); }
+  }
+
+  // Raw moments; valid if swept with moments
+  Moments const& moments (uint i) const { return m_all.moments[i]; }
+
+  // Histogram counts and real statistics of channel c,
+  // as ImageFeats::Acc::add
+  void getImage (feat::ImageFeats::Acc& acc, uint i, uint c) const {
+    uint nBin = m_binStarts.back();
+    auto const* hc = &m_all.counts[i * nBin];
+    acc.label.n = area(i);
+    acc.label.counts.assign
+        (hc + m_binStarts[c], hc + m_binStarts[c + 1]);
+    acc.real = m_all.reals[i * channels() + c];
+    acc.real.n = area(i);
+  }
+
+  // Approximate bytes held
+  size_t bytes () const {
+    return sizeof(Self) + m_keys.capacity() * sizeof(Key) +
+        (m_all.labels.capacity() + m_all.area.capacity()) * sizeof(uint32) +
+        (m_all.lower.capacity() + m_all.upper.capacity()) * sizeof(long) +
+        m_all.coords.capacity() * sizeof(double) +
+        m_all.moments.capacity() * sizeof(Moments) +
+        m_all.counts.capacity() * sizeof(uint32) +
+        m_all.reals.capacity() * sizeof(Real);
+  }
+
+ protected:
+  // Append slot of label index li
+  uint32 add (Part& part, uint32 li) const {
+    uint32 s = part.labels.size();
+    if (!part.slotOf.empty()) { part.slotOf[li] = s; }
+    part.labels.push_back(li);
+    part.area.push_back(0);
+    part.lower.resize(part.lower.size() + D, 0);
+    part.upper.resize(part.upper.size() + D, 0);
+    part.coords.resize(part.coords.size() + D, 0.0);
+    if (m_moments) { part.moments.emplace_back(); }
+    part.counts.resize(part.counts.size() + m_binStarts.back(), 0);
+    part.reals.resize(part.reals.size() + channels());
+    return s;
+  }
+
+  // Sweep rows [rowBegin, rowEnd) of requested region
+  template <typename TImagePtr, typename TMaskPtr, typename TCImagePtr>
+  void sweep (Part& part, long rowBegin, long rowEnd,
+              TKeyIndex<Key> const& kidx, TImagePtr const& image,
+              TMaskPtr const& mask, std::vector<TCImagePtr> const& channels,
+              std::vector<stats::HistBins> const& bins) const {
+    typedef TImageVal<TImagePtr> Val;
+    typedef TImageVal<TCImagePtr> CVal;
+    if (rowBegin >= rowEnd) { return; }
+    auto const& region = image->GetRequestedRegion();
+    long nx = region.GetSize()[0];
+    if (nx == 0) { return; }
+    part.slotOf.assign(m_keys.size(), NONE);
+    uint nChannel = channels.size(), nBin = m_binStarts.back();
+    auto const* lbuf = image->GetBufferPointer();
+    auto const* mbuf = mask.IsNull()? nullptr: mask->GetBufferPointer();
+    std::vector<CVal const*> cbufs;
+    for (auto const& c: channels) { cbufs.push_back(c->GetBufferPointer()); }
+    // Index of first row
+    itk::Index<D> point = region.GetIndex();
+    long r = rowBegin;
+    for (uint i = 1; i < D; ++i) {
+      point[i] += r % (long)region.GetSize()[i];
+      r /= (long)region.GetSize()[i];
+    }
+    std::vector<long> coffsets(nChannel);
+    for (long row = rowBegin; row < rowEnd; ++row) {
+      long offset = bufferOffset(image->GetBufferedRegion(), point);
+      for (uint c = 0; c < nChannel; ++c)
+      { coffsets[c] = bufferOffset(channels[c]->GetBufferedRegion(), point); }
+      Val lastVal = Val();
+      uint32 s = NONE;
+      for (long x = 0; x < nx; ++x) {
+        if (mbuf && mbuf[offset + x] == MASK_OUT_VAL) { continue; }
+        Val v = lbuf[offset + x];
+        if (s == NONE || !(v == lastVal)) {
+          uint32 li = kidx.find(v);
+          s = part.slotOf[li] == NONE? add(part, li): part.slotOf[li];
+          lastVal = v;
+        }
+        long px = point[0] + x;
+        long* lo = &part.lower[s * D];
+        long* up = &part.upper[s * D];
+        if (part.area[s]++ == 0) {
+          for (uint i = 0; i < D; ++i) { lo[i] = up[i] = point[i]; }
+          lo[0] = up[0] = px;
+        }
+        else {
+          if (px < lo[0]) { lo[0] = px; }
+          if (px > up[0]) { up[0] = px; }
+          for (uint i = 1; i < D; ++i) {
+            if (point[i] < lo[i]) { lo[i] = point[i]; }
+            if (point[i] > up[i]) { up[i] = point[i]; }
+          }
+        }
+        double* cs = &part.coords[s * D];
+        cs[0] += px;
+        for (uint i = 1; i < D; ++i) { cs[i] += point[i]; }
+        if (m_moments) { addMoments(part.moments[s], px, point[D - 1]); }
+        Real* reals = &part.reals[s * nChannel];
+        uint32* hc = &part.counts[s * nBin];
+        for (uint c = 0; c < nChannel; ++c) {
+          double val = cbufs[c][coffsets[c] + x];
+          Real& rs = reals[c];
+          rs.sum += val;
+          rs.sum2 += val * val;
+          if (val < rs.min) { rs.min = val; }
+          if (val > rs.max) { rs.max = val; }
+          int b = bins[c](val);
+          if (b >= 0) { ++hc[m_binStarts[c] + b]; }
+        }
+      }
+      for (uint i = 1; i < D; ++i) {
+        if (++point[i] < region.GetIndex()[i] + (long)region.GetSize()[i])
+        { break; }
+        point[i] = region.GetIndex()[i];
+      }
+    }
+  }
+
+  static void addMoments (Moments& m, double px, double py) {
+    m.n += 1.0;
+    m.x += px;
+    m.y += py;
+    m.xx += px * px;
+    m.xy += px * py;
+    m.yy += py * py;
+    m.xxx += px * px * px;
+    m.xxy += px * px * py;
+    m.xyy += px * py * py;
+    m.yyy += py * py * py;
+  }
+
+  void merge (Part const& part) {
+    uint nChannel = channels(), nBin = m_binStarts.back();
+    for (uint32 s = 0; s < part.labels.size(); ++s) {
+      uint32 li = part.labels[s];
+      long* lo = &m_all.lower[li * D];
+      long* up = &m_all.upper[li * D];
+      for (uint i = 0; i < D; ++i) {
+        long plo = part.lower[s * D + i], pup = part.upper[s * D + i];
+        lo[i] = m_all.area[li] == 0? plo: std::min(lo[i], plo);
+        up[i] = m_all.area[li] == 0? pup: std::max(up[i], pup);
+        m_all.coords[li * D + i] += part.coords[s * D + i];
+      }
+      m_all.area[li] += part.area[s];
+      if (m_moments) { m_all.moments[li].merge(part.moments[s]); }
+      for (uint b = 0; b < nBin; ++b)
+      { m_all.counts[li * nBin + b] += part.counts[s * nBin + b]; }
+      for (uint c = 0; c < nChannel; ++c)
+      { m_all.reals[li * nChannel + c].merge(part.reals[s * nChannel + c]); }
+    }
+  }
+
+  static long bufferOffset (itk::ImageRegion<D> const& buffered,
+                            itk::Index<D> const& point) {
+    long ret = 0, stride = 1;
+    for (uint i = 0; i < D; ++i) {
+      ret += (point[i] - buffered.GetIndex()[i]) * stride;
+      stride *= buffered.GetSize()[i];
+    }
+    return ret;
+  }
+};
+
+};
+
+#endif
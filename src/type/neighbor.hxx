@@ -111,21 +111,129 @@ std::pair<TImageVal<TImagePtr>, bool>
 getContourTraits (itk::Index<TImage<TImagePtr>::ImageDimension> point,
                   TImagePtr const& image, TMaskPtr const& mask)
 {
-  std::vector<TImageVal<TImagePtr>> nvs;
-  getNeighborValues(nvs, point, image, mask);
   auto thisVal = image->GetPixel(point);
-  auto ret = std::make_pair
-      (thisVal, nvs.size() < (TImage<TImagePtr>::ImageDimension << 1));
-  for (auto x: nvs) {
-    if (x != thisVal) {
-      ret.first = x;
-      break;
+  auto ret = std::make_pair(thisVal, false);
+  UInt nValid = 0;
+  traverseNeighbors
+      (point, image->GetRequestedRegion(), mask, [&]
+       (itk::Index<TImage<TImagePtr>::ImageDimension> const& p) {
+        ++nValid;
+        if (ret.first == thisVal) { ret.first = image->GetPixel(p); }
+      });
+  ret.second = nValid < (TImage<TImagePtr>::ImageDimension << 1);
+  return ret;
+}
+
+
+// Same as calling getContourTraits on every point of region, but reads
+// image/mask buffers directly (mask has to share image buffered region)
+// f (itk::Index<D> const& point, long offset, val, nval) is called on
+// contour points in raster order, where offset is into image buffer
+// and nval == val means a border point; masked-out points are skipped
+// Rows off region edges are screened by branch-free compare loops the
+// compiler vectorizes; only flagged and edge points are checked in full
+template <typename TImagePtr, typename TMaskPtr, typename Func> void
+traverseContourPoints
+(TImagePtr const& image, TMaskPtr const& mask,
+ itk::ImageRegion<TImage<TImagePtr>::ImageDimension> const& region,
+ Func f)
+{
+  const UInt D = TImage<TImagePtr>::ImageDimension;
+  typedef TImageVal<TImagePtr> Val;
+  auto const& buffered = image->GetBufferedRegion();
+  std::array<long, D> lower, upper, strides;
+  long stride = 1, nRow = 1;
+  for (UInt i = 0; i < D; ++i) {
+    lower[i] = region.GetIndex()[i];
+    upper[i] = lower[i] + region.GetSize()[i];
+    if (upper[i] <= lower[i]) { return; }
+    strides[i] = stride;
+    stride *= buffered.GetSize()[i];
+    if (i > 0) { nRow *= upper[i] - lower[i]; }
+  }
+  Val const* lbuf = image->GetBufferPointer();
+  auto const* mbuf = mask.IsNull()? nullptr: mask->GetBufferPointer();
+  long nx = upper[0] - lower[0];
+  std::vector<uint8> flags(nx);
+  itk::Index<D> point = region.GetIndex();
+  for (long row = 0; row < nRow; ++row) {
+    long offset = 0;
+    bool inner = nx > 2;
+    point[0] = lower[0];
+    for (UInt i = 0; i < D; ++i) {
+      offset += (point[i] - buffered.GetIndex()[i]) * strides[i];
+      if (i > 0) {
+        inner = inner && point[i] > lower[i] && point[i] + 1 < upper[i];
+      }
+    }
+    // Full check of x-th point in row, in getContourTraits order
+    auto visit = [&](long x) {
+      long j = offset + x;
+      if (mbuf && mbuf[j] == MASK_OUT_VAL) { return; }
+      Val val = lbuf[j], nval = val;
+      UInt nValid = 0;
+      for (UInt i = 0; i < D; ++i) {
+        long c = i == 0? lower[0] + x: point[i];
+        if (c > lower[i] &&
+            (!mbuf || mbuf[j - strides[i]] != MASK_OUT_VAL)) {
+          ++nValid;
+          if (nval == val) { nval = lbuf[j - strides[i]]; }
+        }
+        if (c + 1 < upper[i] &&
+            (!mbuf || mbuf[j + strides[i]] != MASK_OUT_VAL)) {
+          ++nValid;
+          if (nval == val) { nval = lbuf[j + strides[i]]; }
+        }
+      }
+      if (nval != val || nValid < (D << 1)) {
+        point[0] = lower[0] + x;
+        f(point, j, val, nval);
+      }
+    };
+    if (inner) {
+      Val const* l = lbuf + offset;
+      for (long x = 1; x + 1 < nx; ++x)
+      { flags[x] = (l[x] != l[x - 1]) | (l[x] != l[x + 1]); }
+      for (UInt i = 1; i < D; ++i) {
+        Val const* l0 = l - strides[i];
+        Val const* l1 = l + strides[i];
+        for (long x = 1; x + 1 < nx; ++x)
+        { flags[x] |= (l[x] != l0[x]) | (l[x] != l1[x]); }
+      }
+      if (mbuf) {
+        auto const* m = mbuf + offset;
+        for (long x = 1; x + 1 < nx; ++x) {
+          flags[x] |= (m[x] == MASK_OUT_VAL) | (m[x - 1] == MASK_OUT_VAL) |
+              (m[x + 1] == MASK_OUT_VAL);
+        }
+        for (UInt i = 1; i < D; ++i) {
+          auto const* m0 = m - strides[i];
+          auto const* m1 = m + strides[i];
+          for (long x = 1; x + 1 < nx; ++x) {
+            flags[x] |= (m0[x] == MASK_OUT_VAL) | (m1[x] == MASK_OUT_VAL);
+          }
+        }
+      }
+      visit(0);
+      for (long x = 1; x + 1 < nx; ++x) { if (flags[x]) { visit(x); } }
+      visit(nx - 1);
+    }
+    else { for (long x = 0; x < nx; ++x) { visit(x); } }
+    for (UInt i = 1; i < D; ++i) {
+      if (++point[i] < upper[i]) { break; }
+      point[i] = lower[i];
     }
   }
-  return ret;
 }
 
 
+// Over requested region
+template <typename TImagePtr, typename TMaskPtr, typename Func>
+inline void
+traverseContourPoints (TImagePtr const& image, TMaskPtr const& mask,
+                       Func f)
+{ traverseContourPoints(image, mask, image->GetRequestedRegion(), f); }
+
 };
 
 #endif
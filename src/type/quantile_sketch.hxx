@@ -0,0 +1,112 @@
+#ifndef _glia_type_quantile_sketch_hxx_
+#define _glia_type_quantile_sketch_hxx_
+
+#include "glia_base.hxx"
+
+namespace glia {
+
+// Fixed-resolution histogram sketch of a value stream over [lower, upper]
+// Only occupied bins are stored, as sorted (bin, count) pairs, so add,
+// merge and quantile cost O(#occupied bins) <= nBin no matter how many
+// values were added
+// Error bound: a quantile is reported as the center of the bin holding
+// the k-th smallest value, so it is off by at most half a bin width,
+// (upper - lower) / (2 * nBin); values out of range are clamped into the
+// end bins and only their rank is kept
+// Sketches can only be merged if they share the same range and bins
+class QuantileSketch {
+ public:
+  typedef std::pair<uint16, uint32> Bin;
+
+ protected:
+  double m_lower = 0.0, m_interval = 1.0;
+  uint m_nBin = 0;
+  uint m_n = 0;
+  std::vector<Bin> m_bins;
+
+ public:
+  QuantileSketch () {}
+
+  QuantileSketch (double lower, double upper, uint nBin)
+  { init(lower, upper, nBin); }
+
+  // nBin has to be in [1, 65536]
+  void init (double lower, double upper, uint nBin) {
+    if (nBin == 0 || nBin > 65536)
+    { perr("Error: invalid number of quantile sketch bins..."); }
+    m_lower = lower;
+    m_interval = std::max(upper - lower, FEPS) / nBin;
+    m_nBin = nBin;
+    m_n = 0;
+    m_bins.clear();
+  }
+
+  void add (double x) {
+    ++m_n;
+    uint16 b = bin(x);
+    auto bit = std::lower_bound
+        (m_bins.begin(), m_bins.end(), std::make_pair(b, (uint32)0));
+    if (bit != m_bins.end() && bit->first == b) { ++bit->second; }
+    else { m_bins.emplace(bit, b, 1); }
+  }
+
+  void merge (QuantileSketch const& s) {
+    if (s.m_n == 0) { return; }
+    if (m_n == 0) {
+      *this = s;
+      return;
+    }
+    std::vector<Bin> bins;
+    bins.reserve(m_bins.size() + s.m_bins.size());
+    auto it0 = m_bins.cbegin();
+    auto it1 = s.m_bins.cbegin();
+    while (it0 != m_bins.cend() && it1 != s.m_bins.cend()) {
+      if (it0->first < it1->first) { bins.push_back(*it0++); }
+      else if (it1->first < it0->first) { bins.push_back(*it1++); }
+      else {
+        bins.emplace_back(it0->first, it0->second + it1->second);
+        ++it0;
+        ++it1;
+      }
+    }
+    bins.insert(bins.end(), it0, m_bins.cend());
+    bins.insert(bins.end(), it1, s.m_bins.cend());
+    m_bins.swap(bins);
+    m_n += s.m_n;
+  }
+
+  // Approximate value of rank floor(q * n), q in [0, 1]
+  // Return DUMMY if empty
+  double quantile (double q) const {
+    if (m_n == 0) { return DUMMY; }
+    uint k = std::min((uint)(q * m_n), m_n - 1), c = 0;
+    for (auto const& bp: m_bins) {
+      c += bp.second;
+      if (c > k) { return center(bp.first); }
+    }
+    return center(m_bins.back().first);
+  }
+
+  // Same rank as stats::amedian
+  double median () const { return quantile(0.5); }
+
+  double errorBound () const { return 0.5 * m_interval; }
+
+  uint size () const { return m_n; }
+
+  bool empty () const { return m_n == 0; }
+
+  std::vector<Bin> const& bins () const { return m_bins; }
+
+ protected:
+  uint16 bin (double x) const {
+    int b = (x - m_lower) / m_interval;
+    return std::min(std::max(b, 0), (int)m_nBin - 1);
+  }
+
+  double center (uint16 b) const { return m_lower + (b + 0.5) * m_interval; }
+};
+
+};
+
+#endif
@@ -32,21 +32,30 @@ class TRegion : public TPointPtrMap<TKey, TPoint> {
     std::cout << "Adding region with key: " << key << std::endl;
     if (pBorder) { border.emplace(key, pBorder); }
     for (auto const& bn: pBoundaries)
-    { boundary.emplace(std::make_pair(key, bn.first), bn.second); }
+    { addBoundary(key, bn.first, bn.second); }
   }
 
   ~TRegion () override {}
 
   virtual bool touchBorder () const { return !border.empty(); }
 
+  // Add boundary piece of base key facing base neighbor
+  virtual void addBoundary (TKey key, TKey neighbor, Points* pPoints)
+  { insertBoundary(std::make_pair(std::make_pair(key, neighbor), pPoints)); }
+
   // Get boundary on side of this region
+  // Pieces facing bases that have boundary pieces in region are looked
+  // up through the adjacency indices, from whichever side is smaller
   virtual void boundaryWith (Boundary& b, Self const& region) const {
-    for (auto const& bp0: boundary) {
-      for (auto const& bp1: region.boundary) {
-        if (bp0.first.second == bp1.first.first) {
-          b.merge(bp0);
-          break;
-        }
+    if (m_facing.size() <= region.m_sides.size()) {
+      for (auto const& fp: m_facing) {
+        if (region.m_sides.count(fp.first) > 0) { boundaryFacing(b, fp); }
+      }
+    }
+    else {
+      for (auto const& sp: region.m_sides) {
+        auto fit = m_facing.find(sp.first);
+        if (fit != m_facing.end()) { boundaryFacing(b, *fit); }
       }
     }
   }
@@ -58,25 +67,20 @@ class TRegion : public TPointPtrMap<TKey, TPoint> {
     border.merge(std::make_pair(key, pBorder));
     for (auto const& bn: pBoundaries) {
       auto it = boundary.find(std::make_pair(bn.first, key));
-      if (it == boundary.end())
-      { boundary[std::make_pair(key, bn.first)] = bn.second; }
-      else { boundary.erase(it); }
+      if (it == boundary.end()) { addBoundary(key, bn.first, bn.second); }
+      else { eraseBoundary(it); }
     }
   }
 
   virtual void merge (Self const& region) {
-    // std::cout << "1 ";
     Super::merge(region);
-    // std::cout << "2 ";
     border.merge(region.border);
-    // std::cout << "3 ";
     for (auto const& pp: region.boundary) {
       auto it = boundary.find
           (std::make_pair(pp.first.second, pp.first.first));
-      if (it == boundary.end()) { boundary.merge(pp); }
-      else { boundary.erase(it); }
+      if (it == boundary.end()) { insertBoundary(pp); }
+      else { eraseBoundary(it); }
     }
-    // std::cout << "4" << std::endl;
   }
 
   // neighbors: keys of basic superpixels
@@ -86,9 +90,40 @@ class TRegion : public TPointPtrMap<TKey, TPoint> {
     sreg.border = this->border;
     for (auto const& bp: this->boundary) {
       if (neighbors.count(bp.first.second) > 0)
-      { sreg.boundary.insert(bp); }
+      { sreg.insertBoundary(bp); }
     }
   }
+
+ protected:
+  // Adjacency indices of boundary pieces (a, c):
+  // neighbor base c -> bases a facing it; base a -> number of its pieces
+  std::unordered_map<TKey, std::vector<TKey>> m_facing;
+  std::unordered_map<TKey, uint> m_sides;
+
+  void insertBoundary
+  (std::pair<std::pair<TKey, TKey>, Points*> const& pp) {
+    if (pp.second && boundary.insert(pp).second) {
+      m_facing[pp.first.second].push_back(pp.first.first);
+      ++m_sides[pp.first.first];
+    }
+  }
+
+  void eraseBoundary (typename Boundary::iterator it) {
+    auto fit = m_facing.find(it->first.second);
+    auto& keys = fit->second;
+    *std::find(keys.begin(), keys.end(), it->first.first) = keys.back();
+    keys.pop_back();
+    if (keys.empty()) { m_facing.erase(fit); }
+    auto sit = m_sides.find(it->first.first);
+    if (--sit->second == 0) { m_sides.erase(sit); }
+    boundary.erase(it);
+  }
+
+  void boundaryFacing
+  (Boundary& b, std::pair<const TKey, std::vector<TKey>> const& fp) const {
+    for (auto const& key: fp.second)
+    { b.merge(*boundary.find(std::make_pair(key, fp.first))); }
+  }
 };
 
 };
@@ -0,0 +1,195 @@
+#ifndef _glia_type_region_graph_hxx_
+#define _glia_type_region_graph_hxx_
+
+#include "glia_image.hxx"
+#include "type/hash.hxx"
+#include "type/object.hxx"
+#include "type/quantile_sketch.hxx"
+#include "util/container.hxx"
+
+namespace glia {
+
+// Region adjacency graph with per-boundary sufficient statistics
+// Built in one raster pass over a label image and a boundary
+// probability image; no per-pixel storage is kept
+// Boundary points follow genContourMap: a pixel belongs to the boundary
+// with its first differing neighbor (order: -x, +x, -y, +y, ...)
+template <typename TKey>
+class TRegionGraph : public Object {
+ public:
+  typedef Object SuperObject;
+  typedef TRegionGraph<TKey> Self;
+  typedef std::shared_ptr<Self> Pointer;
+  typedef std::shared_ptr<const Self> ConstPointer;
+  typedef std::weak_ptr<Self> WeakPointer;
+  typedef TKey Key;
+  typedef std::pair<TKey, TKey> KeyPair;
+
+  struct Edge {
+    double sum = 0.0;
+    uint n = 0;
+    uint8 sides = 0;   // 1: seen from r0, 2: seen from r1
+    QuantileSketch hist;   // Left empty if histogram disabled
+
+    void add (double x, bool useHist) {
+      sum += x;
+      ++n;
+      if (useHist) { hist.add(x); }
+    }
+
+    void merge (Edge const& e) {
+      sum += e.sum;
+      n += e.n;
+      sides |= e.sides;
+      hist.merge(e.hist);
+    }
+
+    bool mutual () const { return sides == 3; }
+  };
+
+  std::unordered_map<KeyPair, Edge> edges;
+
+ protected:
+  std::unordered_map<Key, uint> m_sizes;    // Region key -> #pixels
+  std::unordered_map<Key, Key> m_parent;    // Union-find forest
+  Key m_maxKey = 0;
+  uint m_nRegion = 0;
+  QuantileSketch m_hist;   // Empty sketch spanning pb value range
+
+ public:
+  TRegionGraph () {}
+
+  template <typename TImagePtr, typename TRImagePtr, typename TMaskPtr>
+  TRegionGraph (TImagePtr const& image, TRImagePtr const& pbImage,
+                TMaskPtr const& mask, uint histBin)
+  { set(image, pbImage, mask, histBin); }
+
+  ~TRegionGraph () override {}
+
+  // histBin: number of histogram bins over pb value range, 0 to disable
+  template <typename TImagePtr, typename TRImagePtr, typename TMaskPtr> void
+  set (TImagePtr const& image, TRImagePtr const& pbImage,
+       TMaskPtr const& mask, uint histBin) {
+    const uint D = TImage<TImagePtr>::ImageDimension;
+    edges.clear();
+    m_sizes.clear();
+    m_parent.clear();
+    m_maxKey = 0;
+    m_nRegion = 0;
+    auto const& size = image->GetBufferedRegion().GetSize();
+    std::array<long, D> strides;
+    long n = 1;
+    for (int i = 0; i < D; ++i) {
+      strides[i] = n;
+      n *= size[i];
+    }
+    auto const* lbuf = image->GetBufferPointer();
+    auto const* pbuf = pbImage->GetBufferPointer();
+    auto const* mbuf = mask.IsNull()? nullptr: mask->GetBufferPointer();
+    if (n == 0) { return; }
+    bool useHist = histBin > 0;
+    if (useHist) {
+      auto mm = std::minmax_element(pbuf, pbuf + n);
+      m_hist.init(*mm.first, *mm.second, histBin);
+    }
+    std::array<long, D> index;
+    index.fill(0);
+    auto runKey = lbuf[0];
+    uint runLength = 0;
+    auto inside = [mbuf](long j) { return !mbuf || mbuf[j] != MASK_OUT_VAL; };
+    auto advance = [&index, &size]() {
+      for (int i = 0; i < D && ++index[i] == (long)size[i]; ++i)
+      { index[i] = 0; }
+    };
+    for (long j = 0; j < n; ++j, advance()) {
+      if (!inside(j)) { continue; }
+      Key val = lbuf[j];
+      if (val != runKey) {
+        if (runLength > 0) { m_sizes[runKey] += runLength; }
+        runKey = val;
+        runLength = 0;
+      }
+      ++runLength;
+      if (val > m_maxKey) { m_maxKey = val; }
+      Key nval = val;
+      for (int i = 0; i < D && nval == val; ++i) {
+        if (index[i] > 0 && inside(j - strides[i]) &&
+            lbuf[j - strides[i]] != val) { nval = lbuf[j - strides[i]]; }
+        else if (index[i] + 1 < (long)size[i] && inside(j + strides[i]) &&
+                 lbuf[j + strides[i]] != val) {
+          nval = lbuf[j + strides[i]];
+        }
+      }
+      if (nval != val) {
+        auto eit = edges.emplace
+            (val < nval? std::make_pair(val, nval): std::make_pair(nval, val),
+             Edge());
+        auto& e = eit.first->second;
+        if (eit.second && useHist) { e.hist = m_hist; }
+        e.sides |= val < nval? 1: 2;
+        e.add(pbuf[j], useHist);
+      }
+    }
+    if (runLength > 0) { m_sizes[runKey] += runLength; }
+    // Boundaries have to be mutual
+    for (auto eit = edges.begin(); eit != edges.end();) {
+      if (eit->second.mutual()) { ++eit; }
+      else { eit = edges.erase(eit); }
+    }
+    std::unordered_set<Key> keys;
+    for (auto const& ep: edges) {
+      keys.insert(ep.first.first);
+      keys.insert(ep.first.second);
+    }
+    m_nRegion = keys.size();
+  }
+
+  // Sorted keys of mutual boundaries
+  void boundaryKeys (std::vector<KeyPair>& keys) const {
+    keys.reserve(keys.size() + edges.size());
+    for (auto const& ep: edges) { keys.push_back(ep.first); }
+    std::sort(keys.begin(), keys.end());
+  }
+
+  // Number of regions with at least one boundary
+  virtual uint size () const { return m_nRegion; }
+
+  // Largest key of a region inside mask
+  virtual Key maxKey () const { return m_maxKey; }
+
+  virtual void merge (Key r0, Key r1, Key r2) {
+    m_parent[r0] = r2;
+    m_parent[r1] = r2;
+    m_sizes[r2] = clookup(m_sizes, r0, 0u) + clookup(m_sizes, r1, 0u);
+    if (r2 > m_maxKey) { m_maxKey = r2; }
+  }
+
+  // Current (merged) key of region r
+  virtual Key find (Key r) {
+    Key root = r;
+    for (auto pit = m_parent.find(root); pit != m_parent.end();
+         pit = m_parent.find(root)) { root = pit->second; }
+    while (r != root) {
+      auto& p = m_parent[r];
+      r = p;
+      p = root;
+    }
+    return root;
+  }
+
+  virtual uint regionSize (Key r) const { return clookup(m_sizes, r, 0u); }
+
+  // Approximate median, see QuantileSketch for error bound
+  virtual double median (Edge const& e) const {
+    if (e.n == 0) { return DUMMY; }
+    if (e.hist.empty()) { return sdivide(e.sum, e.n, 0.0); }
+    return e.hist.median();
+  }
+
+  virtual double mean (Edge const& e) const
+  { return sdivide(e.sum, e.n, 0.0); }
+};
+
+};
+
+#endif
@@ -61,8 +61,7 @@ public:
     }
     else {
       genPointMap(*pPointMap, image, mask);
-      genContourMap
-          (*pBorderMap, *pBoundaryMap, *pPointMap, image, mask);
+      genContourMap(*pBorderMap, *pBoundaryMap, image, mask);
       // std::cout << "genContourMap. Got " << pBoundaryMap->size() << " boundary points" << std::endl;
       // std::cout << "genContourMap. Got " << pBorderMap->size() << " border points" << std::endl;
       // std::cout << "initContour..." << std::endl;
@@ -93,10 +92,8 @@ public:
       if (pBorder) { it->second.border[pp.first] = pBorder; }
       auto bnit = pBoundaryMap->find(pp.first);
       if (bnit != pBoundaryMap->unary().end()) {
-        for (auto const& bp: bnit->second) {
-          it->second.boundary.emplace
-              (std::make_pair(pp.first, bp.first), bp.second);
-        }
+        for (auto const& bp: bnit->second)
+        { it->second.addBoundary(pp.first, bp.first, bp.second); }
       }
     }
   }
@@ -110,13 +107,29 @@ public:
       auto it = Super::insert(std::make_pair(pp.first, Region())).first;
       auto pBorder = cpointer(*pBorderMap, pp.first);
       if (pBorder) { it->second.border[pp.first] = pBorder; }
-      for (auto const& bp: pp.second) {
-        it->second.boundary.emplace
-            (std::make_pair(pp.first, bp.first), bp.second);
-      }
+      for (auto const& bp: pp.second)
+      { it->second.addBoundary(pp.first, bp.first, bp.second); }
     }
   }
 
+  // Approximate bytes held by point storage and region indices
+  virtual size_t bytes () const {
+    size_t ret = 0;
+    for (auto const* pm: {pPointMap.get(), pBorderMap.get()}) {
+      for (auto const& pp: *pm)
+      { ret += sizeof(pp) + pp.second.capacity() * sizeof(TPoint); }
+    }
+    for (auto const& pp: *pBoundaryMap)
+    { ret += sizeof(pp) + pp.second.capacity() * sizeof(TPoint); }
+    for (auto const& rp: *this) {
+      ret += sizeof(rp) +
+          (rp.second.mapSize() + rp.second.border.mapSize() +
+           rp.second.boundary.mapSize()) *
+          (sizeof(Points*) + sizeof(std::pair<TKey, TKey>));
+    }
+    return ret;
+  }
+
   virtual iterator merge (TKey r0, TKey r1, TKey r2) {
     auto it = citerator(*static_cast<Super*>(this), r2);
     // std::cout << "merging regions ...";
@@ -0,0 +1,340 @@
+#ifndef _glia_type_region_store_hxx_
+#define _glia_type_region_store_hxx_
+
+#include "glia_image.hxx"
+#include "type/hash.hxx"
+#include "type/label_buckets.hxx"
+#include "type/neighbor.hxx"
+#include "type/object.hxx"
+#include "type/point.hxx"
+
+namespace glia {
+
+// Compact region storage, an alternative to TRegionMap
+// Pixels are kept as uint32 linear offsets into the image buffer, grouped
+// by region in one contiguous array (CSR); borders and boundary pieces
+// (points of a facing b) are grouped the same way
+// Contours follow genContourMap: a point is a boundary point of its first
+// differing neighbor (order: -x, +x, -y, +y, ...), otherwise a border
+// point if it misses a neighbor (image edge or mask)
+// Merges only add a node with two children; a merged region is visited
+// through its base regions, so nothing is copied
+template <typename TKey, uint D>
+class TRegionStore : public Object {
+ public:
+  typedef Object SuperObject;
+  typedef TRegionStore<TKey, D> Self;
+  typedef std::shared_ptr<Self> Pointer;
+  typedef std::shared_ptr<const Self> ConstPointer;
+  typedef std::weak_ptr<Self> WeakPointer;
+  typedef TKey Key;
+  typedef std::pair<TKey, TKey> KeyPair;
+  typedef glia::Point<D> Point;
+
+  // Point set given as spans of one offset array
+  // Same traverse/size interface as TPointPtrMap
+  class Points {
+   public:
+    typedef typename Self::Point Point;
+
+    Points () {}
+
+    Points (Self const* store, std::vector<uint32> const* offsets)
+        : m_store(store), m_offsets(offsets) {}
+
+    uint size () const { return m_n; }
+
+    bool empty () const { return m_n == 0; }
+
+    template <typename Func> void traverse (Func f) const {
+      for (auto const& sp: m_spans) {
+        for (uint32 i = sp.first; i < sp.second; ++i)
+        { f(m_store->point((*m_offsets)[i])); }
+      }
+    }
+
+    // f(uint32 offset)
+    template <typename Func> void traverseOffsets (Func f) const {
+      for (auto const& sp: m_spans)
+      { for (uint32 i = sp.first; i < sp.second; ++i) { f((*m_offsets)[i]); } }
+    }
+
+    void add (uint32 begin, uint32 end) {
+      if (begin == end) { return; }
+      if (!m_spans.empty() && m_spans.back().second == begin)
+      { m_spans.back().second = end; }
+      else { m_spans.emplace_back(begin, end); }
+      m_n += end - begin;
+    }
+
+   protected:
+    Self const* m_store = nullptr;
+    std::vector<uint32> const* m_offsets = nullptr;
+    std::vector<std::pair<uint32, uint32>> m_spans;
+    uint m_n = 0;
+  };
+
+  // Region points with border, as used by RegionFeats::Acc::addRegion
+  class Region : public Points {
+   public:
+    Points border;
+
+    Region () {}
+
+    Region (Points const& points, Points const& border)
+        : Points(points), border(border) {}
+  };
+
+ protected:
+  static const uint32 NONE = std::numeric_limits<uint32>::max();
+
+  struct Node {
+    uint32 base;        // Base region index, NONE if merged
+    uint32 child0, child1;
+    uint32 size;
+  };
+
+  std::array<long, D> m_lower;   // Buffered region index
+  std::array<long, D> m_size;
+  std::array<long, D> m_strides;
+  TLabelBuckets<Key, D> m_buckets;             // Points by base index
+  std::vector<Node> m_nodes;                   // Base nodes come first
+  std::unordered_map<Key, uint32> m_nodeOf;    // Key -> node
+  std::vector<uint32> m_border, m_borderStarts;
+  std::vector<uint32> m_boundary, m_pieceStarts;
+  std::vector<KeyPair> m_pieceKeys;            // Sorted by (base a, c)
+  std::vector<uint32> m_basePieceStarts;       // Base index -> pieces
+  std::unordered_map<KeyPair, uint32> m_pieceOf;
+
+ public:
+  TRegionStore () {}
+
+  template <typename TImagePtr, typename TMaskPtr>
+  TRegionStore (TImagePtr const& image, TMaskPtr const& mask)
+  { set(image, mask); }
+
+  ~TRegionStore () override {}
+
+  // Bucket points by label, then find contours
+  template <typename TImagePtr, typename TMaskPtr> void
+  set (TImagePtr const& image, TMaskPtr const& mask) {
+    clear();
+    auto const& region = image->GetBufferedRegion();
+    long n = 1;
+    for (int i = 0; i < D; ++i) {
+      m_lower[i] = region.GetIndex()[i];
+      m_size[i] = region.GetSize()[i];
+      m_strides[i] = n;
+      n *= m_size[i];
+    }
+    if (n > (long)NONE) { perr("Error: image too large for region store..."); }
+    // Bases numbered in key order
+    m_buckets.set(image, mask, region, false);
+    uint32 nBase = m_buckets.size();
+    m_nodes.reserve(nBase);
+    for (uint32 a = 0; a < nBase; ++a) {
+      m_nodeOf[m_buckets.key(a)] = a;
+      m_nodes.push_back(Node{a, NONE, NONE, m_buckets.count(a)});
+    }
+    Key lastKey = 0;
+    uint32 lastBase = NONE;
+    auto baseOf = [this, &lastKey, &lastBase](Key key) -> uint32 {
+      if (lastBase == NONE || key != lastKey) {
+        lastKey = key;
+        lastBase = m_nodeOf.find(key)->second;
+      }
+      return lastBase;
+    };
+    // (base a, key c, offset) and (base, offset), in raster order
+    typedef TImageVal<TImagePtr> Val;
+    std::vector<std::tuple<uint32, Key, uint32>> bpix;
+    std::vector<std::pair<uint32, uint32>> epix;
+    traverseContourPoints
+        (image, mask, region, [&baseOf, &bpix, &epix]
+         (itk::Index<D> const& point, long j, Val val, Val nval) {
+          uint32 a = baseOf(val);
+          if (nval != val) { bpix.emplace_back(a, nval, j); }
+          else { epix.emplace_back(a, j); }
+        });
+    // Borders
+    m_borderStarts.assign(nBase + 1, 0);
+    for (auto const& ep: epix) { ++m_borderStarts[ep.first + 1]; }
+    for (uint32 a = 0; a < nBase; ++a)
+    { m_borderStarts[a + 1] += m_borderStarts[a]; }
+    m_border.resize(epix.size());
+    std::vector<uint32> cursor
+        (m_borderStarts.begin(), m_borderStarts.end() - 1);
+    for (auto const& ep: epix) { m_border[cursor[ep.first]++] = ep.second; }
+    // Boundary pieces, raster order kept within a piece
+    std::stable_sort(bpix.begin(), bpix.end(), [](
+        std::tuple<uint32, Key, uint32> const& x,
+        std::tuple<uint32, Key, uint32> const& y) {
+      return std::get<0>(x) < std::get<0>(y) ||
+          (std::get<0>(x) == std::get<0>(y) && std::get<1>(x) < std::get<1>(y));
+    });
+    m_boundary.reserve(bpix.size());
+    m_basePieceStarts.assign(nBase + 1, 0);
+    for (auto const& bp: bpix) {
+      uint32 a = std::get<0>(bp);
+      auto key = std::make_pair(m_buckets.key(a), std::get<1>(bp));
+      if (m_pieceKeys.empty() || m_pieceKeys.back() != key) {
+        m_pieceOf[key] = m_pieceKeys.size();
+        m_pieceKeys.push_back(key);
+        m_pieceStarts.push_back(m_boundary.size());
+        ++m_basePieceStarts[a + 1];
+      }
+      m_boundary.push_back(std::get<2>(bp));
+    }
+    m_pieceStarts.push_back(m_boundary.size());
+    for (uint32 a = 0; a < nBase; ++a)
+    { m_basePieceStarts[a + 1] += m_basePieceStarts[a]; }
+  }
+
+  void clear () {
+    m_buckets = TLabelBuckets<Key, D>();
+    m_nodes.clear();
+    m_nodeOf.clear();
+    m_border.clear();
+    m_borderStarts.clear();
+    m_boundary.clear();
+    m_pieceStarts.clear();
+    m_pieceKeys.clear();
+    m_basePieceStarts.clear();
+    m_pieceOf.clear();
+  }
+
+  // Record merge of r0 and r1 into r2 in O(1)
+  // r0 and r1 stay accessible unless r2 reuses their key
+  virtual void merge (Key r0, Key r1, Key r2) {
+    uint32 n0 = node(r0), n1 = node(r1);
+    m_nodes.push_back
+        (Node{NONE, n0, n1, m_nodes[n0].size + m_nodes[n1].size});
+    m_nodeOf[r2] = m_nodes.size() - 1;
+  }
+
+  // Number of keys, including merged regions
+  virtual uint size () const { return m_nodeOf.size(); }
+
+  virtual uint baseSize () const { return m_buckets.size(); }
+
+  virtual Key baseKey (uint i) const { return m_buckets.key(i); }
+
+  virtual Key maxKey () const {
+    Key ret = m_nodeOf.begin()->first;
+    for (auto const& np: m_nodeOf)
+    { if (ret < np.first) { ret = np.first; } }
+    return ret;
+  }
+
+  virtual bool contains (Key r) const { return m_nodeOf.count(r) > 0; }
+
+  virtual uint regionSize (Key r) const { return m_nodes[node(r)].size; }
+
+  Points points (Key r) const
+  { return group(r, m_buckets.offsets(), m_buckets.starts()); }
+
+  Points border (Key r) const
+  { return group(r, m_border, m_borderStarts); }
+
+  Region region (Key r) const
+  { return Region(points(r), border(r)); }
+
+  // Boundary points of r0 facing r1
+  Points boundary (Key r0, Key r1) const {
+    Points ret(this, &m_boundary);
+    std::vector<uint32> bases0, bases1;
+    getBases(bases0, node(r0));
+    getBases(bases1, node(r1));
+    std::unordered_set<Key> keys1;
+    for (auto b: bases1) { keys1.insert(m_buckets.key(b)); }
+    for (auto a: bases0) {
+      for (uint32 i = m_basePieceStarts[a]; i < m_basePieceStarts[a + 1];
+           ++i) {
+        if (keys1.count(m_pieceKeys[i].second) > 0)
+        { ret.add(m_pieceStarts[i], m_pieceStarts[i + 1]); }
+      }
+    }
+    return ret;
+  }
+
+  // Boundary pieces (a, c) between base regions, sorted by a
+  virtual uint pieceSize () const { return m_pieceKeys.size(); }
+
+  virtual KeyPair const& pieceKey (uint i) const { return m_pieceKeys[i]; }
+
+  Points piece (uint i) const {
+    Points ret(this, &m_boundary);
+    ret.add(m_pieceStarts[i], m_pieceStarts[i + 1]);
+    return ret;
+  }
+
+  // Whether the opposite piece (c, a) exists
+  virtual bool mutual (uint i) const {
+    auto const& key = m_pieceKeys[i];
+    return m_pieceOf.count(std::make_pair(key.second, key.first)) > 0;
+  }
+
+  // Sorted keys (r0, r1), r0 < r1, of mutual base boundaries
+  void boundaryKeys (std::vector<KeyPair>& keys) const {
+    for (uint i = 0; i < m_pieceKeys.size(); ++i) {
+      auto const& key = m_pieceKeys[i];
+      if (key.first < key.second && mutual(i)) { keys.push_back(key); }
+    }
+    std::sort(keys.begin(), keys.end());
+  }
+
+  Point point (uint32 offset) const {
+    Point ret;
+    for (int i = 0; i < D; ++i)
+    { ret[i] = m_lower[i] + (offset / m_strides[i]) % m_size[i]; }
+    return ret;
+  }
+
+  // Approximate bytes held
+  virtual size_t bytes () const {
+    size_t ret = sizeof(Self) + m_buckets.bytes();
+    for (auto const* v: {&m_border,
+            &m_borderStarts, &m_boundary, &m_pieceStarts,
+            &m_basePieceStarts}) { ret += v->capacity() * sizeof(uint32); }
+    ret += m_nodes.capacity() * sizeof(Node) +
+        m_pieceKeys.capacity() * sizeof(KeyPair) +
+        m_nodeOf.size() * (sizeof(Key) + sizeof(uint32) + sizeof(void*)) +
+        m_pieceOf.size() * (sizeof(KeyPair) + sizeof(uint32) + sizeof(void*));
+    return ret;
+  }
+
+ protected:
+  uint32 node (Key r) const {
+    auto nit = m_nodeOf.find(r);
+    if (nit == m_nodeOf.end())
+    { perr("Error: region not found in region store..."); }
+    return nit->second;
+  }
+
+  // Base regions under node, in merge order
+  void getBases (std::vector<uint32>& bases, uint32 n) const {
+    std::vector<uint32> stack{n};
+    while (!stack.empty()) {
+      auto const& nd = m_nodes[stack.back()];
+      stack.pop_back();
+      if (nd.base != NONE) { bases.push_back(nd.base); }
+      else {
+        stack.push_back(nd.child1);
+        stack.push_back(nd.child0);
+      }
+    }
+  }
+
+  Points group (Key r, std::vector<uint32> const& offsets,
+                std::vector<uint32> const& starts) const {
+    Points ret(this, &offsets);
+    std::vector<uint32> bases;
+    getBases(bases, node(r));
+    for (auto b: bases) { ret.add(starts[b], starts[b + 1]); }
+    return ret;
+  }
+};
+
+};
+
+#endif
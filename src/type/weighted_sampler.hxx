@@ -0,0 +1,97 @@
+#ifndef _glia_type_weighted_sampler_hxx_
+#define _glia_type_weighted_sampler_hxx_
+
+#include "glia_base.hxx"
+
+namespace glia {
+
+// Sum tree over item weights for sampling by weight
+// set, push_back and sample cost O(log n)
+// Inner nodes are recomputed from their children, never updated by
+// deltas, so zero-weight items can never be sampled
+class WeightedSampler {
+ protected:
+  uint m_n = 0;
+  uint m_cap = 0;                // Number of leaves, power of two
+  std::vector<double> m_tree;    // Root at 1, leaves at [m_cap, 2 * m_cap)
+
+ public:
+  WeightedSampler () {}
+
+  WeightedSampler (std::vector<double> const& weights) { assign(weights); }
+
+  void clear () {
+    m_n = 0;
+    m_cap = 0;
+    m_tree.clear();
+  }
+
+  void assign (std::vector<double> const& weights) {
+    m_n = weights.size();
+    m_cap = 1;
+    while (m_cap < m_n) { m_cap <<= 1; }
+    m_tree.assign(2 * m_cap, 0.0);
+    for (uint i = 0; i < m_n; ++i) {
+      check(weights[i]);
+      m_tree[m_cap + i] = weights[i];
+    }
+    for (uint j = m_cap - 1; j > 0; --j)
+    { m_tree[j] = m_tree[2 * j] + m_tree[2 * j + 1]; }
+  }
+
+  // Append item and return its index
+  uint push_back (double w) {
+    if (m_n == m_cap) { grow(); }
+    set(m_n, w);
+    return m_n++;
+  }
+
+  // Requires i < size()
+  void set (uint i, double w) {
+    check(w);
+    uint j = m_cap + i;
+    m_tree[j] = w;
+    for (j >>= 1; j > 0; j >>= 1)
+    { m_tree[j] = m_tree[2 * j] + m_tree[2 * j + 1]; }
+  }
+
+  double weight (uint i) const { return m_tree[m_cap + i]; }
+
+  double total () const { return m_cap > 0? m_tree[1]: 0.0; }
+
+  uint size () const { return m_n; }
+
+  // u: uniform random number in [0, 1)
+  // Return index of sampled item, or -1 if total weight is zero
+  int sample (double u) const {
+    if (total() <= 0.0) { return -1; }
+    double x = u * total();
+    uint j = 1;
+    while (j < m_cap) {
+      j <<= 1;
+      // Rounding can push x past the left sum; never enter empty subtrees
+      if (m_tree[j + 1] > 0.0 && (x >= m_tree[j] || m_tree[j] <= 0.0)) {
+        x -= m_tree[j];
+        ++j;
+      }
+    }
+    return j - m_cap;
+  }
+
+ protected:
+  void grow () {
+    std::vector<double> weights(m_tree.begin() + m_cap,
+                                m_tree.begin() + m_cap + m_n);
+    uint n = m_n;
+    weights.resize(std::max<uint>(2 * m_cap, 1), 0.0);
+    assign(weights);
+    m_n = n;
+  }
+
+  static void check (double w)
+  { if (!(w >= 0.0)) { perr("Error: invalid sampling weight..."); } }
+};
+
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define _glia_util_image_hxx_
 
 #include "glia_image.hxx"
+#include "type/key_index.hxx"
 #include "type/neighbor.hxx"
 #include "util/struct.hxx"
 #include "util/container.hxx"
@@ -212,29 +213,42 @@ transformImage (
     TImagePtr& image, std::unordered_map<TImageVal<TImagePtr>,
     TImageVal<TImagePtr>> const& lmap, TMaskPtr const& mask)
 {
-  for (TImageIIt<TImagePtr> iit(image, image->GetRequestedRegion());
-       !iit.IsAtEnd(); ++iit) {
-    if (mask.IsNull() ||
-        mask->GetPixel(iit.GetIndex()) != MASK_OUT_VAL)
-    { iit.Set(lmap.find(iit.Get())->second); }
-  }
+  transformImage(image, lmap, mask, false);
 }
 
 
 // If fillMissing == true, use fill pixels that miss label mappings
 // with BG_VAL
+// lmap is compacted once so pixels are mapped without hashing
 template <typename TImagePtr, typename TMaskPtr> void
 transformImage (
     TImagePtr& image, std::unordered_map<TImageVal<TImagePtr>,
     TImageVal<TImagePtr>> const& lmap, TMaskPtr const& mask,
     bool fillMissing)
 {
+  typedef TImageVal<TImagePtr> TVal;
+  TKeyIndex<TVal> kidx;
+  std::vector<TVal> vals;
+  kidx.reserve(lmap.size());
+  vals.reserve(lmap.size());
+  for (auto const& lp: lmap) {
+    kidx.insert(lp.first);
+    vals.push_back(lp.second);
+  }
+  TVal lastVal = TVal();
+  uint32 lastIndex = TKeyIndex<TVal>::NONE;
+  bool hasLast = false;
   for (TImageIIt<TImagePtr> iit(image, image->GetRequestedRegion());
        !iit.IsAtEnd(); ++iit) {
     if (mask.IsNull() ||
         mask->GetPixel(iit.GetIndex()) != MASK_OUT_VAL) {
-      auto lit = lmap.find(iit.Get());
-      if (lit != lmap.end()) { iit.Set(lit->second); }
+      TVal val = iit.Get();
+      if (!hasLast || !(val == lastVal)) {
+        lastVal = val;
+        lastIndex = kidx.find(val);
+        hasLast = true;
+      }
+      if (lastIndex != TKeyIndex<TVal>::NONE) { iit.Set(vals[lastIndex]); }
       else if (fillMissing) { iit.Set(BG_VAL); }
     }
   }
@@ -13,28 +13,13 @@ template <typename TPoints, typename TImagePtr>
 void histc(std::vector<uint> &hc, TImagePtr const &image, TPoints const &points,
            uint bin, std::pair<double, double> const &range) {
   hc.resize(bin, 0.0);
-  double interval = (range.second - range.first) / bin;
-  std::vector<double> bounds(bin);
-  bounds[0] = interval;
-  for (auto i = 1; i < bin; ++i) {
-    bounds[i] = bounds[i - 1] + interval;
-  }
-  points.traverse(
-      [&image, &range, &bounds, &hc, bin](typename TPoints::Point const &p) {
-        auto val = image->GetPixel(p);
-        if (val > range.first && val < range.second) {
-          for (auto i = 0; i < bin; ++i) {
-            if (val < bounds[i]) {
-              ++hc[i];
-              break;
-            }
-          }
-        } else if (val <= range.first) {
-          ++hc[0];
-        } else {
-          ++hc[bin - 1];
-        }
-      });
+  HistBins bins(bin, range);
+  points.traverse([&image, &bins, &hc](typename TPoints::Point const &p) {
+    int i = bins(image->GetPixel(p));
+    if (i >= 0) {
+      ++hc[i];
+    }
+  });
 }
 
 template <typename TPoints, typename TImagePtr>
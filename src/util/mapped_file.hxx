@@ -0,0 +1,57 @@
+#ifndef _glia_util_mapped_file_hxx_
+#define _glia_util_mapped_file_hxx_
+
+#include "glia_base.hxx"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace glia {
+
+// Read-only memory map of a whole file
+// Pages are shared by all processes mapping the same file
+class MappedFile {
+ public:
+  typedef MappedFile Self;
+  typedef std::shared_ptr<Self> Pointer;
+  typedef std::shared_ptr<const Self> ConstPointer;
+
+ protected:
+  void* m_data = nullptr;
+  size_t m_size = 0;
+
+ public:
+  MappedFile (std::string const& file) {
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) { perr("Error: cannot open " + file + "..."); }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      perr("Error: cannot stat " + file + "...");
+    }
+    m_size = st.st_size;
+    if (m_size > 0) {
+      m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (m_data == MAP_FAILED) {
+        ::close(fd);
+        perr("Error: cannot map " + file + "...");
+      }
+    }
+    ::close(fd);
+  }
+
+  ~MappedFile () { if (m_data) { ::munmap(m_data, m_size); } }
+
+  MappedFile (Self const&) = delete;
+
+  Self& operator= (Self const&) = delete;
+
+  char const* data () const { return static_cast<char const*>(m_data); }
+
+  size_t size () const { return m_size; }
+};
+
+};
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef _glia_util_metrics_hxx_
+#define _glia_util_metrics_hxx_
+
+#include "glia_base.hxx"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
+// Named timers, counters and gauges for hot paths
+// Instrument code with the macros below; they compile to nothing unless
+// GLIA_METRICS is defined, so uninstrumented builds pay nothing
+// Each use takes clock reads or atomics shared by all threads, so
+// instrument whole calls, not per-merge or per-boundary loops
+//   GLIA_TIMER(name): time enclosing scope
+//   GLIA_COUNT(name, n): add n to counter
+//   GLIA_GAUGE(name, v): set gauge to v
+// Names are string literals; handles are looked up once per call site
+#ifdef GLIA_METRICS
+#define GLIA_METRICS_CAT_(a, b) a##b
+#define GLIA_METRICS_CAT(a, b) GLIA_METRICS_CAT_(a, b)
+#define GLIA_TIMER(name)                                                \
+  static auto& GLIA_METRICS_CAT(_glia_timer_, __LINE__) =               \
+      glia::metrics::Registry::instance().timer(name);                  \
+  glia::metrics::ScopedTimer GLIA_METRICS_CAT(_glia_scoped_timer_,      \
+                                              __LINE__)                 \
+  (GLIA_METRICS_CAT(_glia_timer_, __LINE__))
+#define GLIA_COUNT(name, n)                                             \
+  do {                                                                  \
+    static auto& _glia_counter =                                        \
+        glia::metrics::Registry::instance().counter(name);              \
+    _glia_counter.add(n);                                               \
+  } while (0)
+#define GLIA_GAUGE(name, v)                                             \
+  do {                                                                  \
+    static auto& _glia_gauge =                                          \
+        glia::metrics::Registry::instance().gauge(name);                \
+    _glia_gauge.set(v);                                                 \
+  } while (0)
+#else
+#define GLIA_TIMER(name)
+#define GLIA_COUNT(name, n) do {} while (0)
+#define GLIA_GAUGE(name, v) do {} while (0)
+#endif
+
+namespace glia {
+namespace metrics {
+
+typedef std::chrono::steady_clock Clock;
+
+class Registry;
+
+// Aggregated durations in seconds
+struct TimerStats {
+  uint64 count = 0;
+  double total = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+};
+
+
+// Durations are accumulated in per-thread shards and merged on read, so
+// timers closing on many threads do not contend on one lock
+class Timer {
+ public:
+  Timer (std::string const& name) : m_name(name) {}
+
+  std::string const& name () const { return m_name; }
+
+  void add (double seconds) {
+    auto& shard = m_shards[shardIndex()];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto& s = shard.stats;
+    if (s.count == 0 || seconds < s.min) { s.min = seconds; }
+    if (seconds > s.max) { s.max = seconds; }
+    s.total += seconds;
+    ++s.count;
+  }
+
+  TimerStats stats () const {
+    TimerStats ret;
+    for (auto const& shard: m_shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto const& s = shard.stats;
+      if (s.count == 0) { continue; }
+      if (ret.count == 0 || s.min < ret.min) { ret.min = s.min; }
+      if (s.max > ret.max) { ret.max = s.max; }
+      ret.total += s.total;
+      ret.count += s.count;
+    }
+    return ret;
+  }
+
+  void reset () {
+    for (auto& shard: m_shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.stats = TimerStats();
+    }
+  }
+
+ protected:
+  static const uint N_SHARD = 64;
+
+  // Own cache line each; threads beyond N_SHARD share shards
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    TimerStats stats;
+  };
+
+  std::string m_name;
+  std::array<Shard, N_SHARD> m_shards;
+
+  static uint shardIndex () {
+    static std::atomic<uint> next{0};
+    thread_local uint i = next.fetch_add(1, std::memory_order_relaxed) %
+        N_SHARD;
+    return i;
+  }
+};
+
+
+class Counter {
+ public:
+  Counter (std::string const& name) : m_name(name) {}
+
+  std::string const& name () const { return m_name; }
+
+  void add (int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+
+  int64_t value () const { return m_value.load(std::memory_order_relaxed); }
+
+  void reset () { m_value.store(0, std::memory_order_relaxed); }
+
+ protected:
+  std::string m_name;
+  std::atomic<int64_t> m_value{0};
+};
+
+
+// Last and largest value set
+class Gauge {
+ public:
+  Gauge (std::string const& name) : m_name(name) {}
+
+  std::string const& name () const { return m_name; }
+
+  inline void set (double v);
+
+  double value () const { return m_value.load(std::memory_order_relaxed); }
+
+  double max () const { return m_max.load(std::memory_order_relaxed); }
+
+  void reset () {
+    m_value.store(0.0, std::memory_order_relaxed);
+    m_max.store(0.0, std::memory_order_relaxed);
+  }
+
+ protected:
+  std::string m_name;
+  std::atomic<double> m_value{0.0};
+  std::atomic<double> m_max{0.0};
+};
+
+
+// Chrome trace event: complete event ('X') or counter sample ('C')
+struct TraceEvent {
+  std::string const* name;
+  char phase;
+  uint32 tid;
+  double ts;      // Microseconds since registry creation
+  double value;   // Duration in microseconds for 'X', value for 'C'
+};
+
+
+// Process-wide owner of all metrics
+// Handles are never destroyed, so call sites may cache references
+class Registry {
+ public:
+  static Registry& instance () {
+    static Registry registry;
+    return registry;
+  }
+
+  Timer& timer (std::string const& name)
+  { return get(m_timers, name); }
+
+  Counter& counter (std::string const& name)
+  { return get(m_counters, name); }
+
+  Gauge& gauge (std::string const& name)
+  { return get(m_gauges, name); }
+
+  // Record trace events from now on, keeping at most maxEvents
+  void setTracing (bool on, size_t maxEvents = 1 << 20) {
+    std::lock_guard<std::mutex> lock(m_traceMutex);
+    m_maxEvents = maxEvents;
+    m_tracing.store(on, std::memory_order_relaxed);
+  }
+
+  bool tracing () const { return m_tracing.load(std::memory_order_relaxed); }
+
+  double now () const {
+    return std::chrono::duration<double, std::micro>
+        (Clock::now() - m_epoch).count();
+  }
+
+  void trace (std::string const& name, char phase, double ts, double value) {
+    std::lock_guard<std::mutex> lock(m_traceMutex);
+    if (m_events.size() >= m_maxEvents) {
+      ++m_nDropped;
+      return;
+    }
+    m_events.push_back(TraceEvent{&name, phase, tid(), ts, value});
+  }
+
+  // Zero all metrics and drop recorded trace events
+  void reset () {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (auto& tp: m_timers) { tp.second->reset(); }
+      for (auto& cp: m_counters) { cp.second->reset(); }
+      for (auto& gp: m_gauges) { gp.second->reset(); }
+    }
+    std::lock_guard<std::mutex> lock(m_traceMutex);
+    m_events.clear();
+    m_nDropped = 0;
+  }
+
+  // f(Timer const&), f(Counter const&), f(Gauge const&) in name order
+  template <typename TFunc> void traverseTimers (TFunc f) const
+  { traverse(m_timers, f); }
+
+  template <typename TFunc> void traverseCounters (TFunc f) const
+  { traverse(m_counters, f); }
+
+  template <typename TFunc> void traverseGauges (TFunc f) const
+  { traverse(m_gauges, f); }
+
+  // Write recorded events in Chrome trace event format
+  // (chrome://tracing, Perfetto)
+  bool writeChromeTrace (std::string const& file) const {
+    std::ofstream fs(file);
+    if (!fs.is_open()) { return false; }
+    std::lock_guard<std::mutex> lock(m_traceMutex);
+    fs << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    for (size_t i = 0; i < m_events.size(); ++i) {
+      auto const& e = m_events[i];
+      fs << (i == 0? "\n": ",\n") << "{\"name\":\"" << escape(*e.name)
+         << "\",\"ph\":\"" << e.phase << "\",\"pid\":0,\"tid\":" << e.tid
+         << ",\"ts\":" << e.ts;
+      if (e.phase == 'X') { fs << ",\"dur\":" << e.value << "}"; }
+      else { fs << ",\"args\":{\"value\":" << e.value << "}}"; }
+    }
+    fs << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":"
+       << m_nDropped << "}}\n";
+    return fs.good();
+  }
+
+ protected:
+  mutable std::mutex m_mutex;
+  std::map<std::string, std::unique_ptr<Timer>> m_timers;
+  std::map<std::string, std::unique_ptr<Counter>> m_counters;
+  std::map<std::string, std::unique_ptr<Gauge>> m_gauges;
+  Clock::time_point m_epoch = Clock::now();
+  std::atomic<bool> m_tracing{false};
+  mutable std::mutex m_traceMutex;
+  std::vector<TraceEvent> m_events;
+  size_t m_maxEvents = 1 << 20;
+  uint64 m_nDropped = 0;
+  std::unordered_map<std::thread::id, uint32> m_tids;
+
+  Registry () {}
+
+  template <typename T> T&
+  get (std::map<std::string, std::unique_ptr<T>>& m, std::string const& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& p = m[name];
+    if (!p) { p.reset(new T(name)); }
+    return *p;
+  }
+
+  template <typename T, typename TFunc> void
+  traverse (std::map<std::string, std::unique_ptr<T>> const& m,
+            TFunc f) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto const& p: m) { f(*p.second); }
+  }
+
+  // Small sequential thread id; called with m_traceMutex held
+  uint32 tid () {
+    return m_tids.emplace(std::this_thread::get_id(), m_tids.size())
+        .first->second;
+  }
+
+  static std::string escape (std::string const& s) {
+    std::string ret;
+    for (char c: s) {
+      if (c == '"' || c == '\\') { ret.push_back('\\'); }
+      ret.push_back(c);
+    }
+    return ret;
+  }
+};
+
+
+inline void Gauge::set (double v) {
+  m_value.store(v, std::memory_order_relaxed);
+  double m = m_max.load(std::memory_order_relaxed);
+  while (v > m && !m_max.compare_exchange_weak
+         (m, v, std::memory_order_relaxed)) {}
+  auto& registry = Registry::instance();
+  if (registry.tracing()) { registry.trace(m_name, 'C', registry.now(), v); }
+}
+
+
+// Add lifetime of this object to timer
+class ScopedTimer {
+ public:
+  ScopedTimer (Timer& timer) : m_timer(timer), m_start(Clock::now()) {}
+
+  ~ScopedTimer () {
+    auto end = Clock::now();
+    m_timer.add(std::chrono::duration<double>(end - m_start).count());
+    auto& registry = Registry::instance();
+    if (registry.tracing()) {
+      double dur = std::chrono::duration<double, std::micro>
+          (end - m_start).count();
+      registry.trace(m_timer.name(), 'X', registry.now() - dur, dur);
+    }
+  }
+
+ protected:
+  Timer& m_timer;
+  Clock::time_point m_start;
+};
+
+};
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/discrete_distribution.hpp>
 #include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_01.hpp>
 #include <boost/random/variate_generator.hpp>
 
 namespace glia {
@@ -42,6 +43,16 @@ inline int sample (std::vector<double> const& weights, const long seed)
 }
 
 
+// Uniform random numbers in [0, 1)
+inline boost::variate_generator<boost::mt19937, boost::uniform_01<>>
+    uniform01 (const long seed)
+{
+  boost::mt19937 rng(seed);
+  return boost::variate_generator<boost::mt19937, boost::uniform_01<>>
+      (rng, boost::uniform_01<>());
+}
+
+
 inline boost::variate_generator
 <boost::mt19937, boost::normal_distribution<>>
     gaussian (double mean, double stddev, const long seed)
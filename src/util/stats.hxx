@@ -91,28 +91,55 @@ amedian (TContainer& data)
 }
 
 
+// Bin lookup of histc
+// Bin i takes in-range values below bounds[i], bounds being accumulated
+// bin widths (from 0, not range.first; in-range values past the last
+// bound are dropped); values at or below range.first go to the first
+// bin, others to the last
+// The bin is guessed arithmetically and checked against the same
+// bounds, so results match a scan of the bounds at O(1) per value
+class HistBins {
+ public:
+  HistBins () {}
+
+  HistBins (uint bin, std::pair<double, double> const& range)
+      : m_bin(bin), m_lower(range.first), m_upper(range.second),
+        m_interval((range.second - range.first) / bin), m_bounds(bin) {
+    for (int i = 0; i < m_bin; ++i)
+    { m_bounds[i] = i == 0? m_interval: m_bounds[i - 1] + m_interval; }
+  }
+
+  int size () const { return m_bin; }
+
+  // Bin of val, or -1 if dropped
+  int operator() (double val) const {
+    if (val > m_lower && val < m_upper) {
+      double x = val / m_interval;
+      int i = x < 1.0? 0: (x < m_bin? (int)x: m_bin);
+      while (i > 0 && val < m_bounds[i - 1]) { --i; }
+      while (i < m_bin && !(val < m_bounds[i])) { ++i; }
+      return i < m_bin? i: -1;
+    }
+    return val <= m_lower? 0: m_bin - 1;
+  }
+
+ protected:
+  int m_bin = 0;
+  double m_lower = 0.0, m_upper = 0.0, m_interval = 0.0;
+  std::vector<double> m_bounds;
+};
+
+
 template <typename TContainer> void
 histc (std::vector<uint>& hc, TContainer const& data, uint bin,
        std::pair<double, double> const& range)
 {
   hc.resize(bin, 0);
   if (data.empty()) { return; }
-  double interval = (range.second - range.first) / bin;
-  std::vector<double> bounds(bin);
-  bounds[0] = interval;
-  for (auto i = 1; i < bin; ++i)
-  { bounds[i] = bounds[i - 1] + interval; }
+  HistBins bins(bin, range);
   for (auto it = data.begin(); it != data.end(); ++it) {
-    if (*it > range.first && *it < range.second) {
-      for (auto i = 0; i < bin; ++i) {
-        if (*it < bounds[i]) {
-          ++hc[i];
-          break;
-        }
-      }
-    }
-    else if (*it <= range.first) { ++hc[0]; }
-    else { ++hc[bin - 1]; }
+    int i = bins(*it);
+    if (i >= 0) { ++hc[i]; }
   }
 }
 
@@ -2,6 +2,7 @@
 #define _glia_util_struct_hxx_
 
 #include "type/hash.hxx"
+#include "type/label_buckets.hxx"
 #include "type/neighbor.hxx"
 #include "util/container.hxx"
 
@@ -50,44 +51,32 @@ getPoints (TPoints& points, TImagePtr const& image,
 template <typename TSet, typename TImagePtr, typename TMaskPtr> void
 getKeys (TSet& keys, TImagePtr const& image, TMaskPtr const& mask)
 {
-  for (TImageCIIt<TImagePtr> iit(image, image->GetRequestedRegion());
-       !iit.IsAtEnd(); ++iit) {
-    if (mask.IsNull() || mask->GetPixel(iit.GetIndex()) != MASK_OUT_VAL)
-    { keys.insert(iit.Value()); }
-  }
+  TLabelBuckets<TImageVal<TImagePtr>, TImage<TImagePtr>::ImageDimension>
+      buckets(image, mask, true);
+  keys.insert(buckets.keys().begin(), buckets.keys().end());
 }
 
 
 template <typename TCMap, typename TImagePtr, typename TMaskPtr> void
 genCountMap (TCMap& cmap, TImagePtr const& image, TMaskPtr const& mask)
 {
-  for (TImageCIIt<TImagePtr> iit(image, image->GetRequestedRegion());
-       !iit.IsAtEnd(); ++iit) {
-    auto& index = iit.GetIndex();
-    if (mask.IsNull() || mask->GetPixel(index) != MASK_OUT_VAL) {
-      auto key = iit.Value();
-      auto cit = cmap.find(key);
-      if (cit == cmap.end()) { cmap[key] = 1; }
-      else { ++cit->second; }
-    }
-  }
+  TLabelBuckets<typename TCMap::key_type, TImage<TImagePtr>::ImageDimension>
+      buckets(image, mask, true);
+  for (uint i = 0; i < buckets.size(); ++i)
+  { cmap[buckets.key(i)] += buckets.count(i); }
 }
 
 
 template <typename TPMap, typename TImagePtr, typename TMaskPtr> void
 genPointMap (TPMap& pmap, TImagePtr const& image, TMaskPtr mask)
 {
-  std::unordered_map<typename TPMap::key_type, uint> cmap;
-  genCountMap(cmap, image, mask);
-  for (auto const& cp: cmap) {
-    auto& p = pmap[cp.first];
-    p.reserve(cp.second);
-  }
-  for (TImageCIIt<TImagePtr> iit(image, image->GetRequestedRegion());
-       !iit.IsAtEnd(); ++iit) {
-    auto& index = iit.GetIndex();
-    if (mask.IsNull() || mask->GetPixel(index) != MASK_OUT_VAL)
-    { pmap[iit.Value()].push_back(index); }
+  TLabelBuckets<typename TPMap::key_type, TImage<TImagePtr>::ImageDimension>
+      buckets(image, mask, false);
+  for (uint i = 0; i < buckets.size(); ++i) {
+    auto& p = pmap[buckets.key(i)];
+    p.reserve(p.size() + buckets.count(i));
+    for (auto it = buckets.begin(i); it != buckets.end(i); ++it)
+    { p.push_back(buckets.index(*it)); }
   }
 }
 
@@ -124,24 +113,46 @@ genContourMap (TPMap& borderMap, TBMap& boundaryMap,
 }
 
 
+// Append (key, point) items to map buckets, one lookup per key
+// Items with the same key keep their order
+template <typename TMap, typename TItems> void
+appendGrouped (TMap& map, TItems& items)
+{
+  typedef typename TItems::value_type Item;
+  std::stable_sort(items.begin(), items.end(), [](
+      Item const& x, Item const& y) { return x.first < y.first; });
+  for (auto it = items.cbegin(); it != items.cend();) {
+    auto eit = it;
+    while (eit != items.cend() && eit->first == it->first) { ++eit; }
+    auto& points = map[it->first];
+    points.reserve(points.size() + (eit - it));
+    for (; it != eit; ++it) { points.push_back(it->second); }
+  }
+}
+
+
 // Generate border/boundary map using image/mask
+// Masked-out points are skipped
 template <typename TPMap, typename TBMap, typename TImagePtr,
           typename TMaskPtr> void
 genContourMap (TPMap& borderMap, TBMap& boundaryMap,
                TImagePtr const& image, TMaskPtr const& mask)
 {
-  for (TImageCIIt<TImagePtr> iit(image, image->GetRequestedRegion());
-       !iit.IsAtEnd(); ++iit) {
-    Point<TImage<TImagePtr>::ImageDimension> point(iit.GetIndex());
-    auto thisVal = image->GetPixel(point);
-    auto ct = getContourTraits(point, image, mask);
-    if (ct.first != thisVal) { // boundary point
-      // std::cout << "point: " << point << " bounds " << thisVal << "," << ct.first << std::endl;
-      boundaryMap[std::make_pair(thisVal, ct.first)].push_back(point);
-    }
-    else if (ct.second) // border point
-    { borderMap[thisVal].push_back(point); }
-  }
+  const UInt D = TImage<TImagePtr>::ImageDimension;
+  typedef TImageVal<TImagePtr> Val;
+  typedef typename TPMap::mapped_type::value_type TPoint;
+  std::vector<std::pair<typename TPMap::key_type, TPoint>> border;
+  std::vector<std::pair<typename TBMap::key_type, TPoint>> boundary;
+  traverseContourPoints
+      (image, mask, [&border, &boundary]
+       (itk::Index<D> const& point, long offset, Val val, Val nval) {
+        if (nval != val) { // boundary point
+          boundary.emplace_back(std::make_pair(val, nval), point);
+        }
+        else { border.emplace_back(val, point); } // border point
+      });
+  appendGrouped(borderMap, border);
+  appendGrouped(boundaryMap, boundary);
 }
 
 
@@ -2,29 +2,34 @@
 #define _glia_util_struct_merge_hxx_
 
 #include "type/boundary_table.hxx"
+#include "type/key_index.hxx"
+#include "type/quantile_sketch.hxx"
 #include "type/tuple.hxx"
+#include "util/metrics.hxx"
 #include "util/stats.hxx"
-#include <iomanip>
 
 namespace glia {
 
-template <typename TBTItemData, typename TRegionMap, typename IFb, typename UFb,
-          typename IFsal, typename UFsal, typename CFunc>
-void genMergeOrderGreedy(std::vector<TTriple<typename TRegionMap::Key>> &order,
-                         std::vector<double> &saliencies, TRegionMap &rmap,
-                         bool updateRegion, IFb initFb, IFsal initFsal,
-                         UFb updateFb, UFsal updateFsal, CFunc fcond) {
-  std::cout << std::fixed;
-  std::cout << std::setprecision(2);
-
-  TBoundaryTable<TBTItemData, TRegionMap> bt(rmap, initFb, initFsal);
-  typename TRegionMap::Key keyToAssign = rmap.maxKey() + 1;
-  order.reserve(order.size() + rmap.size() - 1);
-  auto init_map_size = rmap.size();
-  saliencies.reserve(saliencies.size() + rmap.size() - 1);
-  while (!bt.empty()) {
+// Default number of quantile sketch bins for pb medians
+const uint PB_SKETCH_BIN = 256;
 
-    auto btit = bt.top(fcond);
+// Merging on an initialized boundary table
+// ftop(): boundary to merge next, bt.table().end() to stop
+// fmerge(r0, r1, r2): called after each merge is recorded
+template <typename TBoundaryTable, typename UFb, typename UFsal,
+          typename TFunc, typename MFunc>
+void genMergeOrder(std::vector<TTriple<typename TBoundaryTable::Key>> &order,
+                   std::vector<double> &saliencies, TBoundaryTable &bt,
+                   typename TBoundaryTable::Key keyToAssign, uint nRegions,
+                   UFb updateFb, UFsal updateFsal, TFunc ftop,
+                   MFunc fmerge) {
+  GLIA_TIMER("merge.order");
+  GLIA_COUNT("merge.boundaries", bt.size());
+  auto n0 = order.size();
+  order.reserve(order.size() + nRegions - 1);
+  saliencies.reserve(saliencies.size() + nRegions - 1);
+  while (!bt.empty()) {
+    auto btit = ftop();
     if (btit == bt.table().end()) {
       break;
     } // Stop if no item satifies
@@ -33,23 +38,72 @@ void genMergeOrderGreedy(std::vector<TTriple<typename TRegionMap::Key>> &order,
 
     // std::cout << "merging (" << r0 << "," << r1 << ") -> " << keyToAssign <<
     // std::endl;
-    order.push_back(TTriple<typename TRegionMap::Key>(r0, r1, keyToAssign));
-    std::cout << "merged: "
-              << ((float)order.size() / (float)init_map_size) * 100 << "%"
-              << std::endl;
-    saliencies.push_back(btit->second->mqit->first);
-    if (updateRegion) {
-      rmap.merge(r0, r1, keyToAssign);
-    }
+    order.push_back(
+        TTriple<typename TBoundaryTable::Key>(r0, r1, keyToAssign));
+    saliencies.push_back(bt.saliency(btit));
+    fmerge(r0, r1, keyToAssign);
     bt.update(btit, keyToAssign++, updateFb, updateFsal);
   }
+  GLIA_COUNT("merge.count", order.size() - n0);
+}
+
+// Greedy merging on an initialized boundary table
+// fmerge(r0, r1, r2): called after each merge is recorded
+template <typename TBoundaryTable, typename UFb, typename UFsal,
+          typename CFunc, typename MFunc>
+void genMergeOrderGreedy(
+    std::vector<TTriple<typename TBoundaryTable::Key>> &order,
+    std::vector<double> &saliencies, TBoundaryTable &bt,
+    typename TBoundaryTable::Key keyToAssign, uint nRegions, UFb updateFb,
+    UFsal updateFsal, CFunc fcond, MFunc fmerge) {
+  genMergeOrder(order, saliencies, bt, keyToAssign, nRegions, updateFb,
+                updateFsal, [&bt, &fcond]() { return bt.top(fcond); },
+                fmerge);
+}
+
+// Randomized merging on an initialized boundary table
+// Each boundary passing fcond is drawn with probability proportional to
+// fweight(saliency) (see TBoundaryTable::initSampler)
+// frand(): uniform random number in [0, 1)
+template <typename TBoundaryTable, typename UFb, typename UFsal,
+          typename CFunc, typename MFunc, typename WFunc, typename RFunc>
+void genMergeOrderSampled(
+    std::vector<TTriple<typename TBoundaryTable::Key>> &order,
+    std::vector<double> &saliencies, TBoundaryTable &bt,
+    typename TBoundaryTable::Key keyToAssign, uint nRegions, UFb updateFb,
+    UFsal updateFsal, CFunc fcond, MFunc fmerge, WFunc fweight,
+    RFunc &frand) {
+  bt.initSampler(fweight);
+  genMergeOrder(order, saliencies, bt, keyToAssign, nRegions, updateFb,
+                updateFsal, [&bt, &fcond, &frand]() {
+                  return bt.top(fcond, frand);
+                }, fmerge);
+}
+
+template <typename TBTItemData, typename TRegionMap, typename IFb, typename UFb,
+          typename IFsal, typename UFsal, typename CFunc>
+void genMergeOrderGreedy(std::vector<TTriple<typename TRegionMap::Key>> &order,
+                         std::vector<double> &saliencies, TRegionMap &rmap,
+                         bool updateRegion, IFb initFb, IFsal initFsal,
+                         UFb updateFb, UFsal updateFsal, CFunc fcond,
+                         BoundaryQueue qmode = BoundaryQueue::Indexed) {
+  typedef typename TRegionMap::Key Key;
+  TBoundaryTable<TBTItemData, TRegionMap> bt(rmap, initFb, initFsal, qmode);
+  genMergeOrderGreedy(order, saliencies, bt, rmap.maxKey() + 1, rmap.size(),
+                      updateFb, updateFsal, fcond,
+                      [&rmap, updateRegion](Key r0, Key r1, Key r2) {
+                        if (updateRegion) {
+                          rmap.merge(r0, r1, r2);
+                        }
+                      });
 }
 
 template <typename TRegionMap, typename TImagePtr, typename CFunc>
 void genMergeOrderGreedyUsingPbMean(
     std::vector<TTriple<typename TRegionMap::Key>> &order,
     std::vector<double> &saliencies, TRegionMap &rmap, bool updateRegion,
-    TImagePtr const &pbImage, CFunc fcond) {
+    TImagePtr const &pbImage, CFunc fcond,
+    BoundaryQueue qmode = BoundaryQueue::Indexed) {
   // std::cout << "genMergeOrderGreedyUsingPbMean: 1" << std::endl;
   typedef std::pair<double, int> ItemData;
   // std::cout << "genMergeOrderGreedyUsingPbMean: 2" << std::endl;
@@ -99,31 +153,49 @@ void genMergeOrderGreedyUsingPbMean(
     return -data2s.first;
   };
   genMergeOrderGreedy<ItemData>(order, saliencies, rmap, updateRegion, initFb,
-                                initFsal, updateFb, updateFsal, fcond);
+                                initFsal, updateFb, updateFsal, fcond, qmode);
+}
+
+// Empty quantile sketch spanning the value range of pbImage
+template <typename TImagePtr>
+QuantileSketch genPbSketch(TImagePtr const &pbImage, uint nBin) {
+  auto const *buf = pbImage->GetBufferPointer();
+  auto n = pbImage->GetBufferedRegion().GetNumberOfPixels();
+  if (n == 0) {
+    return QuantileSketch(0.0, 1.0, nBin);
+  }
+  auto mm = std::minmax_element(buf, buf + n);
+  return QuantileSketch(*mm.first, *mm.second, nBin);
 }
 
+// Boundary pb medians are kept in bounded quantile sketches of nBin bins
+// Medians are off by at most (max(pb) - min(pb)) / (2 * nBin)
 template <typename TRegionMap, typename TImagePtr, typename CFunc,
           typename AFunc>
 void genMergeOrderGreedyUsingPbApproxMedian(
     std::vector<TTriple<typename TRegionMap::Key>> &order,
     std::vector<double> &saliencies, TRegionMap &rmap, bool updateRegion,
-    TImagePtr const &pbImage, CFunc fcond, AFunc faux) {
-  typedef std::vector<double> ItemData;
+    TImagePtr const &pbImage, CFunc fcond, AFunc faux,
+    BoundaryQueue qmode = BoundaryQueue::Indexed,
+    uint nBin = PB_SKETCH_BIN) {
+  typedef QuantileSketch ItemData;
   typedef typename TRegionMap::Key Key;
+  auto sketch = genPbSketch(pbImage, nBin);
   // Saliency and item data update functions
-  auto initFb = [&pbImage, &rmap, &faux](ItemData &data, Key r0, Key r1) {
+  auto initFb = [&pbImage, &rmap, &faux, &sketch](ItemData &data, Key r0,
+                                                 Key r1) {
     auto rit0 = rmap.find(r0);
     auto rit1 = rmap.find(r1);
     typename TRegionMap::Region::Boundary b;
     getBoundary(b, rit0->second, rit1->second);
-    data.reserve(b.size());
+    data = sketch;
     b.traverse([&pbImage, &data](typename TRegionMap::Point const &p) {
-      data.push_back(pbImage->GetPixel(p));
+      data.add(pbImage->GetPixel(p));
     });
     faux(data, r0, r1);
   };
-  auto initFsal = [](ItemData &data, Key r0, Key r1) -> double {
-    double p = stats::amedian(data);
+  auto initFsal = [](ItemData const &data, Key r0, Key r1) -> double {
+    double p = data.median();
     if (p == DUMMY) {
       perr("Error: invalid boundary saliency...");
     }
@@ -131,46 +203,46 @@ void genMergeOrderGreedyUsingPbApproxMedian(
   };
   auto updateFb = [&faux](ItemData &data2s, Key r0, Key r1, Key rs, Key r2,
                           ItemData *pData0s, ItemData *pData1s) {
-    if (pData0s && pData1s) {
-      splice(data2s, *pData0s, *pData1s);
-    } else if (pData0s) {
-      splice(data2s, *pData0s);
-    } else if (pData1s) {
-      splice(data2s, *pData1s);
+    if (pData0s) {
+      data2s.merge(*pData0s);
+    }
+    if (pData1s) {
+      data2s.merge(*pData1s);
     }
     faux(data2s, rs, r2);
   };
   auto updateFsal = [](ItemData &data2s, Key rs, Key r2) -> double {
-    double p = stats::amedian(data2s);
+    double p = data2s.median();
     if (p == DUMMY) {
       perr("Error: invalid boundary saliency...");
     }
     return -p;
   };
   genMergeOrderGreedy<ItemData>(order, saliencies, rmap, updateRegion, initFb,
-                                initFsal, updateFb, updateFsal, fcond);
+                                initFsal, updateFb, updateFsal, fcond, qmode);
 }
 
 template <typename TRegionMap, typename TImagePtr, typename CFunc>
 void genMergeOrderGreedyUsingPbApproxMedianAndMinSize(
     std::vector<TTriple<typename TRegionMap::Key>> &order,
     std::vector<double> &saliencies, TRegionMap &rmap, TImagePtr const &pbImage,
-    CFunc fcond) {
-  typedef std::vector<double> ItemData;
+    CFunc fcond, uint nBin = PB_SKETCH_BIN) {
+  typedef QuantileSketch ItemData;
   typedef typename TRegionMap::Key Key;
+  auto sketch = genPbSketch(pbImage, nBin);
   // Saliency and item data update functions
-  auto initFb = [&pbImage, &rmap](ItemData &data, Key r0, Key r1) {
+  auto initFb = [&pbImage, &rmap, &sketch](ItemData &data, Key r0, Key r1) {
     auto rit0 = rmap.find(r0);
     auto rit1 = rmap.find(r1);
     typename TRegionMap::Region::Boundary b;
     getBoundary(b, rit0->second, rit1->second);
-    data.reserve(b.size());
+    data = sketch;
     b.traverse([&pbImage, &data](typename TRegionMap::Point const &p) {
-      data.push_back(pbImage->GetPixel(p));
+      data.add(pbImage->GetPixel(p));
     });
   };
-  auto initFsal = [&rmap](ItemData &data, Key r0, Key r1) -> double {
-    double p = stats::amedian(data);
+  auto initFsal = [&rmap](ItemData const &data, Key r0, Key r1) -> double {
+    double p = data.median();
     if (p == DUMMY) {
       perr("Error: invalid boundary saliency...");
     }
@@ -179,16 +251,15 @@ void genMergeOrderGreedyUsingPbApproxMedianAndMinSize(
   };
   auto updateFb = [](ItemData &data2s, Key r0, Key r1, Key rs, Key r2,
                      ItemData *pData0s, ItemData *pData1s) {
-    if (pData0s && pData1s) {
-      splice(data2s, *pData0s, *pData1s);
-    } else if (pData0s) {
-      splice(data2s, *pData0s);
-    } else if (pData1s) {
-      splice(data2s, *pData1s);
+    if (pData0s) {
+      data2s.merge(*pData0s);
+    }
+    if (pData1s) {
+      data2s.merge(*pData1s);
     }
   };
   auto updateFsal = [&rmap](ItemData &data2s, Key rs, Key r2) -> double {
-    double p = stats::amedian(data2s);
+    double p = data2s.median();
     if (p == DUMMY) {
       perr("Error: invalid boundary saliency...");
     }
@@ -199,26 +270,37 @@ void genMergeOrderGreedyUsingPbApproxMedianAndMinSize(
                                 updateFb, updateFsal, fcond);
 }
 
+// Map base keys of order to their final merged keys
 template <typename TKey>
 void transformKeys(std::unordered_map<TKey, TKey> &lmap,
                    std::vector<TTriple<TKey>> const &order) {
-  std::unordered_set<TKey> newKeys;
-  std::unordered_map<TKey, TKey> omap;
-  for (auto const &merge : order) {
-    omap[merge.x0] = merge.x2;
-    omap[merge.x1] = merge.x2;
-    newKeys.insert(merge.x2);
+  TKeyIndex<TKey> kidx;
+  std::vector<TTriple<uint32>> dorder;
+  compactOrder(dorder, kidx, order);
+  uint32 const NONE = TKeyIndex<TKey>::NONE;
+  std::vector<uint32> parent(kidx.size(), NONE);
+  std::vector<bool> isNew(kidx.size(), false);
+  for (auto const &merge : dorder) {
+    parent[merge.x0] = merge.x2;
+    parent[merge.x1] = merge.x2;
+    isNew[merge.x2] = true;
   }
-  for (auto const &op : omap) {
-    if (newKeys.count(op.first) == 0) {
-      TKey dst = op.second;
-      auto oit = omap.find(dst);
-      while (oit != omap.end()) {
-        dst = oit->second;
-        oit = omap.find(dst);
-      }
-      lmap[op.first] = dst;
+  // Roots are resolved once per chain by path compression
+  std::vector<uint32> path;
+  for (uint32 k = 0; k < kidx.size(); ++k) {
+    if (isNew[k] || parent[k] == NONE) {
+      continue;
+    }
+    uint32 dst = k;
+    while (parent[dst] != NONE && parent[dst] != dst) {
+      path.push_back(dst);
+      dst = parent[dst];
+    }
+    for (auto p : path) {
+      parent[p] = dst;
     }
+    path.clear();
+    lmap[kidx.key(k)] = kidx.key(dst);
   }
 }
 
@@ -1,6 +1,8 @@
 #ifndef _glia_util_struct_merge_bc_hxx_
 #define _glia_util_struct_merge_bc_hxx_
 
+#include "type/region_store.hxx"
+#include "util/random.hxx"
 #include "util/struct_merge.hxx"
 
 namespace glia {
@@ -15,11 +17,16 @@ genMergeOrderGreedyUsingBoundaryClassifier (
   typedef TBcFeat ItemData;
   typedef TBoundaryTable<ItemData, TRegionMap> BoundaryTable;
   typedef typename TRegionMap::Key Key;
+  typedef typename TRegionMap::Region Region;
+  // Merged regions are built aside: rmap is iterated while the table is
+  // initialized
   auto initFb = [&rmap, &fBcFeat](ItemData& data, Key r0, Key r1) {
-    rmap.erase(BG_VAL);
-    auto rit2 = rmap.merge(r0, r1, BG_VAL);
-    fBcFeat(data, rmap.find(r0)->second, rmap.find(r1)->second,
-            rit2->second, r0, r1, BG_VAL);
+    Region const& reg0 = rmap.find(r0)->second;
+    Region const& reg1 = rmap.find(r1)->second;
+    Region reg2;
+    reg2.merge(reg0);
+    reg2.merge(reg1);
+    fBcFeat(data, reg0, reg1, reg2, r0, r1, BG_VAL);
   };
   auto initFsal = [&fBcPred](
       ItemData const& data, Key r0, Key r1) -> double {
@@ -28,10 +35,12 @@ genMergeOrderGreedyUsingBoundaryClassifier (
   auto updateFb = [&rmap, &fBcFeat](
       ItemData& data2s, Key r0, Key r1, Key rs, Key r2,
       ItemData* pData0s, ItemData* pData1s) {
-    rmap.erase(BG_VAL);
-    auto rit3 = rmap.merge(rs, r2, BG_VAL);
-    fBcFeat(data2s, rmap.find(rs)->second, rmap.find(r2)->second,
-            rit3->second, rs, r2, BG_VAL);
+    Region const& regs = rmap.find(rs)->second;
+    Region const& reg2 = rmap.find(r2)->second;
+    Region reg3;
+    reg3.merge(regs);
+    reg3.merge(reg2);
+    fBcFeat(data2s, regs, reg2, reg3, rs, r2, BG_VAL);
   };
   auto updateFsal = [&fBcPred](
       ItemData const& data2s, Key rs, Key r2) -> double {
@@ -51,15 +60,70 @@ genMergeOrderGreedyUsingBoundaryClassifier (
     TSegImagePtr const& segImage, TMaskPtr const& mask,
     FFunc fBcFeat, BCFunc fBcPred, CFunc fcond)
 {
-  std::cout << "starting region maps..." << std::endl;
-  TRegionMap<TKey, Point<TImage<TSegImagePtr>::ImageDimension>>
-      rmap(segImage, mask, false); // Both region points and contours
-  std::cout << "rmap.size(): " << rmap.size() << std::endl;
-  std::cout << "starting genMergeOrderGreedyUsingBoundaryClassifier..." << std::endl;
+  TRegionMap<TKey, Point<TImage<TSegImagePtr>::ImageDimension>> rmap;
+  {
+    GLIA_TIMER("rmap.build");
+    rmap.set(segImage, mask, false); // Both region points and contours
+  }
+  GLIA_GAUGE("rmap.regions", rmap.size());
+  GLIA_GAUGE("rmap.bytes", rmap.bytes());
   genMergeOrderGreedyUsingBoundaryClassifier<TBcFeat>(
       order, saliencies, rmap, fBcFeat, fBcPred, fcond);
 }
 
+
+// Initial boundaries are featurized first and scored in one batch call
+// fBcFeat (TBcFeat& data, Key r0, Key r1);
+// fBcPred (TBcFeat const& data) -> double;
+// fBcPredBatch (std::vector<TBcFeat const*> const& data,
+//               std::vector<double>& sals);
+// fmerge (Key r0, Key r1, Key r2): called before boundaries are updated
+// fBcPred is used for boundaries created by merges
+// rstore (see TRegionStore) is only used for initial boundaries and is
+// not updated
+// qmode: boundary queue (see BoundaryQueue)
+// randomSeed: if non-negative, each merge is drawn with probability
+// proportional to exp(saliency) instead of taking the most salient
+template <typename TBcFeat, typename TRegionStore, typename FFunc,
+          typename BCFunc, typename BBCFunc, typename CFunc,
+          typename MFunc> void
+genMergeOrderGreedyUsingBatchedBoundaryClassifier (
+    std::vector<TTriple<typename TRegionStore::Key>>& order,
+    std::vector<double>& saliencies, TRegionStore const& rstore,
+    FFunc fBcFeat, BCFunc fBcPred, BBCFunc fBcPredBatch, CFunc fcond,
+    MFunc fmerge, BoundaryQueue qmode = BoundaryQueue::Indexed,
+    long randomSeed = -1)
+{
+  typedef TBcFeat ItemData;
+  typedef TBoundaryTable<ItemData, TRegionStore> BoundaryTable;
+  typedef typename TRegionStore::Key Key;
+  auto initFb = [&fBcFeat](ItemData& data, Key r0, Key r1) {
+    fBcFeat(data, r0, r1);
+  };
+  auto updateFb = [&fBcFeat](
+      ItemData& data2s, Key r0, Key r1, Key rs, Key r2,
+      ItemData* pData0s, ItemData* pData1s) {
+    fBcFeat(data2s, rs, r2);
+  };
+  auto updateFsal = [&fBcPred](
+      ItemData const& data2s, Key rs, Key r2) -> double {
+    return fBcPred(data2s);
+  };
+  std::vector<typename BoundaryTable::KeyPair> keys;
+  rstore.boundaryKeys(keys);
+  BoundaryTable bt(qmode);
+  bt.initBatch(keys, initFb, fBcPredBatch);
+  if (randomSeed < 0) {
+    genMergeOrderGreedy(order, saliencies, bt, rstore.maxKey() + 1,
+                        rstore.size(), updateFb, updateFsal, fcond, fmerge);
+    return;
+  }
+  auto frand = random::uniform01(randomSeed);
+  genMergeOrderSampled(order, saliencies, bt, rstore.maxKey() + 1,
+                       rstore.size(), updateFb, updateFsal, fcond, fmerge,
+                       [](double sal) { return std::exp(sal); }, frand);
+}
+
 };
 
 #endif
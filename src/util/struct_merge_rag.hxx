@@ -0,0 +1,47 @@
+#ifndef _glia_util_struct_merge_rag_hxx_
+#define _glia_util_struct_merge_rag_hxx_
+
+#include "type/region_graph.hxx"
+#include "util/struct_merge.hxx"
+
+namespace glia {
+
+// Greedy merging by boundary pb mean or approximate median on a region
+// adjacency graph; boundary statistics are merged, never recomputed
+template <typename TKey, typename CFunc> void
+genMergeOrderGreedyUsingPbStats (
+    std::vector<TTriple<TKey>>& order, std::vector<double>& saliencies,
+    TRegionGraph<TKey>& rag, bool useMedian, CFunc fcond,
+    BoundaryQueue qmode = BoundaryQueue::Indexed)
+{
+  typedef TRegionGraph<TKey> RegionGraph;
+  typedef typename RegionGraph::Edge ItemData;
+  typedef TKey Key;
+  std::vector<typename RegionGraph::KeyPair> keys;
+  rag.boundaryKeys(keys);
+  auto initFb = [&rag](ItemData& data, Key r0, Key r1) {
+    auto eit = rag.edges.find(std::make_pair(r0, r1));
+    data = std::move(eit->second);
+    rag.edges.erase(eit);
+  };
+  auto fsal = [&rag, useMedian](ItemData const& data, Key r0, Key r1)
+      -> double {
+    double p = useMedian? rag.median(data): rag.mean(data);
+    if (p == DUMMY) { perr("Error: invalid boundary saliency..."); }
+    return -p;
+  };
+  auto updateFb = [](ItemData& data2s, Key r0, Key r1, Key rs, Key r2,
+                     ItemData* pData0s, ItemData* pData1s) {
+    if (pData0s) { data2s.merge(*pData0s); }
+    if (pData1s) { data2s.merge(*pData1s); }
+  };
+  TBoundaryTable<ItemData, RegionGraph> bt(keys, initFb, fsal, qmode);
+  genMergeOrderGreedy(order, saliencies, bt, rag.maxKey() + 1, rag.size(),
+                      updateFb, fsal, fcond,
+                      [&rag](Key r0, Key r1, Key r2)
+                      { rag.merge(r0, r1, r2); });
+}
+
+};
+
+#endif
@@ -36,22 +36,22 @@ def main(cfg):
     hmt = libglia.hmt.create()
     hmt.config(3, cfg.n_trees, 0, cfg.sample_size_ratio, cfg.balance)
 
+    hist_bins = 6 * [cfg.hist_bins_color] + 3 * [cfg.hist_bins_daisy]
+    hist_lower = [0., -127., -128., 0., 0., 0., 0., 0., 0.]
+    hist_higher = [100., 128., 127., 1., 1., 1., 256., 256., 256.]
+
     # for each clique, compute features for the boundary classifier
-    bc_feats_fn = lambda order, saliencies, labels, img_lab, img_hsv, daisy_descs, contours: hmt.bc_feat(
-        order, saliencies, labels, img_lab + img_hsv + daisy_descs, contours,
-        6 * [cfg.hist_bins_color] + 3 * [cfg.hist_bins_daisy],
-        [0., -127., -128., 0., 0., 0., 0., 0., 0.], [
-            100., 128., 127., 1., 1., 1., 256., 256., 256.
-        ], cfg.initial_saliency, cfg.saliency_bias, [0.2, 0.5, 0.8], cfg.
-        normalize_area, cfg.use_log_shape)
-
-    # generate merge order using boundary classifier
-    merge_order_bc_fn = lambda labels, img_lab, img_hsv, daisy_descs, contours, thr: hmt.merge_order_bc(
-        labels, img_lab + img_hsv + daisy_descs, contours,
-        6 * [cfg.hist_bins_color] + 3 * [cfg.hist_bins_daisy],
-        [0., -127., -128., 0., 0., 0., 0., 0., 0.], [
-            100., 128., 127., 1., 1., 1., 256., 256., 256.
-        ], cfg.use_log_shape, thr)
+    # (frames are processed in parallel)
+    bc_feats_fn = lambda orders, saliencies, labels, images, contours: hmt.bc_feat_batch(
+        orders, saliencies, labels, images, contours,
+        hist_bins, hist_lower, hist_higher, cfg.initial_saliency,
+        cfg.saliency_bias, [0.2, 0.5, 0.8], cfg.normalize_area,
+        cfg.use_log_shape)
+
+    # generate merge orders using boundary classifier
+    merge_order_bc_fn = lambda labels, images, contours, thr: hmt.merge_order_bc_batch(
+        labels, images, contours, hist_bins, hist_lower, hist_higher,
+        cfg.use_log_shape, thr)
 
     # for all frames, compute features and labels
     phases = ['train', 'test']
@@ -77,35 +77,28 @@ def main(cfg):
     # train boundary classifier with aggregated features
     for t in range(cfg.n_classifiers):
         print('training classifier {}/{}'.format(i + 1, cfg.n_classifiers))
-        for i, s in enumerate(feats['train']):
-            print('{}/{}'.format(i + 1, len(feats['train'])))
+        train = feats['train']
+        labels = [s['labels'] for s in train]
+        contours = [s['contours'] for s in train]
+        images = [s['img_lab'] + s['img_hsv'] + s['daisy_descs'] for s in train]
+        truths = [loader[i]['label/segmentation'] for i in range(len(train))]
+
+        if (t == 0):
+            # This is the merge based on boundary probabilities (first tree in the ensemble)
+            orders = hmt.merge_order_pb_batch(labels, contours, 1)
+        else:
+            orders = merge_order_bc_fn(labels, images, contours,
+                                       hmt.get_threshold())
+        saliencies = [s for _, s in orders]
+        orders = [o for o, _ in orders]
 
-            truth = loader[i]['label/segmentation']
-            img = sample['image']
+        X_list += bc_feats_fn(orders, saliencies, labels, images, contours)
 
-            if (t == 0):
-                # This is the merge based on boundary probabilities (first tree in the ensemble)
-                order, saliencies = hmt.merge_order_pb(s['labels'],
-                                                       s['contours'], 1)
-            else:
-                order, saliencies = merge_order_bc_fn(s['labels'],
-                                                      s['img_lab'],
-                                                      s['img_hsv'],
-                                                      s['daisy_descs'],
-                                                      s['contours'],
-                                                      hmt.get_threshold())
-
-            X = bc_feats_fn(order, saliencies, s['labels'], s['img_lab'],
-                            s['img_hsv'], s['daisy_descs'], s['contours'])
-            X_list.append(X)
-
-            # for each merge, compute label based on groundtruth
-            # -1 is for "merge"
-            # 1 is for "no merge"
-            Y = hmt.bc_label_ri(order, s['labels'],
-                                truth, True, 0, False,
-                                False, 1.0)
-            Y_list.append(Y)
+        # for each merge, compute label based on groundtruth
+        # -1 is for "merge"
+        # 1 is for "no merge"
+        Y_list += hmt.bc_label_ri_batch(orders, labels, truths, True, 0,
+                                        False, False, 1.0)
 
         hmt.train_rf(np.concatenate(X_list, axis=0),
                      np.concatenate(Y_list))
@@ -113,11 +106,17 @@ def main(cfg):
     if(not os.path.exists(cfg.out_path)):
         os.makedirs(cfg.out_path)
 
+    # Shogun models (load_models), also needed to retrain or serialize
     path = pjoin(cfg.out_path, 'models.p')
     models = hmt.get_models()
     print('Saving models to {}'.format(path))
     pickle.dump(models, open(path, 'wb'))
 
+    # Compiled forests for inference (load_models_file)
+    path = pjoin(cfg.out_path, 'models.bin')
+    print('Saving models to {}'.format(path))
+    hmt.save_models(path)
+
 
 if __name__ == "__main__":
 